@@ -10,7 +10,9 @@
       "lldb_lib_dir%": "",
       "lldb_lib_so%": "",
       "build_addon": "false",
+      "build_batch": "false",
       "coverage": "false",
+      "llnode_version%": "unknown",
   },
 
   "target_defaults": {
@@ -21,6 +23,8 @@
 
     "cflags" : [ "-std=c++11" ],
 
+    "defines": [ "LLNODE_VERSION=<(llnode_version)" ],
+
     "conditions": [
       [ "OS == 'mac'", {
         # Necessary for node v4.x
@@ -72,6 +76,74 @@
   }],
 
   "conditions": [
+    [ "build_batch == 'true'", {
+      "targets": [{
+        "target_name": "llnode-batch",
+        "type": "executable",
+        "defines": [ "NO_COLOR_OUTPUT" ],
+        "sources": [
+          "src/llnode_batch.cc",
+          "src/llnode_api.cc",
+          "src/constants.cc",
+          "src/error.cc",
+          "src/llv8.cc",
+          "src/llv8-constants.cc",
+          "src/llscan.cc",
+          "src/printer.cc",
+          "src/node.cc",
+          "src/node-constants.cc",
+          "src/settings.cc",
+        ],
+        "conditions": [
+          [ "OS == 'mac'", {
+                "conditions": [
+                  [ "lldb_lib_dir == ''", {
+                    "variables": {
+                      "mac_shared_frameworks": "/Applications/Xcode.app/Contents/SharedFrameworks",
+                    },
+                    "xcode_settings": {
+                      "OTHER_LDFLAGS": [
+                        "-F<(mac_shared_frameworks)",
+                        "-Wl,-rpath,<(mac_shared_frameworks)",
+                        "-framework LLDB",
+                      ],
+                    },
+                  },
+                  # lldb_lib_dir != ""
+                  {
+                    "xcode_settings": {
+                      "OTHER_LDFLAGS": [
+                        "-Wl,-rpath,<(lldb_lib_dir)",
+                        "-L<(lldb_lib_dir)",
+                        "-l<(lldb_lib)",
+                      ],
+                    },
+                  }],
+                ]
+          }],
+          [ "OS=='linux' or OS=='freebsd' or OS=='android'", {
+            "conditions": [
+              # If we could not locate the lib dir, then we will have to search
+              # from the global search paths during linking and at runtime
+              [ "lldb_lib_dir != ''", {
+                "ldflags": [
+                  "-L<(lldb_lib_dir)",
+                  "-Wl,-rpath,<(lldb_lib_dir)"
+                ]
+              }],
+              # If we cannot find a non-versioned library liblldb(-x.y).so,
+              # then we will have to link to the versioned library
+              # liblldb(-x.y).so.z loaded by the detected lldb executable
+              [ "lldb_lib_so != ''", {
+                "libraries": ["<(lldb_lib_so)"]
+              }, {
+                "libraries": ["-l<(lldb_lib)"]
+              }]
+            ]
+          }]
+        ]
+      }]
+    }],
     [ "build_addon == 'true'", {
       "targets": [{
         "target_name": "addon",
@@ -90,6 +162,7 @@
           "src/llv8-constants.cc",
           "src/llscan.cc",
           "src/printer.cc",
+          "src/node.cc",
           "src/node-constants.cc",
           "src/settings.cc",
         ],
@@ -2,8 +2,10 @@
 
 const {
   fromCoredump,
+  LLNode,
   LLNodeHeapType,
-  nextInstance
+  nextInstance,
+  instanceAddresses
 } = require('bindings')('addon');
 
 function *next() {
@@ -23,6 +25,51 @@ Object.defineProperty(LLNodeHeapType.prototype, 'instances', {
   }
 });
 
+Object.defineProperty(LLNodeHeapType.prototype, 'instanceAddresses', {
+  enumerable: false,
+  configurable: false,
+  get: function() {
+    return instanceAddresses(this);
+  }
+});
+
+// Decode the object at `address`, decoding its properties and elements on
+// first access
+function getObjectInfo(address, maxElements) {
+  const llnode = this;
+  const info = llnode.decodeObject(address, maxElements);
+  if (!info.properties) return info;
+
+  const properties = Object.create(null);
+  for (const [name, child] of info.properties) {
+    let decoded;
+    Object.defineProperty(properties, name, {
+      enumerable: true,
+      get: () => decoded || (decoded = llnode.getObjectInfo(child))
+    });
+  }
+
+  const elements = new Array(info.elements.length);
+  info.elements.forEach((child, index) => {
+    let decoded;
+    Object.defineProperty(elements, index, {
+      enumerable: true,
+      get: () => decoded || (decoded = llnode.getObjectInfo(child))
+    });
+  });
+
+  info.properties = properties;
+  info.elements = elements;
+  return info;
+}
+
+Object.defineProperty(LLNode.prototype, 'getObjectInfo', {
+  enumerable: false,
+  configurable: false,
+  writable: false,
+  value: getObjectInfo
+});
+
 module.exports = {
   fromCoredump
 }
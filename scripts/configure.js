@@ -20,6 +20,9 @@ function main() {
 main();
 
 function configureBuildOptions(config) {
+  // Used to key the on-disk cache of resolved constants
+  config.variables.llnode_version = require('../package.json').version;
+
   // Do not build addon by default until it's less experimental
   const build_addon = (process.env.npm_config_llnode_build_addon ||
     process.env.LLNODE_BUILD_ADDON);
@@ -29,6 +32,15 @@ function configureBuildOptions(config) {
     config.variables.build_addon = 'false';
   }
 
+  // Standalone executable for batch analysis of core dumps
+  const build_batch = (process.env.npm_config_llnode_build_batch ||
+    process.env.LLNODE_BUILD_BATCH);
+  if (build_batch) {
+    config.variables.build_batch = build_batch;
+  } else {
+    config.variables.build_batch = 'false';
+  }
+
   // Optionally build with support for gcov
   const coverage = (process.env.npm_config_llnode_coverage ||
     process.env.LLNODE_COVERAGE);
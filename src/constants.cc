@@ -1,12 +1,29 @@
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <sstream>
+#include <thread>
 
 #include <lldb/API/SBExpressionOptions.h>
 
 #include "src/constants.h"
 
+#ifndef LLNODE_VERSION
+#define LLNODE_VERSION unknown
+#endif
+#define LLNODE_STRINGIFY_(x) #x
+#define LLNODE_STRINGIFY(x) LLNODE_STRINGIFY_(x)
+
 using lldb::SBAddress;
 using lldb::SBError;
 using lldb::SBSymbol;
@@ -24,8 +41,6 @@ T ReadSymbolFromTarget(SBTarget& target, SBAddress& start, const char* name,
 }
 
 Constant<int64_t> Constants::LookupConstant(SBTarget target, const char* name) {
-  int64_t res;
-
   SBSymbolContextList context_list = target.FindSymbols(name);
 
   if (!context_list.IsValid() || context_list.GetSize() == 0) {
@@ -33,7 +48,13 @@ Constant<int64_t> Constants::LookupConstant(SBTarget target, const char* name) {
   }
 
   SBSymbolContext context = context_list.GetContextAtIndex(0);
-  SBSymbol symbol = context.GetSymbol();
+  return ReadConstant(target, context.GetSymbol(), name);
+}
+
+Constant<int64_t> Constants::ReadConstant(SBTarget target, SBSymbol symbol,
+                                          const char* name) {
+  int64_t res;
+
   if (!symbol.IsValid()) {
     return Constant<int64_t>();
   }
@@ -64,14 +85,325 @@ Constant<int64_t> Constants::LookupConstant(SBTarget target, const char* name) {
   return Constant<int64_t>(res, name);
 }
 
-void Constants::Assign(SBTarget target) {
+static bool IsPostmortemSymbol(const char* name) {
+  return strncmp(name, "v8dbg_", 6) == 0 || strncmp(name, "nodedbg_", 8) == 0;
+}
+
+
+void ConstantResolver::Assign(SBTarget target) {
+  target_ = target;
+  indexed_ = false;
+  symbols_.clear();
+  resolved_.clear();
+  missing_.clear();
+  // Profiles describe one V8 version, they don't carry over to other targets
+  profile_.clear();
+  cache_path_ = CachePath(target);
+  cache_hit_ = LoadCache();
+  cache_dirty_ = false;
+  generation_++;
+}
+
+
+std::string ConstantResolver::CachePath(SBTarget target) {
+  // An empty LLNODE_CACHE_DIR disables the cache
+  std::string dir;
+  const char* env = getenv("LLNODE_CACHE_DIR");
+  if (env != nullptr) {
+    dir = env;
+  } else if ((env = getenv("XDG_CACHE_HOME")) != nullptr && *env != '\0') {
+    dir = std::string(env) + "/llnode";
+  } else if ((env = getenv("HOME")) != nullptr && *env != '\0') {
+    dir = std::string(env) + "/.cache/llnode";
+  }
+  if (dir.empty()) return std::string();
+
+  lldb::SBModule executable = target.FindModule(target.GetExecutable());
+  if (!executable.IsValid()) return std::string();
+  const char* build_id = executable.GetUUIDString();
+  if (build_id == nullptr || *build_id == '\0') return std::string();
+
+  std::string name = std::string(LLNODE_STRINGIFY(LLNODE_VERSION)) + "-" +
+                     build_id + ".constants";
+  std::replace(name.begin(), name.end(), '/', '_');
+  return dir + "/" + name;
+}
+
+
+// Create `path` and its missing parents, like `mkdir -p`
+static bool MakeDirectories(const std::string& path) {
+  for (size_t slash = path.find('/', 1);; slash = path.find('/', slash + 1)) {
+    std::string dir = path.substr(0, slash);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    if (slash == std::string::npos) return true;
+  }
+}
+
+
+// The cache has one "name value" line per resolved constant and one "!name"
+// line per constant the binary doesn't have. The trailing "# end" line tells
+// complete files apart from ones another session is still writing.
+bool ConstantResolver::LoadCache() {
+  if (cache_path_.empty()) return false;
+
+  std::ifstream file(cache_path_);
+  if (!file.is_open()) return false;
+
+  std::map<std::string, int64_t> resolved;
+  std::unordered_set<std::string> missing;
+  std::string line;
+  bool complete = false;
+  while (std::getline(file, line)) {
+    if (line == "# end") {
+      complete = true;
+      break;
+    }
+    if (line.empty() || line[0] == '#') continue;
+    if (line[0] == '!') {
+      missing.insert(line.substr(1));
+      continue;
+    }
+
+    std::istringstream entry(line);
+    std::string name;
+    int64_t value;
+    if (!(entry >> name >> value)) break;
+    resolved[name] = value;
+  }
+
+  if (!complete) {
+    PRINT_DEBUG("Ignoring incomplete constants cache %s", cache_path_.c_str());
+    return false;
+  }
+
+  PRINT_DEBUG("Loaded %zu constants from %s", resolved.size(),
+              cache_path_.c_str());
+  resolved_ = std::move(resolved);
+  missing_ = std::move(missing);
+  return true;
+}
+
+
+void ConstantResolver::SaveCache() {
+  cache_dirty_ = false;
+  if (cache_path_.empty()) return;
+
+  // Several instances may load the same binary at once, each writes its
+  // own file and renames it over the cache so readers never see a mix.
+  size_t unique =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+      std::chrono::steady_clock::now().time_since_epoch().count();
+  std::string dir = cache_path_.substr(0, cache_path_.rfind('/'));
+  if (!MakeDirectories(dir)) {
+    PRINT_DEBUG("Failed to create constants cache directory %s", dir.c_str());
+    return;
+  }
+
+  std::string tmp_path = cache_path_ + "." + std::to_string(unique) + ".tmp";
+  std::ofstream file(tmp_path);
+  if (!file.is_open()) {
+    PRINT_DEBUG("Failed to open constants cache %s", tmp_path.c_str());
+    return;
+  }
+
+  file << "# llnode constants cache\n";
+  for (auto& entry : resolved_)
+    file << entry.first << " " << entry.second << "\n";
+  for (auto& name : missing_) file << "!" << name << "\n";
+  file << "# end\n";
+
+  file.close();
+  if (file.fail() || std::rename(tmp_path.c_str(), cache_path_.c_str()) != 0) {
+    PRINT_DEBUG("Failed to write constants cache %s", cache_path_.c_str());
+    std::remove(tmp_path.c_str());
+  }
+}
+
+
+void ConstantResolver::IndexSymbols() {
+  indexed_ = true;
+
+  uint32_t num_modules = target_.GetNumModules();
+  for (uint32_t i = 0; i < num_modules; i++) {
+    lldb::SBModule module = target_.GetModuleAtIndex(i);
+    size_t num_symbols = module.GetNumSymbols();
+    for (size_t j = 0; j < num_symbols; j++) {
+      SBSymbol symbol = module.GetSymbolAtIndex(j);
+      const char* name = symbol.GetName();
+      if (name == nullptr || !IsPostmortemSymbol(name)) continue;
+
+      // First definition wins, like FindSymbols()
+      symbols_.emplace(name, symbol);
+    }
+  }
+
+  PRINT_DEBUG("Indexed %zu postmortem symbols", symbols_.size());
+}
+
+
+Constant<int64_t> ConstantResolver::Resolve(const char* name) {
+  if (!IsPostmortemSymbol(name))
+    return Constants::LookupConstant(target_, name);
+
+  if (!indexed_) IndexSymbols();
+
+  // The symbol tables couldn't be enumerated, search by name instead
+  if (symbols_.empty()) return Constants::LookupConstant(target_, name);
+
+  auto it = symbols_.find(name);
+  if (it == symbols_.end()) return Constant<int64_t>();
+  return Constants::ReadConstant(target_, it->second, name);
+}
+
+
+Constant<int64_t> ConstantResolver::Lookup(const char* name) {
+  auto resolved = resolved_.find(name);
+  if (resolved != resolved_.end())
+    return Constant<int64_t>(resolved->second, name);
+
+  // Binaries without postmortem metadata take the profile's values rather
+  // than searching their symbols for every name
+  if (!profile_.empty()) {
+    if (!indexed_) IndexSymbols();
+    auto it = profile_.find(name);
+    if (symbols_.empty() && it != profile_.end())
+      return Constant<int64_t>(it->second, name);
+  }
+
+  if (missing_.count(name) == 0) {
+    Constant<int64_t> constant = Resolve(name);
+    cache_dirty_ = true;
+    if (constant.Check()) {
+      resolved_[name] = *constant;
+      return constant;
+    }
+    missing_.insert(name);
+  }
+
+  auto it = profile_.find(name);
+  if (it != profile_.end()) return Constant<int64_t>(it->second, name);
+
+  return Constant<int64_t>();
+}
+
+
+bool ConstantResolver::LoadProfile(const std::string& path, Error& err) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    return LoadProfileFile(path, err);
+
+  // `path` is a directory, pick the profile matching the target's V8
+  // version.
+  Constant<int64_t> major = Lookup("v8::internal::Version::major_");
+  Constant<int64_t> minor = Lookup("v8::internal::Version::minor_");
+  Constant<int64_t> patch = Lookup("v8::internal::Version::patch_");
+  if (!major.Check() || !minor.Check()) {
+    err = Error::Failure(
+        "Unable to determine the target's V8 version to pick a layout "
+        "profile in %s, pass a profile file explicitly",
+        path.c_str());
+    return false;
+  }
+
+  std::string version = std::to_string(*major) + "." + std::to_string(*minor);
+  std::string base = path + "/" + version;
+  std::string candidates[] = {
+      base + "." + std::to_string(patch.Check() ? *patch : 0) + ".layout",
+      base + ".layout"};
+  for (const std::string& candidate : candidates) {
+    if (std::ifstream(candidate).good()) return LoadProfileFile(candidate, err);
+  }
+
+  err = Error::Failure("No layout profile for V8 %s in %s", version.c_str(),
+                       path.c_str());
+  return false;
+}
+
+
+bool ConstantResolver::LoadProfileFile(const std::string& path, Error& err) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    err = Error::Failure("Failed to open layout profile %s", path.c_str());
+    return false;
+  }
+
+  std::unordered_map<std::string, int64_t> profile;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    if (line.empty() || line[0] == '#') continue;
+
+    std::istringstream entry(line);
+    std::string name;
+    int64_t value;
+    if (!(entry >> name >> value)) {
+      err = Error::Failure("Invalid layout profile entry at %s:%d",
+                           path.c_str(), line_number);
+      return false;
+    }
+    profile[name] = value;
+  }
+
+  if (profile.empty()) {
+    err = Error::Failure("No layout profile found at %s", path.c_str());
+    return false;
+  }
+
+  // Refuse profiles made for a different V8, if we can tell
+  for (const char* name :
+       {"v8::internal::Version::major_", "v8::internal::Version::minor_"}) {
+    Constant<int64_t> actual = Constants::LookupConstant(target_, name);
+    auto expected = profile.find(name);
+    if (actual.Check() && expected != profile.end() &&
+        *actual != expected->second) {
+      err = Error::Failure("Layout profile %s doesn't match the target's V8",
+                           path.c_str());
+      return false;
+    }
+  }
+
+  profile_ = std::move(profile);
+  generation_++;
+  return true;
+}
+
+
+bool ConstantResolver::SaveProfile(const std::string& path, Error& err) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    err = Error::Failure("Failed to open %s for writing", path.c_str());
+    return false;
+  }
+
+  file << "# llnode layout profile\n";
+  for (auto& entry : resolved_)
+    file << entry.first << " " << entry.second << "\n";
+
+  file.close();
+  if (file.fail()) {
+    err = Error::Failure("Failed to write layout profile %s", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+void Constants::Assign(SBTarget target, ConstantResolver* resolver) {
   loaded_ = false;
   target_ = target;
+  resolver_ = resolver;
+}
+
+
+Constant<int64_t> Constants::Lookup(const std::string& name) {
+  if (resolver_ != nullptr) return resolver_->Lookup(name.c_str());
+  return Constants::LookupConstant(target_, name.c_str());
 }
 
 
 int64_t Constants::LoadRawConstant(const char* name, int64_t def) {
-  auto constant = Constants::LookupConstant(target_, name);
+  auto constant = Lookup(name);
   if (!constant.Check()) {
     PRINT_DEBUG("Failed to load raw constant %s, default to %" PRId64, name,
                 def);
@@ -82,8 +414,7 @@ int64_t Constants::LoadRawConstant(const char* name, int64_t def) {
 }
 
 int64_t Constants::LoadConstant(const char* name, int64_t def) {
-  auto constant =
-      Constants::LookupConstant(target_, (constant_prefix() + name).c_str());
+  auto constant = Lookup(constant_prefix() + name);
   if (!constant.Check()) {
     PRINT_DEBUG("Failed to load constant %s, default to %" PRId64, name, def);
     return def;
@@ -94,11 +425,9 @@ int64_t Constants::LoadConstant(const char* name, int64_t def) {
 
 int64_t Constants::LoadConstant(const char* name, const char* fallback,
                                 int64_t def) {
-  auto constant =
-      Constants::LookupConstant(target_, (constant_prefix() + name).c_str());
+  auto constant = Lookup(constant_prefix() + name);
   if (!constant.Check())
-    constant = Constants::LookupConstant(
-        target_, (constant_prefix() + fallback).c_str());
+    constant = Lookup(constant_prefix() + fallback);
   if (!constant.Check()) {
     PRINT_DEBUG("Failed to load constant %s, fallback %s, default to %" PRId64,
                 name, fallback, def);
@@ -111,8 +440,7 @@ int64_t Constants::LoadConstant(const char* name, const char* fallback,
 Constant<int64_t> Constants::LoadConstant(
     std::initializer_list<const char*> names) {
   for (std::string name : names) {
-    auto constant =
-        Constants::LookupConstant(target_, (constant_prefix() + name).c_str());
+    auto constant = Lookup(constant_prefix() + name);
     if (constant.Check()) return constant;
   }
 
@@ -130,8 +458,7 @@ Constant<int64_t> Constants::LoadConstant(
 Constant<int64_t> Constants::LoadOptionalConstant(
     std::initializer_list<const char*> names, int def) {
   for (std::string name : names) {
-    auto constant =
-        Constants::LookupConstant(target_, (constant_prefix() + name).c_str());
+    auto constant = Lookup(constant_prefix() + name);
     if (constant.Check()) return constant;
   }
 
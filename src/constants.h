@@ -2,7 +2,10 @@
 #define SRC_CONSTANTS_H_
 
 #include <lldb/API/LLDB.h>
+#include <map>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "src/error.h"
 
@@ -66,17 +69,89 @@ class Constant {
     return this;                        \
   }
 
+// Resolves the postmortem constants of a target by symbol name. Constants
+// are read from the target's symbols, and a layout profile can provide the
+// ones the binary doesn't carry (e.g. stripped production builds).
+//
+// Postmortem constants (v8dbg_* and nodedbg_*) are served from an index built
+// with a single pass over the target's symbol tables the first time one of
+// them is requested, instead of searching every module once per name.
+//
+// Resolved constants, and the ones the binary doesn't have, are also kept in
+// an on-disk cache keyed by the executable's build-id and llnode's version,
+// so that later sessions on the same binary skip symbol resolution.
+//
+// A layout profile is a text file with one "name value" pair per line. It is
+// generated with SaveProfile() from a binary which has postmortem metadata,
+// and it's specific to the V8 version of that binary. When the target has no
+// postmortem symbols at all, the profile answers lookups directly instead of
+// the target being searched for each name. Profiles are dropped by Assign().
+class ConstantResolver {
+ public:
+  ConstantResolver()
+      : generation_(0),
+        indexed_(false),
+        cache_hit_(false),
+        cache_dirty_(false) {}
+
+  void Assign(lldb::SBTarget target);
+
+  Constant<int64_t> Lookup(const char* name);
+
+  // `path` can be a profile file or a directory of profiles named after the
+  // V8 version they describe (`<major>.<minor>.<patch>.layout` or
+  // `<major>.<minor>.layout`), in which case the target's V8 version selects
+  // one.
+  bool LoadProfile(const std::string& path, Error& err);
+  // Write every constant resolved from the target so far.
+  bool SaveProfile(const std::string& path, Error& err);
+
+  inline bool has_profile() const { return !profile_.empty(); }
+
+  // True when the target's constants weren't found in the cache, in which
+  // case users should resolve all of their constants and call SaveCache().
+  inline bool needs_cache() const {
+    return !cache_path_.empty() && !cache_hit_;
+  }
+  inline bool cache_dirty() const { return cache_dirty_; }
+  void SaveCache();
+
+  // Changes every time the set of known constants changes, so that users of
+  // the resolver know when to reload their constants.
+  inline uint64_t generation() const { return generation_; }
+
+ private:
+  bool LoadProfileFile(const std::string& path, Error& err);
+  void IndexSymbols();
+  Constant<int64_t> Resolve(const char* name);
+  static std::string CachePath(lldb::SBTarget target);
+  bool LoadCache();
+
+  lldb::SBTarget target_;
+  uint64_t generation_;
+  bool indexed_;
+  std::unordered_map<std::string, lldb::SBSymbol> symbols_;
+  std::map<std::string, int64_t> resolved_;
+  std::unordered_set<std::string> missing_;
+  std::string cache_path_;
+  bool cache_hit_;
+  bool cache_dirty_;
+  std::unordered_map<std::string, int64_t> profile_;
+};
+
 class Constants {
  public:
-  Constants() : loaded_(false) {}
+  Constants() : loaded_(false), resolver_(nullptr) {}
 
   inline bool is_loaded() const { return loaded_; }
 
-  void Assign(lldb::SBTarget target);
+  void Assign(lldb::SBTarget target, ConstantResolver* resolver = nullptr);
 
   inline virtual std::string constant_prefix() { return ""; };
 
   static Constant<int64_t> LookupConstant(SBTarget target, const char* name);
+  static Constant<int64_t> ReadConstant(SBTarget target, lldb::SBSymbol symbol,
+                                        const char* name);
 
  protected:
   int64_t LoadRawConstant(const char* name, int64_t def = -1);
@@ -87,8 +162,11 @@ class Constants {
   Constant<int64_t> LoadOptionalConstant(
       std::initializer_list<const char*> names, int def);
 
+  Constant<int64_t> Lookup(const std::string& name);
+
   lldb::SBTarget target_;
   bool loaded_;
+  ConstantResolver* resolver_;
 };
 
 }  // namespace llnode
@@ -3,15 +3,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <lldb/API/SBExpressionOptions.h>
 
 #include "src/error.h"
 #include "src/llnode.h"
 #include "src/llscan.h"
+#include "src/llv8-inl.h"
 #include "src/llv8.h"
 #include "src/node-inl.h"
 #include "src/printer.h"
@@ -26,6 +33,7 @@ using lldb::SBCommandReturnObject;
 using lldb::SBDebugger;
 using lldb::SBError;
 using lldb::SBExpressionOptions;
+using lldb::SBFileSpec;
 using lldb::SBFrame;
 using lldb::SBStream;
 using lldb::SBSymbol;
@@ -34,6 +42,21 @@ using lldb::SBThread;
 using lldb::SBValue;
 
 
+// Builtin name or name of the function running `code`
+static std::string GetCodeName(v8::LLV8* llv8, const v8::CodeMap::Entry* code,
+                               const char** kind) {
+  *kind = "builtin";
+  if (!code->name.empty()) return code->name;
+
+  *kind = "code";
+  if (code->function == 0) return std::string();
+  Error err;
+  v8::JSFunction fn(llv8, code->function);
+  std::string name = fn.Name(err);
+  return err.Success() ? name : std::string();
+}
+
+
 bool BacktraceCmd::DoExecute(SBDebugger d, char** cmd,
                              SBCommandReturnObject& result) {
   SBTarget target = d.GetSelectedTarget();
@@ -43,9 +66,20 @@ bool BacktraceCmd::DoExecute(SBDebugger d, char** cmd,
     return false;
   }
 
+  bool json = false;
+  bool all = false;
+  const char* count = nullptr;
+  for (char** p = cmd; p != nullptr && *p != nullptr; p++) {
+    if (strcmp(*p, "-j") == 0 || strcmp(*p, "--json") == 0)
+      json = true;
+    else if (strcmp(*p, "all") == 0)
+      all = true;
+    else if (count == nullptr)
+      count = *p;
+  }
+
   errno = 0;
-  int number =
-      (cmd != nullptr && *cmd != nullptr) ? strtol(*cmd, nullptr, 10) : -1;
+  int number = count != nullptr ? strtol(count, nullptr, 10) : -1;
   if ((number == 0 && errno == EINVAL) || (number < 0 && number != -1)) {
     result.SetError("Invalid number of frames");
     return false;
@@ -54,7 +88,18 @@ bool BacktraceCmd::DoExecute(SBDebugger d, char** cmd,
   // Load V8 constants from postmortem data
   llv8_->Load(target);
 
-  {
+  if (all) return BacktraceAllThreads(target, number, json, result);
+
+  ResultSink sink(result);
+  std::unique_ptr<JSONWriter> writer;
+  if (json) {
+    writer.reset(new JSONWriter(&sink));
+    writer->BeginObject();
+    writer->Key("thread");
+    writer->Int(thread.GetIndexID());
+    writer->Key("frames");
+    writer->BeginArray();
+  } else {
     SBStream desc;
     if (!thread.GetDescription(desc)) return false;
     result.Printf(" * %s", desc.GetData());
@@ -69,12 +114,36 @@ bool BacktraceCmd::DoExecute(SBDebugger d, char** cmd,
     const char star = (frame == selected_frame ? '*' : ' ');
     const uint64_t pc = frame.GetPC();
 
+    if (writer) {
+      writer->BeginObject();
+      writer->Key("index");
+      writer->Int(i);
+      writer->Key("pc");
+      writer->Address(pc);
+      writer->Key("selected");
+      writer->Bool(frame == selected_frame);
+    }
+
     if (v8::JSFrame::MightBeV8Frame(frame)) {
       Error err;
       v8::JSFrame v8_frame(llv8_, static_cast<int64_t>(frame.GetFP()));
       Printer printer(llv8_);
       std::string res = printer.Stringify(v8_frame, err);
-      if (err.Success()) {
+      if (err.Success() && writer) {
+        writer->Key("description");
+        writer->String(res);
+        // Markers like <exit> or <stub> don't have a function to decode
+        if (res[0] == '<') {
+          writer->Key("kind");
+          writer->String("v8");
+        } else {
+          writer->Key("kind");
+          writer->String("js");
+          WriteJSFrameJSON(v8_frame, writer.get(), err);
+        }
+        writer->EndObject();
+        continue;
+      } else if (err.Success()) {
         result.Printf("  %c frame #%u: 0x%016" PRIx64 " %s\n", star, i, pc,
                       res.c_str());
         continue;
@@ -83,28 +152,346 @@ bool BacktraceCmd::DoExecute(SBDebugger d, char** cmd,
       }
     }
 
-    // Heuristic: a PC in WX memory is almost certainly a V8 builtin.
-    // TODO(bnoordhuis) Find a way to map the PC to the builtin's name.
-    {
-      lldb::SBMemoryRegionInfo info;
-      if (target.GetProcess().GetMemoryRegionInfo(pc, info).Success() &&
-          info.IsExecutable() && info.IsWritable()) {
-        result.Printf("  %c frame #%u: 0x%016" PRIx64 " <builtin>\n", star, i,
-                      pc);
-        continue;
+    // Builtins and JIT code found by the heap scan, by address
+    v8::CodeMap* code_map = llv8_->code_map();
+    const v8::CodeMap::Entry* code = code_map->Find(pc);
+    if (code != nullptr) {
+      const char* kind;
+      std::string name = GetCodeName(llv8_, code, &kind);
+      if (writer) {
+        writer->Key("kind");
+        writer->String(kind);
+        if (!name.empty()) {
+          writer->Key("function");
+          writer->String(name);
+        }
+        writer->EndObject();
+      } else {
+        result.Printf("  %c frame #%u: 0x%016" PRIx64 " <%s%s%s>\n", star, i,
+                      pc, kind, name.empty() ? "" : ": ", name.c_str());
+      }
+      continue;
+    }
+
+    // Without embedded builtins, a PC in WX memory is almost certainly a
+    // builtin in the code space.
+    lldb::SBMemoryRegionInfo info;
+    if (!code_map->HasBuiltins() &&
+        target.GetProcess().GetMemoryRegionInfo(pc, info).Success() &&
+        info.IsExecutable() && info.IsWritable()) {
+      if (writer) {
+        writer->Key("kind");
+        writer->String("builtin");
+        writer->EndObject();
+      } else {
+        result.Printf("  %c frame #%u: 0x%016" PRIx64 " <builtin>\n", star,
+                      i, pc);
       }
+      continue;
     }
 
     // C++ stack frame.
+    if (writer) {
+      writer->Key("kind");
+      writer->String("native");
+      const char* name = frame.GetFunctionName();
+      if (name != nullptr) {
+        writer->Key("function");
+        writer->String(name);
+      }
+      SBFileSpec file = frame.GetLineEntry().GetFileSpec();
+      if (file.IsValid()) {
+        char path[4096];
+        file.GetPath(path, sizeof(path));
+        writer->Key("script");
+        writer->String(path);
+        writer->Key("line");
+        writer->Int(frame.GetLineEntry().GetLine());
+      }
+      writer->EndObject();
+      continue;
+    }
+
     SBStream desc;
     if (frame.GetDescription(desc))
       result.Printf("  %c %s", star, desc.GetData());
   }
 
+  if (writer) {
+    writer->EndArray();
+    writer->EndObject();
+    sink.Write("\n");
+  }
+
   result.SetStatus(eReturnStatusSuccessFinishResult);
   return true;
 }
 
+
+namespace {
+
+// Decoded stack of one thread, innermost frame first
+struct ThreadStack {
+  uint32_t id;
+  std::string name;
+  std::vector<std::string> frames;
+};
+
+}  // namespace
+
+
+// Frames are shown without arguments and without the function's address,
+// so stacks of different threads and processes can be compared.
+static std::vector<ThreadStack> DecodeThreadStacks(v8::LLV8* llv8,
+                                                   SBTarget target,
+                                                   int number) {
+  struct Frame {
+    uint64_t fp;
+    std::string* description;
+  };
+
+  // lldb unwinds the stacks, so frames are collected on this thread and
+  // only the V8 frames are decoded in parallel.
+  lldb::SBProcess process = target.GetProcess();
+  v8::CodeMap* code_map = llv8->code_map();
+  std::vector<ThreadStack> stacks(process.GetNumThreads());
+  std::vector<Frame> jobs;
+  for (uint32_t t = 0; t < stacks.size(); t++) {
+    SBThread thread = process.GetThreadAtIndex(t);
+    uint32_t num_frames = thread.GetNumFrames();
+    if (number != -1) num_frames = std::min<uint32_t>(num_frames, number);
+
+    ThreadStack& stack = stacks[t];
+    stack.id = thread.GetIndexID();
+    stack.name = thread.GetName() != nullptr ? thread.GetName() : "";
+    stack.frames.resize(num_frames);
+    for (uint32_t i = 0; i < num_frames; i++) {
+      SBFrame frame = thread.GetFrameAtIndex(i);
+      if (v8::JSFrame::MightBeV8Frame(frame))
+        jobs.push_back({frame.GetFP(), &stack.frames[i]});
+
+      // Used unless the frame decodes as a V8 frame
+      const v8::CodeMap::Entry* code = code_map->Find(frame.GetPC());
+      const char* name = frame.GetFunctionName();
+      if (code != nullptr) {
+        const char* kind;
+        std::string code_name = GetCodeName(llv8, code, &kind);
+        stack.frames[i] = std::string("<") + kind +
+                          (code_name.empty() ? "" : ": ") + code_name + ">";
+      } else if (name != nullptr) {
+        stack.frames[i] = name;
+      } else {
+        char tmp[32];
+        snprintf(tmp, sizeof(tmp), "0x%016" PRIx64, frame.GetPC());
+        stack.frames[i] = tmp;
+      }
+    }
+  }
+
+  // Workers only read from here on, so resolve every constant up front
+  llv8->LoadAllConstants();
+
+  Printer::PrinterOptions options;
+  options.with_args = false;
+  FunctionNameCache names;
+  std::atomic<size_t> next_job(0);
+  auto worker = [&]() {
+    v8::ReadCache cache(llv8);
+    v8::ReadCache::Scope scope(&cache);
+    Printer printer(llv8, options);
+    printer.set_name_cache(&names);
+
+    for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+      Error err;
+      v8::JSFrame v8_frame(llv8, static_cast<int64_t>(jobs[i].fp));
+      std::string res = printer.Stringify(v8_frame, err);
+      if (err.Fail()) continue;
+
+      // Closures of the same function share a stack
+      size_t fn_pos = res.rfind(" fn=0x");
+      if (fn_pos != std::string::npos) res.resize(fn_pos);
+      *jobs[i].description = res;
+    }
+  };
+
+  size_t worker_count = std::thread::hardware_concurrency();
+  worker_count = std::max<size_t>(1, std::min<size_t>(worker_count, 16));
+  worker_count = std::min(worker_count, std::max<size_t>(1, jobs.size() / 8));
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < worker_count; i++) workers.emplace_back(worker);
+  for (std::thread& t : workers) t.join();
+
+  return stacks;
+}
+
+
+bool BacktraceCmd::BacktraceAllThreads(SBTarget target, int number,
+                                       bool json,
+                                       SBCommandReturnObject& result) {
+  std::vector<ThreadStack> stacks = DecodeThreadStacks(llv8_, target, number);
+
+  // Group threads by their decoded stack
+  struct Group {
+    std::vector<uint32_t> threads;
+    const std::vector<std::string>* frames;
+  };
+  std::map<std::vector<std::string>, Group> groups_by_stack;
+  for (const ThreadStack& stack : stacks) {
+    Group& group = groups_by_stack[stack.frames];
+    group.threads.push_back(stack.id);
+    group.frames = &stack.frames;
+  }
+
+  std::vector<Group*> groups;
+  for (auto& entry : groups_by_stack) groups.push_back(&entry.second);
+  std::sort(groups.begin(), groups.end(), [](const Group* a, const Group* b) {
+    if (a->threads.size() != b->threads.size())
+      return a->threads.size() > b->threads.size();
+    return a->threads[0] < b->threads[0];
+  });
+
+  ResultSink sink(result);
+  if (json) {
+    JSONWriter writer(&sink);
+    writer.BeginObject();
+    writer.Key("stacks");
+    writer.BeginArray();
+    for (const Group* group : groups) {
+      writer.BeginObject();
+      writer.Key("count");
+      writer.Int(group->threads.size());
+      writer.Key("threads");
+      writer.BeginArray();
+      for (uint32_t id : group->threads) writer.Int(id);
+      writer.EndArray();
+      writer.Key("frames");
+      writer.BeginArray();
+      for (const std::string& frame : *group->frames) writer.String(frame);
+      writer.EndArray();
+      writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    sink.Write("\n");
+  } else {
+    for (const Group* group : groups) {
+      std::string threads;
+      for (uint32_t id : group->threads)
+        threads += (threads.empty() ? "#" : ", #") + std::to_string(id);
+      result.Printf(" * %zu thread%s: %s\n", group->threads.size(),
+                    group->threads.size() == 1 ? "" : "s", threads.c_str());
+      for (size_t i = 0; i < group->frames->size(); i++) {
+        result.Printf("    frame #%zu: %s\n", i,
+                      (*group->frames)[i].c_str());
+      }
+      result.Printf("\n");
+    }
+  }
+
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+
+// Frame names can't contain the separators of the folded format
+static std::string FoldedFrame(std::string frame) {
+  std::replace(frame.begin(), frame.end(), ';', ':');
+  std::replace(frame.begin(), frame.end(), '\n', ' ');
+  return frame;
+}
+
+
+bool DumpStacksCmd::DoExecute(SBDebugger d, char** cmd,
+                              SBCommandReturnObject& result) {
+  SBTarget target = d.GetSelectedTarget();
+  if (!target.IsValid() || !target.GetProcess().IsValid()) {
+    result.SetError("No valid process, please start something\n");
+    return false;
+  }
+
+  bool append = false;
+  const char* path = nullptr;
+  for (char** p = cmd; p != nullptr && *p != nullptr; p++) {
+    if (strcmp(*p, "-a") == 0 || strcmp(*p, "--append") == 0)
+      append = true;
+    else if (path == nullptr)
+      path = *p;
+  }
+
+  // Load V8 constants from postmortem data
+  llv8_->Load(target);
+
+  std::vector<ThreadStack> stacks = DecodeThreadStacks(llv8_, target, -1);
+
+  // One line per distinct stack: thread name, then frames from the root
+  // down, then the number of threads.
+  std::map<std::string, size_t> counts;
+  for (const ThreadStack& stack : stacks) {
+    std::string line = FoldedFrame(stack.name.empty() ? "thread" : stack.name);
+    for (auto it = stack.frames.rbegin(); it != stack.frames.rend(); ++it)
+      line += ";" + FoldedFrame(*it);
+    counts[line]++;
+  }
+
+  if (path == nullptr) {
+    for (auto& entry : counts)
+      result.Printf("%s %zu\n", entry.first.c_str(), entry.second);
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  FILE* file = fopen(path, append ? "a" : "w");
+  if (file == nullptr) {
+    Error err = Error::Failure("Failed to open %s: %s", path, strerror(errno));
+    result.SetError(err.GetMessage());
+    return false;
+  }
+  for (auto& entry : counts)
+    fprintf(file, "%s %zu\n", entry.first.c_str(), entry.second);
+  if (fclose(file) != 0) {
+    Error err =
+        Error::Failure("Failed to write %s: %s", path, strerror(errno));
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  result.Printf("Wrote %zu stacks of %zu threads to %s\n", counts.size(),
+                stacks.size(), path);
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+
+void BacktraceCmd::WriteJSFrameJSON(v8::JSFrame v8_frame, JSONWriter* json,
+                                    Error& err) {
+  v8::JSFunction fn = v8_frame.GetFunction(err);
+  if (err.Fail()) return;
+
+  json->Key("fn");
+  json->Address(fn.raw());
+
+  v8::SharedFunctionInfo info = fn.Info(err);
+  if (err.Fail()) return;
+
+  std::string name = info.ProperName(err);
+  if (err.Fail()) return;
+  json->Key("function");
+  json->String(name);
+
+  std::string script_name;
+  int64_t line = 0;
+  int64_t column = 0;
+  if (!info.GetLocation(script_name, line, column, err)) return;
+
+  // Lines start from 1, like in the text output
+  json->Key("script");
+  json->String(script_name);
+  json->Key("line");
+  json->Int(line + 1);
+  json->Key("column");
+  json->Int(column);
+}
+
 bool SetPropertyColorCmd::DoExecute(SBDebugger d, char** cmd,
                                     SBCommandReturnObject& result) {
 #ifdef NO_COLOR_OUTPUT
@@ -204,13 +591,210 @@ bool PrintCmd::DoExecute(SBDebugger d, char** cmd,
   v8::Value v8_value(llv8_, value.GetValueAsSigned());
   Error err;
   Printer printer(llv8_, printer_options);
-  std::string res = printer.Stringify(v8_value, err);
+  ResultSink sink(result);
+  sink.set_limit(printer_options.byte_limit);
+  printer.Print(v8_value, &sink, err);
+  sink.Flush();
   if (err.Fail()) {
     result.SetError(err.GetMessage());
     return false;
   }
 
-  result.Printf("%s\n", res.c_str());
+  if (sink.full())
+    result.Printf("\n(output truncated after %zu bytes)", sink.written());
+  result.Printf("\n");
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+
+bool DumpBufferCmd::DoExecute(SBDebugger d, char** cmd,
+                              SBCommandReturnObject& result) {
+  if (cmd == nullptr || cmd[0] == nullptr || cmd[1] == nullptr) {
+    result.SetError("USAGE: v8 dump buffer expr file\n");
+    return false;
+  }
+
+  SBTarget target = d.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.SetError("No valid process, please start something\n");
+    return false;
+  }
+
+  // The last argument is the output file, everything before it is the
+  // expression.
+  char** last = cmd;
+  while (last[1] != nullptr) last++;
+  const char* path = *last;
+
+  std::string full_cmd;
+  for (char** start = cmd; start != last; start++) full_cmd += *start;
+
+  SBExpressionOptions options;
+  SBValue value = target.EvaluateExpression(full_cmd.c_str(), options);
+  if (value.GetError().Fail()) {
+    SBError error = value.GetError();
+    result.SetError(error);
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+
+  // Load V8 constants from postmortem data
+  llv8_->Load(target);
+
+  v8::Value v8_value(llv8_, value.GetValueAsSigned());
+  v8::HeapObject heap_object(v8_value);
+  if (!heap_object.Check()) {
+    result.SetError("Not a heap object\n");
+    return false;
+  }
+
+  Error err;
+  int64_t type = heap_object.GetType(err);
+  if (err.Fail()) {
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  v8::JSArrayBuffer buffer;
+  v8::CheckedType<uintptr_t> data;
+  v8::CheckedType<size_t> byte_length;
+  if (type == llv8_->types()->kJSArrayBufferType) {
+    buffer = v8::JSArrayBuffer(heap_object);
+    data = buffer.BackingStore();
+    byte_length = buffer.ByteLength();
+  } else if (type == llv8_->types()->kJSTypedArrayType) {
+    v8::JSTypedArray typed_array(heap_object);
+    buffer = typed_array.Buffer(err);
+    if (err.Fail()) {
+      result.SetError(err.GetMessage());
+      return false;
+    }
+
+    // Only dump the part of the backing store this view covers
+    data = typed_array.GetData();
+    v8::CheckedType<size_t> byte_offset = typed_array.ByteOffset();
+    if (data.Check() && byte_offset.Check())
+      data = v8::CheckedType<uintptr_t>(*data + *byte_offset);
+    else
+      data = v8::CheckedType<uintptr_t>();
+    byte_length = typed_array.ByteLength();
+  } else {
+    result.SetError("Value is not an ArrayBuffer or a TypedArray\n");
+    return false;
+  }
+
+  bool neutered = buffer.WasNeutered(err);
+  if (err.Fail()) {
+    result.SetError(err.GetMessage());
+    return false;
+  }
+  if (neutered) {
+    result.SetError("ArrayBuffer is neutered\n");
+    return false;
+  }
+
+  if (!data.Check() || !byte_length.Check()) {
+    result.SetError("Failed to load the backing store\n");
+    return false;
+  }
+
+  FILE* file = fopen(path, "wb");
+  if (file == nullptr) {
+    err = Error::Failure("Failed to open %s: %s", path, strerror(errno));
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  // Copy the backing store in large chunks, so that multi-megabyte buffers
+  // don't need to fit in memory at once.
+  const size_t kChunkSize = 1024 * 1024;
+  lldb::SBProcess process = target.GetProcess();
+  std::vector<char> chunk(std::min<size_t>(*byte_length, kChunkSize));
+  size_t written = 0;
+  while (written < *byte_length) {
+    size_t length = std::min(chunk.size(), *byte_length - written);
+    SBError sberr;
+    process.ReadMemory(*data + written, chunk.data(), length, sberr);
+    if (sberr.Fail()) {
+      err = Error::Failure(
+          "Failed to read backing store memory, addr=0x%016" PRIx64,
+          static_cast<uint64_t>(*data + written));
+      break;
+    }
+    if (fwrite(chunk.data(), 1, length, file) != length) {
+      err = Error::Failure("Failed to write %s: %s", path, strerror(errno));
+      break;
+    }
+    written += length;
+  }
+
+  if (fclose(file) != 0 && err.Success())
+    err = Error::Failure("Failed to write %s: %s", path, strerror(errno));
+  if (err.Fail()) {
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  result.Printf("Wrote %zu bytes from 0x%016" PRIx64 " to %s\n", written,
+                static_cast<uint64_t>(*data), path);
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+
+bool SaveLayoutCmd::DoExecute(SBDebugger d, char** cmd,
+                              SBCommandReturnObject& result) {
+  if (cmd == nullptr || *cmd == nullptr) {
+    result.SetError("USAGE: v8 layout save file\n");
+    return false;
+  }
+
+  SBTarget target = d.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.SetError("No valid process, please start something\n");
+    return false;
+  }
+
+  llv8_->Load(target);
+  node_->Load(target);
+  llv8_->LoadAllConstants();
+  node_->LoadAllConstants();
+
+  Error err;
+  if (!llv8_->resolver()->SaveProfile(*cmd, err)) {
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  result.Printf("Layout profile written to %s\n", *cmd);
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+
+bool LoadLayoutCmd::DoExecute(SBDebugger d, char** cmd,
+                              SBCommandReturnObject& result) {
+  if (cmd == nullptr || *cmd == nullptr) {
+    result.SetError("USAGE: v8 layout load path\n");
+    return false;
+  }
+
+  SBTarget target = d.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.SetError("No valid process, please start something\n");
+    return false;
+  }
+
+  llv8_->Load(target);
+
+  Error err;
+  if (!llv8_->resolver()->LoadProfile(*cmd, err)) {
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  result.Printf("Layout profile loaded from %s\n", *cmd);
   result.SetStatus(eReturnStatusSuccessFinishResult);
   return true;
 }
@@ -218,8 +802,6 @@ bool PrintCmd::DoExecute(SBDebugger d, char** cmd,
 
 bool ListCmd::DoExecute(SBDebugger d, char** cmd,
                         SBCommandReturnObject& result) {
-  static SBFrame last_frame;
-  static uint64_t last_line = 0;
   SBTarget target = d.GetSelectedTarget();
   SBThread thread = target.GetProcess().GetSelectedThread();
   if (!thread.IsValid()) {
@@ -262,12 +844,12 @@ bool ListCmd::DoExecute(SBDebugger d, char** cmd,
   bool reset_line = false;
   if (line_switch) {
     reset_line = true;
-    last_line = line_from_switch;
-  } else if (frame != last_frame) {
-    last_line = 0;
+    last_line_ = line_from_switch;
+  } else if (frame != last_frame_) {
+    last_line_ = 0;
     reset_line = true;
   }
-  last_frame = frame;
+  last_frame_ = frame;
   if (!v8::JSFrame::MightBeV8Frame(frame)) {
     SBCommandInterpreter interpreter = d.GetCommandInterpreter();
     std::string cmd = "source list ";
@@ -285,12 +867,12 @@ bool ListCmd::DoExecute(SBDebugger d, char** cmd,
   uint32_t lines_found = 0;
 
   uint32_t line_cursor = v8_frame.GetSourceForDisplay(
-      reset_line, last_line, kDisplayLines, lines, lines_found, err);
+      reset_line, last_line_, kDisplayLines, lines, lines_found, err);
   if (err.Fail()) {
     result.SetError(err.GetMessage());
     return false;
   }
-  last_line = line_cursor;
+  last_line_ = line_cursor;
 
   for (uint32_t i = 0; i < lines_found; i++) {
     result.Printf("  %d %s\n", line_cursor - lines_found + i + 1,
@@ -315,6 +897,11 @@ bool WorkqueueCmd::DoExecute(SBDebugger d, char** cmd,
   llv8_->Load(target);
   node_->Load(target);
 
+  for (char** start = cmd; start != nullptr && *start != nullptr; start++) {
+    if (strcmp(*start, "-a") == 0 || strcmp(*start, "--all") == 0)
+      return ExecuteAll(target, result);
+  }
+
   node::Environment env = node::Environment::GetCurrent(node_, err);
   if (err.Fail()) {
     result.SetError(err.GetMessage());
@@ -331,6 +918,42 @@ bool WorkqueueCmd::DoExecute(SBDebugger d, char** cmd,
   return true;
 }
 
+bool WorkqueueCmd::ExecuteAll(SBTarget target, SBCommandReturnObject& result) {
+  if (llscan_ == nullptr) {
+    result.SetError("--all is not supported by this command\n");
+    return false;
+  }
+
+  // Environments are only known after a heap scan
+  if (!llscan_->ScanHeapForObjects(target, result)) return false;
+
+  std::vector<IsolateRecord>& isolates = llscan_->GetIsolates();
+  size_t found = 0;
+  for (size_t i = 1; i < isolates.size(); i++) {
+    if (isolates[i].environment == 0) continue;
+    found++;
+
+    Error err;
+    node::Environment env(node_, isolates[i].environment);
+    std::string result_message = GetResultMessage(&env, err);
+    result.Printf("Isolate #%zu (Environment 0x%016" PRIx64 "):\n", i,
+                  isolates[i].environment);
+    if (err.Fail()) {
+      result.Printf("  %s\n", err.GetMessage());
+      continue;
+    }
+    result.Printf("%s\n", result_message.c_str());
+  }
+
+  if (found == 0) {
+    result.SetError("No Environment found in the heap\n");
+    return false;
+  }
+
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
+
 std::string GetActiveHandlesCmd::GetResultMessage(node::Environment* env,
                                                   Error& err) {
   int active_handles = 0;
@@ -395,6 +1018,17 @@ std::string GetActiveRequestsCmd::GetResultMessage(node::Environment* env,
 }
 
 
+// State behind the commands registered into one debugger, so debuggers
+// created in the same process don't share targets. lldb keeps the commands
+// until it exits, so it is never freed.
+struct PluginState {
+  PluginState() : node(&llv8), llscan(&llv8, &node) {}
+
+  v8::LLV8 llv8;
+  node::Node node;
+  LLScan llscan;
+};
+
 void InitDebugMode() {
   bool is_debug_mode = false;
   char* var = getenv("LLNODE_DEBUG");
@@ -412,9 +1046,10 @@ namespace lldb {
 bool PluginInitialize(SBDebugger d) {
   llnode::InitDebugMode();
 
-  static llnode::v8::LLV8 llv8;
-  static llnode::node::Node node(&llv8);
-  static llnode::LLScan llscan = llnode::LLScan(&llv8);
+  llnode::PluginState* state = new llnode::PluginState();
+  llnode::v8::LLV8& llv8 = state->llv8;
+  llnode::node::Node& node = state->node;
+  llnode::LLScan& llscan = state->llscan;
 
   SBCommandInterpreter interpreter = d.GetCommandInterpreter();
 
@@ -425,8 +1060,12 @@ bool PluginInitialize(SBDebugger d) {
       "Show a backtrace with node.js JavaScript functions and their args. "
       "An optional argument is accepted; if that argument is a number, it "
       "specifies the number of frames to display. Otherwise all frames will "
-      "be dumped.\n\n"
-      "Syntax: v8 bt [number]\n");
+      "be dumped. Use -j or --json to get the frames as JSON. Frames in V8 "
+      "builtins are shown with the builtin's name, and frames in JIT code "
+      "with their function's name once the heap has been scanned. With "
+      "`all`, the stacks of every thread are decoded in parallel and "
+      "threads with the same stack are listed together.\n\n"
+      "Syntax: v8 bt [all] [number] [--json]\n");
   interpreter.AddCommand("jsstack", new llnode::BacktraceCmd(&llv8),
                          "Alias for `v8 bt`");
 
@@ -443,11 +1082,52 @@ bool PluginInitialize(SBDebugger d) {
       " * -s, --print-source   - print source code for function objects\n"
       " * -l num, --length num - print maximum of `num` elements from "
       "string/array\n"
+      " * -b num, --byte-limit num - stop printing after `num` bytes of "
+      "output\n"
+      " * -D num, --depth num  - expand nested objects, arrays and contexts "
+      "up to `num` levels deep\n"
+      " * -N num, --node-limit num - expand at most `num` nested values "
+      "(default 10000)\n"
       "\n"
       "Syntax: v8 inspect [flags] expr\n");
   interpreter.AddCommand("jsprint", new llnode::PrintCmd(&llv8, true),
                          "Alias for `v8 inspect`");
 
+  SBCommand dump = v8.AddMultiwordCommand("dump", "Dump V8 data to files");
+  dump.AddCommand("buffer", new llnode::DumpBufferCmd(&llv8),
+                  "Write the contents of an ArrayBuffer or TypedArray to a "
+                  "file. For TypedArrays only the bytes covered by the view "
+                  "are written.\n\n"
+                  "Syntax: v8 dump buffer expr file\n");
+  dump.AddCommand("stacks", new llnode::DumpStacksCmd(&llv8),
+                  "Write the JavaScript and native stacks of every thread as "
+                  "folded stacks for flame graphs, one line per distinct "
+                  "stack with the number of threads. Use -a or --append to "
+                  "add to an existing file, e.g. when running lldb in batch "
+                  "mode over many cores.\n\n"
+                  "Syntax: v8 dump stacks [-a] [file]\n");
+  dump.AddCommand("perfmap", new llnode::DumpPerfMapCmd(&llscan),
+                  "Write the JIT code of JavaScript functions found on the "
+                  "heap as a perf map, to symbolize `perf record` profiles "
+                  "taken without --perf-basic-prof. The default file is "
+                  "/tmp/perf-<pid>.map.\n\n"
+                  "Syntax: v8 dump perfmap [file]\n");
+
+  SBCommand layout = v8.AddMultiwordCommand(
+      "layout", "Layout profiles for binaries without postmortem metadata");
+  layout.AddCommand("save", new llnode::SaveLayoutCmd(&llv8, &node),
+                    "Write every V8 and Node.js constant resolved from the "
+                    "current target to a layout profile.\n\n"
+                    "Syntax: v8 layout save file\n");
+  layout.AddCommand("load", new llnode::LoadLayoutCmd(&llv8),
+                    "Use a layout profile for the constants the current "
+                    "target doesn't have. If `path` is a directory, the "
+                    "profile named after the target's V8 version "
+                    "(<major>.<minor>.<patch>.layout or "
+                    "<major>.<minor>.layout) is used. Stripped binaries "
+                    "without the version symbols need a profile file.\n\n"
+                    "Syntax: v8 layout load path\n");
+
   SBCommand source =
       v8.AddMultiwordCommand("source", "Source code information");
   source.AddCommand("list", new llnode::ListCmd(&llv8),
@@ -463,7 +1143,10 @@ bool PluginInitialize(SBDebugger d) {
                 "List all object types and instance counts grouped by type "
                 "name and sorted by instance count. Use -d or --detailed to "
                 "get an output grouped by type name, properties, and array "
-                "length, as well as more information regarding each type.\n");
+                "length, as well as more information regarding each type. Use "
+                "-j or --json to get the output as JSON. Use --isolates to "
+                "list the instance counts and sizes of each isolate, and "
+                "--isolate <num> to only count the instances of one.\n");
 
   SBCommand settingsCmd =
       v8.AddMultiwordCommand("settings", "Interpreter settings");
@@ -489,6 +1172,17 @@ bool PluginInitialize(SBDebugger d) {
                 "entries displayed "
                 "to `num` (use 0 to show all). To get next page repeat command "
                 "or press [ENTER].\n"
+                " * -p <num>  --page <num>         - show page `num` of "
+                "`--output-limit` entries.\n"
+                " * -o <num>  --offset <num>       - start at entry `num`.\n"
+                " * --from <addr> --to <addr>      - only list instances in "
+                "this address range.\n"
+                " * --sort address|size            - list instances by "
+                "address (default) or from the largest to the smallest.\n"
+                " * -j, --json                     - print the instances as "
+                "JSON.\n"
+                " * --output <file>                - write the instances to "
+                "`file`, rendering them on all cores.\n"
                 "Accepts the same options as `v8 inspect`");
 
   interpreter.AddCommand("findjsinstances",
@@ -496,7 +1190,8 @@ bool PluginInitialize(SBDebugger d) {
                          "List all objects which share the specified map.\n");
 
   v8.AddCommand("nodeinfo", new llnode::NodeInfoCmd(&llscan),
-                "Print information about Node.js\n");
+                "Print information about Node.js. Use -j or --json to get "
+                "the output as JSON.\n");
 
   v8.AddCommand(
       "findrefs", new llnode::FindReferencesCmd(&llscan),
@@ -510,17 +1205,34 @@ bool PluginInitialize(SBDebugger d) {
       " * -s, --string string  - all properties that refer to the specified "
       "JavaScript string value\n"
       " * -r, --recursive      - walk through references tree recursively\n"
+      " * -j, --json           - print references as JSON\n"
       "\n");
 
+  v8.AddCommand("heapsnapshot", new llnode::HeapSnapshotCmd(&llscan),
+                "Write the objects found on the heap, and the references "
+                "between them, as a .heapsnapshot file to open in the Memory "
+                "tab of Chrome DevTools. Only objects `v8 findjsobjects` "
+                "lists become nodes, objects nothing else refers to are "
+                "attached to the root. Strings are written as they're "
+                "found, so the snapshot doesn't have to fit in memory.\n\n"
+                "Syntax: v8 heapsnapshot file\n");
+
   v8.AddCommand("getactivehandles",
-                new llnode::GetActiveHandlesCmd(&llv8, &node),
+                new llnode::GetActiveHandlesCmd(&llv8, &node, &llscan),
                 "Print all pending handles in the queue. Equivalent to running "
-                "process._getActiveHandles() on the living process.\n");
+                "process._getActiveHandles() on the living process.\n\n"
+                "Syntax: v8 getactivehandles [-a|--all]\n\n"
+                " * -a, --all  - print the handles of every Environment found "
+                "in the heap, e.g. of worker threads, grouped by isolate\n");
 
   v8.AddCommand(
-      "getactiverequests", new llnode::GetActiveRequestsCmd(&llv8, &node),
+      "getactiverequests",
+      new llnode::GetActiveRequestsCmd(&llv8, &node, &llscan),
       "Print all pending requests in the queue. Equivalent to "
-      "running process._getActiveRequests() on the living process.\n");
+      "running process._getActiveRequests() on the living process.\n\n"
+      "Syntax: v8 getactiverequests [-a|--all]\n\n"
+      " * -a, --all  - print the requests of every Environment found in the "
+      "heap, e.g. of worker threads, grouped by isolate\n");
 
   // Set initial value for color support
   llnode::Settings* settings = llnode::Settings::GetSettings();
@@ -10,6 +10,9 @@
 
 namespace llnode {
 
+class JSONWriter;
+class LLScan;
+
 class CommandBase : public lldb::SBCommandPluginInterface {};
 
 class BacktraceCmd : public CommandBase {
@@ -21,6 +24,11 @@ class BacktraceCmd : public CommandBase {
                  lldb::SBCommandReturnObject& result) override;
 
  private:
+  void WriteJSFrameJSON(v8::JSFrame v8_frame, JSONWriter* json, Error& err);
+  // `v8 bt all`, threads with the same stack are listed together
+  bool BacktraceAllThreads(lldb::SBTarget target, int number, bool json,
+                           lldb::SBCommandReturnObject& result);
+
   v8::LLV8* llv8_;
 };
 
@@ -52,9 +60,58 @@ class PrintCmd : public CommandBase {
   bool detailed_;
 };
 
+class DumpBufferCmd : public CommandBase {
+ public:
+  DumpBufferCmd(v8::LLV8* llv8) : llv8_(llv8) {}
+  ~DumpBufferCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+
+ private:
+  v8::LLV8* llv8_;
+};
+
+class DumpStacksCmd : public CommandBase {
+ public:
+  DumpStacksCmd(v8::LLV8* llv8) : llv8_(llv8) {}
+  ~DumpStacksCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+
+ private:
+  v8::LLV8* llv8_;
+};
+
+class SaveLayoutCmd : public CommandBase {
+ public:
+  SaveLayoutCmd(v8::LLV8* llv8, node::Node* node) : llv8_(llv8), node_(node) {}
+  ~SaveLayoutCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+
+ private:
+  v8::LLV8* llv8_;
+  node::Node* node_;
+};
+
+class LoadLayoutCmd : public CommandBase {
+ public:
+  LoadLayoutCmd(v8::LLV8* llv8) : llv8_(llv8) {}
+  ~LoadLayoutCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+
+ private:
+  v8::LLV8* llv8_;
+};
+
 class ListCmd : public CommandBase {
  public:
-  ListCmd(v8::LLV8* llv8) : llv8_(llv8) {}
+  ListCmd(v8::LLV8* llv8) : llv8_(llv8), last_line_(0) {}
   ~ListCmd() override {}
 
   bool DoExecute(lldb::SBDebugger d, char** cmd,
@@ -62,11 +119,15 @@ class ListCmd : public CommandBase {
 
  private:
   v8::LLV8* llv8_;
+  // Where the previous `v8 source list` stopped, to continue from there
+  lldb::SBFrame last_frame_;
+  uint64_t last_line_;
 };
 
 class WorkqueueCmd : public CommandBase {
  public:
-  WorkqueueCmd(v8::LLV8* llv8, node::Node* node) : llv8_(llv8), node_(node) {}
+  WorkqueueCmd(v8::LLV8* llv8, node::Node* node, LLScan* llscan = nullptr)
+      : llv8_(llv8), node_(node), llscan_(llscan) {}
   ~WorkqueueCmd() override {}
 
   inline v8::LLV8* llv8() { return llv8_; };
@@ -80,22 +141,26 @@ class WorkqueueCmd : public CommandBase {
   };
 
  private:
+  // --all: the queues of every Environment found by the heap scan
+  bool ExecuteAll(lldb::SBTarget target, lldb::SBCommandReturnObject& result);
+
   v8::LLV8* llv8_;
   node::Node* node_;
+  LLScan* llscan_;
 };
 
 class GetActiveHandlesCmd : public WorkqueueCmd {
  public:
-  GetActiveHandlesCmd(v8::LLV8* llv8, node::Node* node)
-      : WorkqueueCmd(llv8, node) {}
+  GetActiveHandlesCmd(v8::LLV8* llv8, node::Node* node, LLScan* llscan)
+      : WorkqueueCmd(llv8, node, llscan) {}
 
   std::string GetResultMessage(node::Environment* env, Error& err) override;
 };
 
 class GetActiveRequestsCmd : public WorkqueueCmd {
  public:
-  GetActiveRequestsCmd(v8::LLV8* llv8, node::Node* node)
-      : WorkqueueCmd(llv8, node) {}
+  GetActiveRequestsCmd(v8::LLV8* llv8, node::Node* node, LLScan* llscan)
+      : WorkqueueCmd(llv8, node, llscan) {}
 
   std::string GetResultMessage(node::Environment* env, Error& err) override;
 };
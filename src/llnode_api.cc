@@ -12,9 +12,11 @@
 
 #include <algorithm>
 #include <cstring>
+#include <mutex>
 
 #include "src/llnode_api.h"
 #include "src/llscan.h"
+#include "src/llv8-inl.h"
 #include "src/llv8.h"
 #include "src/printer.h"
 
@@ -27,18 +29,19 @@ LLNodeApi::LLNodeApi()
       process(new lldb::SBProcess()),
       llv8(new v8::LLV8()),
       llscan(new LLScan(llv8.get())) {}
-LLNodeApi::~LLNodeApi() = default;
+LLNodeApi::~LLNodeApi() {
+  // Close the core dump with the debugger, batch runs open many of them
+  if (debugger && debugger->IsValid()) lldb::SBDebugger::Destroy(*debugger);
+}
 LLNodeApi::LLNodeApi(LLNodeApi&&) = default;
 LLNodeApi& LLNodeApi::operator=(LLNodeApi&&) = default;
 
-bool LLNodeApi::debugger_initialized_ = false;
-
 /* Initialize the SB API and load the core dump */
 bool LLNodeApi::Init(const char* filename, const char* executable) {
-  if (!LLNodeApi::debugger_initialized_) {
-    lldb::SBDebugger::Initialize();
-    LLNodeApi::debugger_initialized_ = true;
-  }
+  // The SB API is initialized once per process, instances may be created
+  // from several threads.
+  static std::once_flag sb_api_initialized;
+  std::call_once(sb_api_initialized, []() { lldb::SBDebugger::Initialize(); });
 
   if (initialized_) {
     return false;
@@ -136,8 +139,6 @@ std::string LLNodeApi::GetFrame(size_t thread_index, size_t frame_index) {
 void LLNodeApi::ScanHeap() {
   lldb::SBCommandReturnObject result;
   // Initial scan to create the JavaScript object map
-  // TODO: make it possible to create multiple instances
-  // of llscan and llnode
   if (!llscan->ScanHeapForObjects(*target, result)) {
     return;
   }
@@ -176,7 +177,7 @@ uint32_t LLNodeApi::GetTypeTotalSize(size_t type_index) {
   return object_types[type_index]->GetTotalInstanceSize();
 }
 
-std::unordered_set<uint64_t>* LLNodeApi::GetTypeInstances(size_t type_index) {
+std::vector<uint64_t>* LLNodeApi::GetTypeInstances(size_t type_index) {
   if (object_types.size() <= type_index) {
     return nullptr;
   }
@@ -197,4 +198,126 @@ std::string LLNodeApi::GetObject(uint64_t address) {
   }
   return result;
 }
+
+static const char* OddballName(v8::constants::Oddball* oddball, int64_t kind) {
+  if (kind == oddball->kException) return "exception";
+  if (kind == oddball->kFalse) return "false";
+  if (kind == oddball->kTrue) return "true";
+  if (kind == oddball->kUndefined) return "undefined";
+  if (kind == oddball->kNull) return "null";
+  if (kind == oddball->kTheHole) return "hole";
+  if (kind == oddball->kUninitialized) return "uninitialized";
+  return "oddball";
+}
+
+ObjectInfo LLNodeApi::GetObjectInfo(uint64_t address, size_t max_elements) {
+  v8::LLV8* v8 = llscan->v8();
+  ObjectInfo info;
+  info.address = address;
+
+  llnode::Error err;
+  v8::Value value(v8, address);
+  v8::Smi smi(value);
+  if (smi.Check()) {
+    info.kind = ObjectInfo::kSmi;
+    info.type_name = "(Smi)";
+    info.number = smi.GetValue();
+    return info;
+  }
+
+  v8::HeapObject heap_object(value);
+  if (!heap_object.Check()) {
+    info.error = "Not object and not smi";
+    return info;
+  }
+
+  v8::HeapObject map_obj = heap_object.GetMap(err);
+  if (err.Fail()) {
+    info.error = err.GetMessage();
+    return info;
+  }
+  v8::Map map(map_obj);
+  info.map = map.raw();
+
+  int64_t type = map.GetType(err);
+  if (err.Success()) info.type_name = heap_object.GetTypeName(err);
+  if (err.Fail()) {
+    info.error = err.GetMessage();
+    return info;
+  }
+
+  info.kind = ObjectInfo::kOther;
+  if (type < v8->types()->kFirstNonstringType) {
+    v8::String str(heap_object);
+    info.kind = ObjectInfo::kString;
+    info.size = str.Size(err);
+    if (err.Success()) info.string = str.ToString(err);
+  } else {
+    info.size = map.InstanceSize(err);
+  }
+  if (err.Fail()) {
+    info.kind = ObjectInfo::kInvalid;
+    info.error = err.GetMessage();
+    return info;
+  }
+  if (info.kind == ObjectInfo::kString) return info;
+
+  if (type == v8->types()->kHeapNumberType) {
+    v8::HeapNumber number(heap_object);
+    info.kind = ObjectInfo::kHeapNumber;
+    v8::CheckedType<double> number_value = number.GetValue(err);
+    if (number_value.Check()) info.number = *number_value;
+  } else if (type == v8->types()->kOddballType) {
+    v8::Oddball oddball(heap_object);
+    v8::Smi kind = oddball.Kind(err);
+    info.kind = ObjectInfo::kOddball;
+    if (err.Success())
+      info.string = OddballName(v8->oddball(), kind.GetValue());
+  } else if (type == v8->types()->kJSFunctionType) {
+    v8::JSFunction fn(heap_object);
+    info.kind = ObjectInfo::kFunction;
+    info.string = fn.Name(err);
+  } else if (type == v8->types()->kJSArrayType ||
+             v8::JSObject::IsObjectType(v8, type)) {
+    v8::JSObject js_object(heap_object);
+    info.kind = type == v8->types()->kJSArrayType ? ObjectInfo::kArray
+                                                  : ObjectInfo::kObject;
+
+    v8::JSObject::OwnProperties properties(&js_object, err);
+    if (err.Success()) {
+      for (v8::JSObject::OwnProperties::Iterator it = properties.begin();
+           it != properties.end(); it++) {
+        std::pair<v8::Value, v8::Value> entry = *it;
+        ObjectInfo::Property property;
+        property.name = entry.first.ToString(err);
+        if (err.Fail()) break;
+        property.value = entry.second.raw();
+        info.properties.push_back(property);
+      }
+      // A property that failed to decode is reported, the rest are kept
+      Error properties_err = properties.error();
+      if (properties_err.Fail()) info.error = properties_err.GetMessage();
+    }
+
+    v8::HeapObject elements_obj = js_object.Elements(err);
+    v8::FixedArray elements(elements_obj);
+    if (err.Success()) {
+      if (info.kind == ObjectInfo::kArray) {
+        info.element_count = js_object.GetArrayLength(err);
+      } else {
+        info.element_count = elements.Length(err).GetValue();
+      }
+    }
+    int64_t count = std::min(info.element_count,
+                             static_cast<int64_t>(max_elements));
+    for (int64_t i = 0; i < count && err.Success(); i++) {
+      v8::Value element = elements.Get<v8::Value>(i, err);
+      if (err.Success()) info.elements.push_back(element.raw());
+    }
+  }
+
+  // Partially decoded objects are still returned, with the error
+  if (err.Fail()) info.error = err.GetMessage();
+  return info;
+}
 }  // namespace llnode
@@ -5,7 +5,6 @@
 
 #include <memory>
 #include <string>
-#include <unordered_set>
 #include <vector>
 
 namespace lldb {
@@ -24,6 +23,48 @@ namespace v8 {
 class LLV8;
 }
 
+// A heap value decoded into its parts, see LLNodeApi::GetObjectInfo().
+// Properties and elements hold the tagged values of the children, which
+// can be decoded in turn by passing them to GetObjectInfo().
+struct ObjectInfo {
+  enum Kind {
+    kInvalid,
+    kSmi,
+    kHeapNumber,
+    kString,
+    kOddball,
+    kObject,
+    kArray,
+    kFunction,
+    kOther
+  };
+
+  struct Property {
+    std::string name;
+    uint64_t value;
+  };
+
+  uint64_t address = 0;
+  Kind kind = kInvalid;
+  std::string type_name;
+  uint64_t map = 0;
+  int64_t size = 0;
+  // kSmi and kHeapNumber
+  double number = 0;
+  // Contents of a kString, name of a kFunction, and "undefined", "null",
+  // "true", "false", "hole"... for a kOddball
+  std::string string;
+  std::vector<Property> properties;
+  // Length of the array, or capacity of an object's elements
+  int64_t element_count = 0;
+  std::vector<uint64_t> elements;
+  // Set when kind is kInvalid
+  std::string error;
+};
+
+// Each instance owns its debugger, target and V8 state, so several cores
+// can be analyzed at once, one thread per instance. An instance must not be
+// used by two threads at the same time.
 class LLNodeApi {
  public:
   // TODO(joyeecheung): a status class for inspection error
@@ -51,14 +92,16 @@ class LLNodeApi {
   std::string GetTypeName(size_t type_index);
   uint32_t GetTypeInstanceCount(size_t type_index);
   uint32_t GetTypeTotalSize(size_t type_index);
-  std::unordered_set<uint64_t>* GetTypeInstances(size_t type_index);
+  std::vector<uint64_t>* GetTypeInstances(size_t type_index);
   // TODO(joyeecheung): templatize all the `Inspect` in llv8.h to
   // return structured data
   std::string GetObject(uint64_t address);
+  // Decode the value at address without formatting it, with at most
+  // max_elements elements.
+  ObjectInfo GetObjectInfo(uint64_t address, size_t max_elements = 1024);
 
  private:
   bool initialized_;
-  static bool debugger_initialized_;
   std::unique_ptr<lldb::SBDebugger> debugger;
   std::unique_ptr<lldb::SBTarget> target;
   std::unique_ptr<lldb::SBProcess> process;
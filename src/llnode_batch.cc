@@ -0,0 +1,460 @@
+// Headless analysis of core dumps: runs report sections on many cores in
+// parallel through LLNodeApi, without lldb's command interpreter, and
+// writes a JSON report per core.
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/error.h"
+#include "src/llnode_api.h"
+#include "src/printer.h"
+
+namespace llnode {
+
+namespace {
+
+struct BatchOptions {
+  std::string executable;
+  std::vector<std::string> cores;
+  // process, threads, heap or instances=<type>
+  std::vector<std::string> sections;
+  // Reports go to stdout as JSON lines when empty
+  std::string output_dir;
+  size_t jobs = 0;
+  // Bytes of core dumps open at once, 0 means no limit
+  uint64_t memory_budget = 0;
+  size_t top = 50;
+  size_t limit = 100;
+};
+
+// Admits cores while the sum of their sizes fits in the budget. lldb maps
+// the whole core and the heap scan grows with it, so the core size is a
+// fair estimate of what analyzing it costs. A core larger than the budget
+// still runs, alone.
+class MemoryBudget {
+ public:
+  explicit MemoryBudget(uint64_t budget) : budget_(budget), used_(0) {}
+
+  void Acquire(uint64_t amount) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [&]() {
+      return budget_ == 0 || used_ == 0 || used_ + amount <= budget_;
+    });
+    used_ += amount;
+  }
+
+  void Release(uint64_t amount) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    used_ -= amount;
+    released_.notify_all();
+  }
+
+ private:
+  uint64_t budget_;
+  uint64_t used_;
+  std::mutex mutex_;
+  std::condition_variable released_;
+};
+
+const char kUsage[] =
+    "Usage: llnode-batch [options] <node> <core> [<core>...]\n"
+    "\n"
+    "Analyzes the core dumps of the node executable without starting an\n"
+    "lldb session, and writes a JSON report for each of them.\n"
+    "\n"
+    "Options:\n"
+    " * -r, --report <sections>  - comma separated sections of the report:\n"
+    "                              process, threads, heap and\n"
+    "                              instances=<type> (default: process,heap)\n"
+    " * -f, --spec <file>        - read the sections from a file, one per\n"
+    "                              line, # starts a comment\n"
+    " * -o, --output <dir>       - write <dir>/<core name>.json instead of\n"
+    "                              one JSON line per core to stdout, cores\n"
+    "                              with the same name get -<position>\n"
+    "                              appended\n"
+    " * -j, --jobs <num>         - cores analyzed in parallel (default: the\n"
+    "                              number of cores of this machine)\n"
+    " * -m, --memory <MB>        - size of the core dumps analyzed at once\n"
+    "                              (default: no limit)\n"
+    " * -t, --top <num>          - heap types to report (default: 50)\n"
+    " * -n, --limit <num>        - instances to report per type (default:\n"
+    "                              100)\n";
+
+void SplitSections(const std::string& spec,
+                   std::vector<std::string>* sections) {
+  size_t start = 0;
+  while (start <= spec.size()) {
+    size_t end = spec.find(',', start);
+    if (end == std::string::npos) end = spec.size();
+    std::string section = spec.substr(start, end - start);
+    if (!section.empty()) sections->push_back(section);
+    start = end + 1;
+  }
+}
+
+bool ReadSpec(const char* path, std::vector<std::string>* sections) {
+  std::ifstream file(path);
+  if (!file.is_open()) return false;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    line.erase(0, line.find_first_not_of(" \t\r"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (!line.empty()) sections->push_back(line);
+  }
+  return true;
+}
+
+bool IsSection(const std::string& section) {
+  return section == "process" || section == "threads" || section == "heap" ||
+         (section.compare(0, 10, "instances=") == 0 && section.size() > 10);
+}
+
+bool ParseBatchOptions(int argc, char** argv, BatchOptions* options) {
+  static struct option opts[] = {{"report", required_argument, nullptr, 'r'},
+                                 {"spec", required_argument, nullptr, 'f'},
+                                 {"output", required_argument, nullptr, 'o'},
+                                 {"jobs", required_argument, nullptr, 'j'},
+                                 {"memory", required_argument, nullptr, 'm'},
+                                 {"top", required_argument, nullptr, 't'},
+                                 {"limit", required_argument, nullptr, 'n'},
+                                 {"help", no_argument, nullptr, 'h'},
+                                 {nullptr, 0, nullptr, 0}};
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "r:f:o:j:m:t:n:h", opts, nullptr)) !=
+         -1) {
+    switch (opt) {
+      case 'r':
+        SplitSections(optarg, &options->sections);
+        break;
+      case 'f':
+        if (!ReadSpec(optarg, &options->sections)) {
+          fprintf(stderr, "Failed to read report spec %s\n", optarg);
+          return false;
+        }
+        break;
+      case 'o':
+        options->output_dir = optarg;
+        break;
+      case 'j':
+        options->jobs = strtoul(optarg, nullptr, 10);
+        break;
+      case 'm':
+        options->memory_budget = strtoull(optarg, nullptr, 10) << 20;
+        break;
+      case 't':
+        options->top = strtoul(optarg, nullptr, 10);
+        break;
+      case 'n':
+        options->limit = strtoul(optarg, nullptr, 10);
+        break;
+      default:
+        return false;
+    }
+  }
+
+  if (argc - optind < 2) return false;
+  options->executable = argv[optind++];
+  for (; optind < argc; optind++) options->cores.push_back(argv[optind]);
+
+  if (options->sections.empty()) {
+    options->sections.push_back("process");
+    options->sections.push_back("heap");
+  }
+  for (const std::string& section : options->sections) {
+    if (!IsSection(section)) {
+      fprintf(stderr, "Unknown report section %s\n", section.c_str());
+      return false;
+    }
+  }
+
+  if (options->jobs == 0) options->jobs = std::thread::hardware_concurrency();
+  if (options->jobs == 0) options->jobs = 1;
+  return true;
+}
+
+uint64_t FileSize(const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) return 0;
+  return static_cast<uint64_t>(file.tellg());
+}
+
+std::string BaseName(const std::string& path) {
+  size_t slash = path.find_last_of("/\\");
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Report file names, cores sharing a file name get their position in the
+// list appended so that their reports don't overwrite each other.
+std::vector<std::string> ReportNames(const std::vector<std::string>& cores) {
+  std::map<std::string, size_t> counts;
+  for (const std::string& core : cores) counts[BaseName(core)]++;
+
+  std::vector<std::string> names;
+  std::set<std::string> taken;
+  for (size_t i = 0; i < cores.size(); i++) {
+    std::string name = BaseName(cores[i]);
+    std::string suffix = "-" + std::to_string(i + 1);
+    if (counts[name] > 1) name += suffix;
+    // A core could already be named like another one's disambiguated name
+    while (!taken.insert(name).second) name += suffix;
+    names.push_back(name + ".json");
+  }
+  return names;
+}
+
+void WriteProcess(LLNodeApi* api, JSONWriter* writer) {
+  writer->Key("process");
+  writer->BeginObject();
+  writer->Key("pid");
+  writer->Int(api->GetProcessID());
+  writer->Key("state");
+  writer->String(api->GetProcessState());
+  writer->Key("threadCount");
+  writer->Int(api->GetThreadCount());
+  writer->EndObject();
+}
+
+void WriteThreads(LLNodeApi* api, JSONWriter* writer) {
+  writer->Key("threads");
+  writer->BeginArray();
+  uint32_t thread_count = api->GetThreadCount();
+  for (uint32_t i = 0; i < thread_count; i++) {
+    writer->BeginObject();
+    writer->Key("thread");
+    writer->Int(i);
+    writer->Key("frames");
+    writer->BeginArray();
+    uint32_t frame_count = api->GetFrameCount(i);
+    for (uint32_t j = 0; j < frame_count; j++)
+      writer->String(api->GetFrame(i, j));
+    writer->EndArray();
+    writer->EndObject();
+  }
+  writer->EndArray();
+}
+
+void WriteHeap(LLNodeApi* api, const BatchOptions& options,
+               JSONWriter* writer) {
+  uint32_t type_count = api->GetTypeCount();
+  int64_t instances = 0;
+  int64_t size = 0;
+  for (uint32_t i = 0; i < type_count; i++) {
+    instances += api->GetTypeInstanceCount(i);
+    size += api->GetTypeTotalSize(i);
+  }
+
+  writer->Key("heap");
+  writer->BeginObject();
+  writer->Key("typeCount");
+  writer->Int(type_count);
+  writer->Key("instances");
+  writer->Int(instances);
+  writer->Key("size");
+  writer->Int(size);
+  writer->Key("types");
+  writer->BeginArray();
+  // Types are sorted by instance count
+  for (uint32_t i = 0; i < type_count && i < options.top; i++) {
+    writer->BeginObject();
+    writer->Key("name");
+    writer->String(api->GetTypeName(i));
+    writer->Key("instances");
+    writer->Int(api->GetTypeInstanceCount(i));
+    writer->Key("size");
+    writer->Int(api->GetTypeTotalSize(i));
+    writer->EndObject();
+  }
+  writer->EndArray();
+  writer->EndObject();
+}
+
+void WriteObject(const ObjectInfo& info, JSONWriter* writer) {
+  writer->BeginObject();
+  writer->Key("address");
+  writer->Address(info.address);
+  writer->Key("size");
+  writer->Int(info.size);
+  if (!info.string.empty()) {
+    writer->Key("value");
+    writer->String(info.string);
+  }
+  if (!info.properties.empty()) {
+    writer->Key("properties");
+    writer->BeginObject();
+    for (const ObjectInfo::Property& property : info.properties) {
+      writer->Key(property.name);
+      writer->Address(property.value);
+    }
+    writer->EndObject();
+  }
+  if (info.kind == ObjectInfo::kArray) {
+    writer->Key("length");
+    writer->Int(info.element_count);
+  }
+  if (!info.error.empty()) {
+    writer->Key("error");
+    writer->String(info.error);
+  }
+  writer->EndObject();
+}
+
+void WriteInstances(LLNodeApi* api, const std::string& type_name,
+                    const BatchOptions& options, JSONWriter* writer) {
+  writer->BeginObject();
+  writer->Key("type");
+  writer->String(type_name);
+
+  std::vector<uint64_t>* instances = nullptr;
+  uint32_t type_count = api->GetTypeCount();
+  for (uint32_t i = 0; i < type_count && instances == nullptr; i++) {
+    if (api->GetTypeName(i) == type_name) instances = api->GetTypeInstances(i);
+  }
+
+  writer->Key("count");
+  writer->Int(instances != nullptr ? instances->size() : 0);
+  writer->Key("objects");
+  writer->BeginArray();
+  for (size_t i = 0; instances != nullptr && i < instances->size() &&
+                     i < options.limit;
+       i++) {
+    // Properties are left as addresses, reports stay flat
+    WriteObject(api->GetObjectInfo((*instances)[i], 0), writer);
+  }
+  writer->EndArray();
+  writer->EndObject();
+}
+
+std::string AnalyzeCore(const std::string& core, const BatchOptions& options,
+                        bool* ok) {
+  std::string report;
+  StringSink sink(&report);
+  JSONWriter writer(&sink);
+  writer.BeginObject();
+  writer.Key("core");
+  writer.String(core);
+  writer.Key("executable");
+  writer.String(options.executable);
+
+  auto start = std::chrono::steady_clock::now();
+  LLNodeApi api;
+  *ok = api.Init(core.c_str(), options.executable.c_str());
+  if (!*ok) {
+    writer.Key("error");
+    writer.String("Failed to load core dump");
+    writer.EndObject();
+    return report;
+  }
+
+  std::vector<std::string> instance_types;
+  bool heap_scanned = false;
+  for (const std::string& section : options.sections) {
+    if (section == "process") {
+      WriteProcess(&api, &writer);
+      continue;
+    }
+    if (section == "threads") {
+      WriteThreads(&api, &writer);
+      continue;
+    }
+
+    if (!heap_scanned) {
+      api.ScanHeap();
+      heap_scanned = true;
+    }
+    if (section == "heap")
+      WriteHeap(&api, options, &writer);
+    else
+      instance_types.push_back(section.substr(10));
+  }
+
+  if (!instance_types.empty()) {
+    writer.Key("instances");
+    writer.BeginArray();
+    for (const std::string& type_name : instance_types)
+      WriteInstances(&api, type_name, options, &writer);
+    writer.EndArray();
+  }
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  writer.Key("elapsedMs");
+  writer.Int(
+      std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+  writer.EndObject();
+  return report;
+}
+
+}  // namespace
+
+int BatchMain(int argc, char** argv) {
+  Error::SetDebugMode(getenv("LLNODE_DEBUG") != nullptr &&
+                      strlen(getenv("LLNODE_DEBUG")) != 0);
+
+  BatchOptions options;
+  if (!ParseBatchOptions(argc, argv, &options)) {
+    fprintf(stderr, "%s", kUsage);
+    return 2;
+  }
+
+  MemoryBudget budget(options.memory_budget);
+  std::vector<std::string> report_names = ReportNames(options.cores);
+  std::atomic<size_t> next_core(0);
+  std::atomic<size_t> failed(0);
+  std::mutex output_mutex;
+
+  auto worker = [&]() {
+    for (size_t i = next_core++; i < options.cores.size(); i = next_core++) {
+      const std::string& core = options.cores[i];
+      uint64_t cost = FileSize(core);
+
+      budget.Acquire(cost);
+      bool ok;
+      std::string report = AnalyzeCore(core, options, &ok);
+      budget.Release(cost);
+      if (!ok) failed++;
+
+      std::lock_guard<std::mutex> lock(output_mutex);
+      if (options.output_dir.empty()) {
+        fprintf(stdout, "%s\n", report.c_str());
+        fflush(stdout);
+      } else {
+        std::string path = options.output_dir + "/" + report_names[i];
+        std::ofstream file(path);
+        file << report << "\n";
+        file.close();
+        if (file.fail()) {
+          fprintf(stderr, "Failed to write %s\n", path.c_str());
+          failed++;
+        }
+      }
+      fprintf(stderr, "[%zu/%zu] %s: %s\n", i + 1, options.cores.size(),
+              core.c_str(), ok ? "done" : "failed");
+    }
+  };
+
+  size_t jobs = std::min(options.jobs, options.cores.size());
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < jobs; i++) workers.emplace_back(worker);
+  for (std::thread& t : workers) t.join();
+
+  return failed == 0 ? 0 : 1;
+}
+
+}  // namespace llnode
+
+int main(int argc, char** argv) { return llnode::BatchMain(argc, argv); }
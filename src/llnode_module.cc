@@ -1,6 +1,7 @@
 // Javascript module API for llnode/lldb
 #include <cinttypes>
 #include <cstdlib>
+#include <cstring>
 
 #include "src/llnode_api.h"
 #include "src/llnode_module.h"
@@ -16,6 +17,7 @@ using Napi::Number;
 using Napi::Object;
 using Napi::ObjectReference;
 using Napi::Persistent;
+using Napi::Promise;
 using Napi::Reference;
 using Napi::String;
 using Napi::Symbol;
@@ -39,6 +41,12 @@ Object LLNode::Init(Napi::Env env, Object exports) {
           InstanceMethod("getProcessObject", &LLNode::GetProcessObject),
           InstanceMethod("getHeapTypes", &LLNode::GetHeapTypes),
           InstanceMethod("getObjectAtAddress", &LLNode::GetObjectAtAddress),
+          InstanceMethod("getHeapTypesAsync", &LLNode::GetHeapTypesAsync),
+          InstanceMethod("getObjectAtAddressAsync",
+                         &LLNode::GetObjectAtAddressAsync),
+          InstanceMethod("getObjectsAtAddresses",
+                         &LLNode::GetObjectsAtAddresses),
+          InstanceMethod("decodeObject", &LLNode::DecodeObject),
       });
 
   constructor = Persistent(func);
@@ -54,6 +62,7 @@ Object LLNode::Init(Napi::Env env, Object exports) {
 LLNode::LLNode(const CallbackInfo& args)
     : ObjectWrap<LLNode>(args),
       heap_initialized_(false),
+      busy_(false),
       api_(new llnode::LLNodeApi){};
 
 LLNode::~LLNode() {}
@@ -89,8 +98,92 @@ Value LLNode::FromCoreDump(const CallbackInfo& args) {
     return env.Null();                                     \
   }
 
+// The api is not thread-safe, only one operation may use it at a time
+#define CHECK_IDLE(llnode, env)                                            \
+  if (llnode->busy_) {                                                     \
+    Napi::Error::New(env, "LLNode is busy with an asynchronous operation") \
+        .ThrowAsJavaScriptException();                                     \
+    return env.Null();                                                     \
+  }
+
+// Runs an operation on api_ off the JavaScript thread and settles a Promise
+// with its result. The LLNode object is kept alive and marked busy until
+// the operation completes.
+class LLNodeAsyncWorker : public Napi::AsyncWorker {
+ public:
+  LLNodeAsyncWorker(Napi::Env env, Object llnode_obj)
+      : Napi::AsyncWorker(env, "LLNodeAsyncWorker"),
+        llnode_(ObjectWrap<LLNode>::Unwrap(llnode_obj)),
+        deferred_(Promise::Deferred::New(env)),
+        llnode_obj_(Persistent(llnode_obj)) {
+    llnode_->busy_ = true;
+  }
+
+  Promise Start() {
+    Promise promise = deferred_.Promise();
+    Queue();
+    return promise;
+  }
+
+ protected:
+  LLNodeApi* api() { return llnode_->api_.get(); }
+
+  void OnOK() override {
+    HandleScope scope(Env());
+    llnode_->busy_ = false;
+    deferred_.Resolve(GetResult(llnode_obj_.Value()));
+  }
+
+  void OnError(const Napi::Error& e) override {
+    HandleScope scope(Env());
+    llnode_->busy_ = false;
+    deferred_.Reject(e.Value());
+  }
+
+  // Called on the JavaScript thread once Execute() succeeded
+  virtual Value GetResult(Object llnode_obj) = 0;
+
+  LLNode* llnode_;
+
+ private:
+  Promise::Deferred deferred_;
+  ObjectReference llnode_obj_;
+};
+
+class HeapTypesWorker : public LLNodeAsyncWorker {
+ public:
+  HeapTypesWorker(Napi::Env env, Object llnode_obj)
+      : LLNodeAsyncWorker(env, llnode_obj) {}
+
+ protected:
+  void Execute() override { api()->ScanHeap(); }
+
+  Value GetResult(Object llnode_obj) override {
+    llnode_->heap_initialized_ = true;
+    return llnode_->GetHeapTypeList(Env(), llnode_obj);
+  }
+};
+
+class ObjectAtAddressWorker : public LLNodeAsyncWorker {
+ public:
+  ObjectAtAddressWorker(Napi::Env env, Object llnode_obj, uint64_t addr)
+      : LLNodeAsyncWorker(env, llnode_obj), addr_(addr) {}
+
+ protected:
+  void Execute() override { value_ = api()->GetObject(addr_); }
+
+  Value GetResult(Object llnode_obj) override {
+    return llnode_->ObjectAtAddress(Env(), addr_, value_);
+  }
+
+ private:
+  uint64_t addr_;
+  std::string value_;
+};
+
 Value LLNode::GetProcessInfo(const CallbackInfo& args) {
   CHECK_INITIALIZED(this->api_, args.Env())
+  CHECK_IDLE(this, args.Env())
 
   return String::New(args.Env(), this->api_->GetProcessInfo());
 }
@@ -98,6 +191,7 @@ Value LLNode::GetProcessInfo(const CallbackInfo& args) {
 Value LLNode::GetProcessObject(const CallbackInfo& args) {
   Napi::Env env = args.Env();
   CHECK_INITIALIZED(this->api_, env)
+  CHECK_IDLE(this, env)
 
   uint32_t pid = this->api_->GetProcessID();
   std::string state = this->api_->GetProcessState();
@@ -136,6 +230,7 @@ Value LLNode::GetProcessObject(const CallbackInfo& args) {
 Value LLNode::GetHeapTypes(const CallbackInfo& args) {
   Napi::Env env = args.Env();
   CHECK_INITIALIZED(this->api_, env)
+  CHECK_IDLE(this, env)
   Object llnode_obj = args.This().As<Object>();
 
   // Initialize the heap and the type iterators
@@ -144,6 +239,27 @@ Value LLNode::GetHeapTypes(const CallbackInfo& args) {
     this->heap_initialized_ = true;
   }
 
+  return GetHeapTypeList(env, llnode_obj);
+}
+
+Value LLNode::GetHeapTypesAsync(const CallbackInfo& args) {
+  Napi::Env env = args.Env();
+  CHECK_INITIALIZED(this->api_, env)
+  CHECK_IDLE(this, env)
+  Object llnode_obj = args.This().As<Object>();
+
+  if (this->heap_initialized_) {
+    Promise::Deferred deferred = Promise::Deferred::New(env);
+    deferred.Resolve(GetHeapTypeList(env, llnode_obj));
+    return deferred.Promise();
+  }
+
+  // The worker deletes itself once the promise is settled
+  HeapTypesWorker* worker = new HeapTypesWorker(env, llnode_obj);
+  return worker->Start();
+}
+
+Array LLNode::GetHeapTypeList(Napi::Env env, Object llnode_obj) {
   uint32_t type_count = this->api_->GetTypeCount();
   Array type_list = Array::New(env);
   for (size_t i = 0; i < type_count; i++) {
@@ -156,42 +272,179 @@ Value LLNode::GetHeapTypes(const CallbackInfo& args) {
 }
 
 Object LLNode::GetObjectAtAddress(Napi::Env env, uint64_t addr) {
-  Object result = Object::New(env);
+  return ObjectAtAddress(env, addr, this->api_->GetObject(addr));
+}
 
+static String AddressString(Napi::Env env, uint64_t addr) {
   char buf[20];
   snprintf(buf, sizeof(buf), "0x%016" PRIx64, addr);
-  result.Set(String::New(env, "address"), String::New(env, buf));
+  return String::New(env, buf);
+}
+
+Object LLNode::ObjectAtAddress(Napi::Env env, uint64_t addr,
+                               const std::string& value) {
+  Object result = Object::New(env);
 
-  std::string value = this->api_->GetObject(addr);
+  result.Set(String::New(env, "address"), AddressString(env, addr));
   result.Set(String::New(env, "value"), String::New(env, value));
 
   return result;
 }
 
-// TODO: create JS object to introspect core dump
-// process/threads/frames
-Value LLNode::GetObjectAtAddress(const CallbackInfo& args) {
+static bool ParseAddress(const CallbackInfo& args, uint64_t* addr) {
   Napi::Env env = args.Env();
-  CHECK_INITIALIZED(this->api_, env)
-
   if (!args[0].IsString()) {
     TypeError::New(env, "First argument must be a string")
         .ThrowAsJavaScriptException();
-    return env.Null();
+    return false;
   }
 
   std::string address_str = args[0].As<String>();
   if (address_str[0] != '0' || address_str[1] != 'x' ||
       address_str.size() > 18) {
     TypeError::New(env, "Invalid address").ThrowAsJavaScriptException();
-    return env.Null();
+    return false;
   }
 
-  uint64_t addr = std::strtoull(address_str.c_str(), nullptr, 16);
+  *addr = std::strtoull(address_str.c_str(), nullptr, 16);
+  return true;
+}
+
+// TODO: create JS object to introspect core dump
+// process/threads/frames
+Value LLNode::GetObjectAtAddress(const CallbackInfo& args) {
+  Napi::Env env = args.Env();
+  CHECK_INITIALIZED(this->api_, env)
+  CHECK_IDLE(this, env)
+
+  uint64_t addr;
+  if (!ParseAddress(args, &addr)) return env.Null();
+
   Object result = this->GetObjectAtAddress(args.Env(), addr);
   return result;
 }
 
+static const char* ObjectKindName(ObjectInfo::Kind kind) {
+  switch (kind) {
+    case ObjectInfo::kSmi:
+      return "smi";
+    case ObjectInfo::kHeapNumber:
+      return "number";
+    case ObjectInfo::kString:
+      return "string";
+    case ObjectInfo::kOddball:
+      return "oddball";
+    case ObjectInfo::kObject:
+      return "object";
+    case ObjectInfo::kArray:
+      return "array";
+    case ObjectInfo::kFunction:
+      return "function";
+    case ObjectInfo::kOther:
+      return "other";
+    default:
+      return "invalid";
+  }
+}
+
+Value LLNode::DecodeObject(const CallbackInfo& args) {
+  Napi::Env env = args.Env();
+  CHECK_INITIALIZED(this->api_, env)
+  CHECK_IDLE(this, env)
+
+  uint64_t addr;
+  if (!ParseAddress(args, &addr)) return env.Null();
+
+  size_t max_elements = 1024;
+  if (args[1].IsNumber()) max_elements = args[1].As<Number>().Uint32Value();
+
+  ObjectInfo info = this->api_->GetObjectInfo(addr, max_elements);
+
+  Object result = Object::New(env);
+  result.Set("address", AddressString(env, info.address));
+  result.Set("kind", String::New(env, ObjectKindName(info.kind)));
+  result.Set("typeName", String::New(env, info.type_name));
+  if (info.map != 0) result.Set("map", AddressString(env, info.map));
+  result.Set("size", Number::New(env, info.size));
+
+  switch (info.kind) {
+    case ObjectInfo::kSmi:
+    case ObjectInfo::kHeapNumber:
+      result.Set("value", Number::New(env, info.number));
+      break;
+    case ObjectInfo::kString:
+    case ObjectInfo::kOddball:
+    case ObjectInfo::kFunction:
+      result.Set("value", String::New(env, info.string));
+      break;
+    default:
+      break;
+  }
+
+  if (info.kind == ObjectInfo::kObject || info.kind == ObjectInfo::kArray) {
+    Array properties = Array::New(env, info.properties.size());
+    for (size_t i = 0; i < info.properties.size(); i++) {
+      Array property = Array::New(env, 2);
+      property.Set(uint32_t(0), String::New(env, info.properties[i].name));
+      property.Set(1, AddressString(env, info.properties[i].value));
+      properties.Set(i, property);
+    }
+    result.Set("properties", properties);
+
+    Array elements = Array::New(env, info.elements.size());
+    for (size_t i = 0; i < info.elements.size(); i++)
+      elements.Set(i, AddressString(env, info.elements[i]));
+    result.Set("elements", elements);
+    result.Set("elementCount", Number::New(env, info.element_count));
+  }
+
+  if (!info.error.empty()) result.Set("error", String::New(env, info.error));
+  return result;
+}
+
+Value LLNode::GetObjectsAtAddresses(const CallbackInfo& args) {
+  Napi::Env env = args.Env();
+  CHECK_INITIALIZED(this->api_, env)
+  CHECK_IDLE(this, env)
+
+  bool is_addresses = false;
+  if (args[0].IsTypedArray()) {
+    is_addresses = args[0].As<Napi::TypedArray>().TypedArrayType() ==
+                   napi_biguint64_array;
+  }
+  if (!is_addresses) {
+    TypeError::New(env, "First argument must be a BigUint64Array")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::TypedArray addresses = args[0].As<Napi::TypedArray>();
+  Napi::ArrayBuffer buffer = addresses.ArrayBuffer();
+  const uint64_t* data = reinterpret_cast<const uint64_t*>(
+      static_cast<uint8_t*>(buffer.Data()) + addresses.ByteOffset());
+  size_t length = addresses.ElementLength();
+
+  Array result = Array::New(env, length);
+  for (size_t i = 0; i < length; i++) {
+    HandleScope scope(env);
+    result.Set(i, this->GetObjectAtAddress(env, data[i]));
+  }
+  return result;
+}
+
+Value LLNode::GetObjectAtAddressAsync(const CallbackInfo& args) {
+  Napi::Env env = args.Env();
+  CHECK_INITIALIZED(this->api_, env)
+  CHECK_IDLE(this, env)
+
+  uint64_t addr;
+  if (!ParseAddress(args, &addr)) return env.Null();
+
+  ObjectAtAddressWorker* worker =
+      new ObjectAtAddressWorker(env, args.This().As<Object>(), addr);
+  return worker->Start();
+}
+
 FunctionReference LLNodeHeapType::constructor;
 
 Object LLNodeHeapType::Init(Napi::Env env, Object exports) {
@@ -205,6 +458,9 @@ Object LLNodeHeapType::Init(Napi::Env env, Object exports) {
   exports.Set(String::New(env, "LLNodeHeapType"), func);
   exports.Set(String::New(env, "nextInstance"),
               Function::New(env, LLNodeHeapType::NextInstance, "nextInstance"));
+  exports.Set(String::New(env, "instanceAddresses"),
+              Function::New(env, LLNodeHeapType::InstanceAddresses,
+                            "instanceAddresses"));
   return exports;
 }
 
@@ -231,6 +487,7 @@ LLNodeHeapType::LLNodeHeapType(const CallbackInfo& args)
 
   this->llnode_ = Persistent(llnode_obj);
   this->instances_initialized_ = false;
+  this->type_instances_ = nullptr;
   this->current_instance_index_ = 0;
 
   this->type_name_ = llnode_ptr->api_->GetTypeName(index);
@@ -255,15 +512,12 @@ LLNode* LLNodeHeapType::llnode() {
 }
 
 void LLNodeHeapType::InitInstances() {
-  auto instances_set =
-      this->llnode()->api_->GetTypeInstances(this->type_index_);
+  static const std::vector<uint64_t> no_instances;
+  auto instances = this->llnode()->api_->GetTypeInstances(this->type_index_);
   this->current_instance_index_ = 0;
+  this->type_instances_ = instances != nullptr ? instances : &no_instances;
 
-  for (const uint64_t& addr : *instances_set) {
-    this->type_instances_.push_back(addr);
-  }
-
-  this->type_ins_count_ = this->type_instances_.size();
+  this->type_ins_count_ = this->type_instances_->size();
   this->instances_initialized_ = true;
 }
 
@@ -282,6 +536,11 @@ Value LLNodeHeapType::NextInstance(const CallbackInfo& args) {
 
   LLNodeHeapType* obj =
       ObjectWrap<LLNodeHeapType>::Unwrap(args[0].As<Object>());
+  if (obj->llnode()->busy_) {
+    Napi::Error::New(env, "LLNode is busy with an asynchronous operation")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
   if (!obj->instances_initialized_) {
     obj->InitInstances();
   }
@@ -290,9 +549,55 @@ Value LLNodeHeapType::NextInstance(const CallbackInfo& args) {
     return env.Undefined();
   }
 
-  uint64_t addr = obj->type_instances_[obj->current_instance_index_++];
+  uint64_t addr = (*obj->type_instances_)[obj->current_instance_index_++];
   Object result = obj->llnode()->GetObjectAtAddress(env, addr);
   return result;
 }
 
+Value LLNodeHeapType::InstanceAddresses(const CallbackInfo& args) {
+  Napi::Env env = args.Env();
+  if (!args[0].IsObject() ||
+      !HasInstance<LLNodeHeapType>(args[0].As<Object>())) {
+    TypeError::New(env, "First argument must be a LLNoteHeapType instance")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  LLNodeHeapType* obj =
+      ObjectWrap<LLNodeHeapType>::Unwrap(args[0].As<Object>());
+  if (obj->llnode()->busy_) {
+    Napi::Error::New(env, "LLNode is busy with an asynchronous operation")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!obj->instances_initialized_) {
+    obj->InitInstances();
+  }
+
+  // The addresses are copied in one go, so that writes from JavaScript can't
+  // reach the sorted instance list the scan keeps for this type.
+  size_t length = obj->type_instances_->size();
+  napi_value buffer;
+  void* data;
+  napi_status status =
+      napi_create_arraybuffer(env, length * sizeof(uint64_t), &data, &buffer);
+  if (status != napi_ok) {
+    Napi::Error::New(env, "Failed to create the instance address buffer")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (length > 0)
+    memcpy(data, obj->type_instances_->data(), length * sizeof(uint64_t));
+
+  napi_value addresses;
+  status = napi_create_typedarray(env, napi_biguint64_array, length, buffer, 0,
+                                  &addresses);
+  if (status != napi_ok) {
+    Napi::Error::New(env, "Failed to create the instance address array")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return Value(env, addresses);
+}
+
 }  // namespace llnode
@@ -8,9 +8,15 @@ namespace llnode {
 
 class LLNodeApi;
 class LLNodeHeapType;
+class LLNodeAsyncWorker;
+class HeapTypesWorker;
+class ObjectAtAddressWorker;
 
 class LLNode : public Napi::ObjectWrap<LLNode> {
   friend class LLNodeHeapType;
+  friend class LLNodeAsyncWorker;
+  friend class HeapTypesWorker;
+  friend class ObjectAtAddressWorker;
 
  public:
   static Napi::Object Init(Napi::Env env, Napi::Object exports);
@@ -27,11 +33,23 @@ class LLNode : public Napi::ObjectWrap<LLNode> {
   Napi::Value GetProcessObject(const Napi::CallbackInfo& args);
   Napi::Value GetHeapTypes(const Napi::CallbackInfo& args);
   Napi::Value GetObjectAtAddress(const Napi::CallbackInfo& args);
+  // Same as above, but scan and decode on the libuv thread pool
+  Napi::Value GetHeapTypesAsync(const Napi::CallbackInfo& args);
+  Napi::Value GetObjectAtAddressAsync(const Napi::CallbackInfo& args);
+  Napi::Value GetObjectsAtAddresses(const Napi::CallbackInfo& args);
+  // Structured counterpart of GetObjectAtAddress, wrapped with lazily
+  // decoded children by getObjectInfo() in index.js
+  Napi::Value DecodeObject(const Napi::CallbackInfo& args);
 
   bool heap_initialized_;
+  // Set while an asynchronous operation owns api_
+  bool busy_;
 
  protected:
+  Napi::Array GetHeapTypeList(Napi::Env env, Napi::Object llnode_obj);
   Napi::Object GetObjectAtAddress(Napi::Env env, uint64_t addr);
+  Napi::Object ObjectAtAddress(Napi::Env env, uint64_t addr,
+                               const std::string& value);
   std::unique_ptr<LLNodeApi> api_;
 };
 
@@ -44,6 +62,8 @@ class LLNodeHeapType : public Napi::ObjectWrap<LLNodeHeapType> {
   ~LLNodeHeapType();
 
   static Napi::Value NextInstance(const Napi::CallbackInfo& args);
+  // A BigUint64Array over the instance addresses owned by llnode
+  static Napi::Value InstanceAddresses(const Napi::CallbackInfo& args);
 
   static Napi::FunctionReference constructor;
 
@@ -57,7 +77,8 @@ class LLNodeHeapType : public Napi::ObjectWrap<LLNodeHeapType> {
   // For getting objects
   Napi::ObjectReference llnode_;
 
-  std::vector<uint64_t> type_instances_;
+  // Owned by the LLScan of llnode_, which is kept alive by this object
+  const std::vector<uint64_t>* type_instances_;
   bool instances_initialized_;
   size_t current_instance_index_;
 
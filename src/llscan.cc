@@ -1,15 +1,23 @@
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cinttypes>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <lldb/API/SBExpressionOptions.h>
@@ -34,6 +42,16 @@ using lldb::SBTarget;
 using lldb::SBValue;
 
 
+// Options without a short form
+enum {
+  kFromOption = 256,
+  kToOption,
+  kSortOption,
+  kOutputOption,
+  kIsolateOption,
+  kIsolatesOption
+};
+
 char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options) {
   static struct option opts[] = {
       {"full-string", no_argument, nullptr, 'F'},
@@ -45,6 +63,18 @@ char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options) {
       {"verbose", no_argument, nullptr, 'v'},
       {"detailed", no_argument, nullptr, 'd'},
       {"output-limit", required_argument, nullptr, 'n'},
+      {"byte-limit", required_argument, nullptr, 'b'},
+      {"json", no_argument, nullptr, 'j'},
+      {"depth", required_argument, nullptr, 'D'},
+      {"node-limit", required_argument, nullptr, 'N'},
+      {"page", required_argument, nullptr, 'p'},
+      {"offset", required_argument, nullptr, 'o'},
+      {"from", required_argument, nullptr, kFromOption},
+      {"to", required_argument, nullptr, kToOption},
+      {"sort", required_argument, nullptr, kSortOption},
+      {"output", required_argument, nullptr, kOutputOption},
+      {"isolate", required_argument, nullptr, kIsolateOption},
+      {"isolates", no_argument, nullptr, kIsolatesOption},
       {nullptr, 0, nullptr, 0}};
 
   int argc = 1;
@@ -62,7 +92,7 @@ char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options) {
   optind = 0;
   opterr = 1;
   do {
-    int arg = getopt_long(argc, args, "Fmsdvl:n:", opts, nullptr);
+    int arg = getopt_long(argc, args, "Fmsdvjl:n:b:D:N:p:o:", opts, nullptr);
     if (arg == -1) break;
 
     switch (arg) {
@@ -86,6 +116,51 @@ char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options) {
         int limit = strtol(optarg, nullptr, 10);
         options->output_limit = limit && limit > 0 ? limit : 0;
       } break;
+      case 'b': {
+        int64_t limit = strtoll(optarg, nullptr, 10);
+        options->byte_limit = limit > 0 ? limit : 0;
+      } break;
+      case 'j':
+        options->json = true;
+        break;
+      case 'D': {
+        int depth = strtol(optarg, nullptr, 10);
+        options->depth = depth > 1 ? depth : 1;
+      } break;
+      case 'N': {
+        int limit = strtol(optarg, nullptr, 10);
+        options->node_limit = limit > 0 ? limit : 0;
+      } break;
+      case 'p':
+        options->page = strtol(optarg, nullptr, 10);
+        break;
+      case 'o': {
+        int offset = strtol(optarg, nullptr, 10);
+        options->offset = offset >= 0 ? offset : -1;
+      } break;
+      case kFromOption:
+        options->start_address = strtoull(optarg, nullptr, 0);
+        break;
+      case kToOption:
+        options->end_address = strtoull(optarg, nullptr, 0);
+        break;
+      case kSortOption:
+        options->sort_by_size = strcmp(optarg, "size") == 0;
+        break;
+      case kOutputOption:
+        options->output_file = optarg;
+        break;
+      case kIsolateOption: {
+        char* end;
+        errno = 0;
+        long isolate = strtol(optarg, &end, 10);
+        bool valid = end != optarg && *end == '\0' && errno == 0 &&
+                     isolate >= 0 && isolate <= INT_MAX;
+        options->isolate = valid ? static_cast<int>(isolate) : -2;
+      } break;
+      case kIsolatesOption:
+        options->list_isolates = true;
+        break;
       default:
         continue;
     }
@@ -115,10 +190,55 @@ bool FindObjectsCmd::DoExecute(SBDebugger d, char** cmd,
   Printer::PrinterOptions printer_options;
   ParsePrinterOptions(cmd, &printer_options);
 
-  if (printer_options.detailed) {
-    DetailedOutput(result);
+  if (printer_options.isolate < -1) {
+    result.SetError("--isolate expects the number of an isolate\n");
+    return false;
+  }
+
+  if (printer_options.list_isolates) {
+    IsolatesOutput(result, printer_options.json);
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  TypeRecordMap* maps = &llscan_->GetMapsToInstances();
+  DetailedTypeRecordMap* detailed_maps = &llscan_->GetDetailedMapsToInstances();
+
+  // Copies of the records holding only the instances of one isolate
+  TypeRecordMap isolate_maps;
+  DetailedTypeRecordMap isolate_detailed_maps;
+  std::vector<std::unique_ptr<TypeRecord>> copies;
+  std::vector<std::unique_ptr<DetailedTypeRecord>> detailed_copies;
+  if (printer_options.isolate >= 0) {
+    uint32_t isolate = static_cast<uint32_t>(printer_options.isolate);
+    if (isolate >= llscan_->GetIsolates().size()) {
+      result.SetError(
+          "Unknown isolate, use `v8 findjsobjects --isolates` to list them\n");
+      return false;
+    }
+
+    for (auto kv : *maps) {
+      TypeRecord* t = new TypeRecord(*kv.second);
+      copies.emplace_back(t);
+      t->KeepIsolate(isolate);
+      if (t->GetInstanceCount() > 0) isolate_maps[kv.first] = t;
+    }
+    for (auto kv : *detailed_maps) {
+      DetailedTypeRecord* t = new DetailedTypeRecord(*kv.second);
+      detailed_copies.emplace_back(t);
+      t->KeepIsolate(isolate);
+      if (t->GetInstanceCount() > 0) isolate_detailed_maps[kv.first] = t;
+    }
+    maps = &isolate_maps;
+    detailed_maps = &isolate_detailed_maps;
+  }
+
+  if (printer_options.json) {
+    JSONOutput(result, *maps, *detailed_maps, printer_options.detailed);
+  } else if (printer_options.detailed) {
+    DetailedOutput(result, *detailed_maps);
   } else {
-    SimpleOutput(result);
+    SimpleOutput(result, *maps);
   }
 
   result.SetStatus(eReturnStatusSuccessFinishResult);
@@ -126,14 +246,74 @@ bool FindObjectsCmd::DoExecute(SBDebugger d, char** cmd,
 }
 
 
-void FindObjectsCmd::SimpleOutput(SBCommandReturnObject& result) {
+void FindObjectsCmd::IsolatesOutput(SBCommandReturnObject& result,
+                                    bool json) {
+  std::vector<IsolateRecord>& isolates = llscan_->GetIsolates();
+
+  // Isolates in the order they were found, then the objects without one
+  std::vector<size_t> order;
+  for (size_t i = 1; i < isolates.size(); i++) order.push_back(i);
+  if (!isolates.empty() && isolates[0].instance_count != 0) order.push_back(0);
+
+  if (json) {
+    ResultSink sink(result);
+    JSONWriter writer(&sink);
+    writer.BeginObject();
+    writer.Key("isolates");
+    writer.BeginArray();
+    for (size_t i : order) {
+      writer.BeginObject();
+      writer.Key("isolate");
+      writer.Int(i);
+      writer.Key("environment");
+      if (isolates[i].environment != 0)
+        writer.Address(isolates[i].environment);
+      else
+        writer.Null();
+      writer.Key("nativeContext");
+      if (isolates[i].native_context != 0)
+        writer.Address(isolates[i].native_context);
+      else
+        writer.Null();
+      writer.Key("instances");
+      writer.Int(isolates[i].instance_count);
+      writer.Key("size");
+      writer.Int(isolates[i].total_instance_size);
+      writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    sink.Write("\n");
+    return;
+  }
+
+  result.Printf(
+      " Isolate        Environment     Native Context  Instances  Total Size\n");
+  result.Printf(
+      " ------- ------------------ ------------------ ---------- ----------\n");
+  for (size_t i : order) {
+    if (i == 0) {
+      result.Printf(" %7d %37s %10" PRIu64 " %10" PRIu64 "\n", 0,
+                    "(no native context)", isolates[0].instance_count,
+                    isolates[0].total_instance_size);
+      continue;
+    }
+    result.Printf(" %7zu 0x%016" PRIx64 " 0x%016" PRIx64 " %10" PRIu64
+                  " %10" PRIu64 "\n",
+                  i, isolates[i].environment, isolates[i].native_context,
+                  isolates[i].instance_count, isolates[i].total_instance_size);
+  }
+}
+
+
+void FindObjectsCmd::SimpleOutput(SBCommandReturnObject& result,
+                                  TypeRecordMap& maps) {
   /* Create a vector to hold the entries sorted by instance count
    * TODO(hhellyer) - Make sort type an option (by count, size or name)
    */
   std::vector<TypeRecord*> sorted_by_count;
-  TypeRecordMap::iterator end = llscan_->GetMapsToInstances().end();
-  for (TypeRecordMap::iterator it = llscan_->GetMapsToInstances().begin();
-       it != end; ++it) {
+  TypeRecordMap::iterator end = maps.end();
+  for (TypeRecordMap::iterator it = maps.begin(); it != end; ++it) {
     sorted_by_count.push_back(it->second);
   }
 
@@ -160,9 +340,10 @@ void FindObjectsCmd::SimpleOutput(SBCommandReturnObject& result) {
 }
 
 
-void FindObjectsCmd::DetailedOutput(SBCommandReturnObject& result) {
+void FindObjectsCmd::DetailedOutput(SBCommandReturnObject& result,
+                                    DetailedTypeRecordMap& maps) {
   std::vector<DetailedTypeRecord*> sorted_by_count;
-  for (auto kv : llscan_->GetDetailedMapsToInstances()) {
+  for (auto kv : maps) {
     sorted_by_count.push_back(kv.second);
   }
 
@@ -193,6 +374,62 @@ void FindObjectsCmd::DetailedOutput(SBCommandReturnObject& result) {
 }
 
 
+void FindObjectsCmd::JSONOutput(SBCommandReturnObject& result,
+                                TypeRecordMap& maps,
+                                DetailedTypeRecordMap& detailed_maps,
+                                bool detailed) {
+  std::vector<TypeRecord*> sorted_by_count;
+  if (detailed) {
+    for (auto kv : detailed_maps) {
+      sorted_by_count.push_back(kv.second);
+    }
+  } else {
+    for (auto kv : maps) {
+      sorted_by_count.push_back(kv.second);
+    }
+  }
+
+  std::sort(sorted_by_count.begin(), sorted_by_count.end(),
+            TypeRecord::CompareInstanceCounts);
+  uint64_t total_objects = 0;
+  uint64_t total_size = 0;
+
+  ResultSink sink(result);
+  JSONWriter json(&sink);
+  json.BeginObject();
+  json.Key("types");
+  json.BeginArray();
+  for (auto t : sorted_by_count) {
+    json.BeginObject();
+    json.Key("name");
+    json.String(t->GetTypeName());
+    json.Key("instances");
+    json.Int(t->GetInstanceCount());
+    json.Key("size");
+    json.Int(t->GetTotalInstanceSize());
+    if (detailed) {
+      DetailedTypeRecord* d = static_cast<DetailedTypeRecord*>(t);
+      json.Key("sample");
+      json.Address(*(d->GetInstances().begin()));
+      json.Key("properties");
+      json.Int(d->GetOwnDescriptorsCount());
+      json.Key("elements");
+      json.Int(d->GetIndexedPropertiesCount());
+    }
+    json.EndObject();
+    total_objects += t->GetInstanceCount();
+    total_size += t->GetTotalInstanceSize();
+  }
+  json.EndArray();
+  json.Key("instances");
+  json.Int(total_objects);
+  json.Key("size");
+  json.Int(total_size);
+  json.EndObject();
+  sink.Write("\n");
+}
+
+
 bool FindInstancesCmd::DoExecute(SBDebugger d, char** cmd,
                                  SBCommandReturnObject& result) {
   if (cmd == nullptr || *cmd == nullptr) {
@@ -232,52 +469,147 @@ bool FindInstancesCmd::DoExecute(SBDebugger d, char** cmd,
 
   if (instance_it != llscan_->GetMapsToInstances().end()) {
     TypeRecord* t = instance_it->second;
+    std::vector<uint64_t>& instances = t->GetInstances();
+
+    // Instances are sorted by address, so an address range is a slice
+    size_t first;
+    size_t last;
+    t->GetAddressRange(printer_options.start_address,
+                       printer_options.end_address, &first, &last);
+    bool filtered = first != 0 || last != instances.size();
+
+    // Sorting a filtered slice by size needs its own order
+    std::vector<size_t> filtered_order;
+    std::vector<size_t>* order = nullptr;
+    if (printer_options.sort_by_size && filtered) {
+      std::vector<size_t>& size_order = t->GetSizeOrder();
+      filtered_order.reserve(last - first);
+      for (size_t i : size_order)
+        if (i >= first && i < last) filtered_order.push_back(i);
+      order = &filtered_order;
+    } else if (printer_options.sort_by_size) {
+      order = &t->GetSizeOrder();
+    }
 
-    // Update pagination options
-    if (full_cmd != pagination_.command ||
-        printer_options.output_limit != pagination_.output_limit) {
-      pagination_.total_entries = t->GetInstanceCount();
-      pagination_.command = full_cmd;
-      pagination_.current_page = 0;
-      pagination_.output_limit = printer_options.output_limit;
-    } else {
-      if (pagination_.output_limit <= 0 ||
-          (pagination_.current_page + 1) * pagination_.output_limit >
-              pagination_.total_entries) {
-        pagination_.current_page = 0;
-      } else {
-        pagination_.current_page++;
-      }
+    int total = static_cast<int>(last - first);
+    int limit = printer_options.output_limit;
+
+    // Repeating the same command shows the next page
+    std::string pagination_key = full_cmd;
+    pagination_key += printer_options.sort_by_size ? " by size" : "";
+    pagination_key += " " + std::to_string(printer_options.start_address) +
+                      "-" + std::to_string(printer_options.end_address);
+
+    int initial_p_offset = 0;
+    if (printer_options.offset >= 0) {
+      initial_p_offset = printer_options.offset;
+    } else if (printer_options.page > 0 && limit > 0) {
+      initial_p_offset = (printer_options.page - 1) * limit;
+    } else if (pagination_key == pagination_.command &&
+               limit == pagination_.output_limit && limit > 0 &&
+               pagination_.next_offset < total) {
+      initial_p_offset = pagination_.next_offset;
     }
+    initial_p_offset = std::min(initial_p_offset, total);
 
-    int initial_p_offset =
-        (pagination_.current_page * printer_options.output_limit);
     int final_p_offset =
-        initial_p_offset +
-        std::min(pagination_.output_limit,
-                 pagination_.total_entries -
-                     pagination_.current_page * pagination_.output_limit);
-    if (final_p_offset <= 0) {
-      final_p_offset = pagination_.total_entries;
-    }
-
-    auto it = pagination_.current_page == 0
-                  ? t->GetInstances().begin()
-                  : std::next(t->GetInstances().begin(), initial_p_offset);
-    for (; it != t->GetInstances().end() &&
-           it != (std::next(t->GetInstances().begin(), final_p_offset));
-         ++it) {
-      Error err;
-      v8::Value v8_value(llscan_->v8(), *it);
+        limit > 0 ? std::min(initial_p_offset + limit, total) : total;
+
+    pagination_.total_entries = total;
+    pagination_.command = pagination_key;
+    pagination_.output_limit = limit;
+    pagination_.next_offset = final_p_offset;
+
+    // Position in the selected order to address, without walking the set
+    auto instance_at = [&](int i) -> uint64_t {
+      return order != nullptr ? instances[(*order)[i]] : instances[first + i];
+    };
+
+    if (!printer_options.output_file.empty()) {
+      std::vector<uint64_t> selected;
+      selected.reserve(final_p_offset - initial_p_offset);
+      for (int i = initial_p_offset; i < final_p_offset; i++)
+        selected.push_back(instance_at(i));
+
+      Error err = WriteToFile(target, printer_options, selected);
+      if (err.Fail()) {
+        result.SetError(err.GetMessage());
+        return false;
+      }
+      result.Printf("Wrote %zu instances of %s to %s\n", selected.size(),
+                    type_name.c_str(), printer_options.output_file.c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    int i = initial_p_offset;
+    if (printer_options.json) {
+      // Values are rendered whole so the document stays valid, the byte
+      // limit only stops adding instances.
+      ResultSink sink(result);
+      JSONWriter json(&sink);
       Printer printer(llscan_->v8(), printer_options);
-      std::string res = printer.Stringify(v8_value, err);
-      result.Printf("%s\n", res.c_str());
+      json.BeginObject();
+      json.Key("type");
+      json.String(type_name);
+      json.Key("total");
+      json.Int(total);
+      json.Key("offset");
+      json.Int(initial_p_offset);
+      json.Key("instances");
+      json.BeginArray();
+      for (; i < final_p_offset; i++) {
+        if (printer_options.byte_limit != 0 &&
+            sink.written() >= printer_options.byte_limit)
+          break;
+        Error err;
+        uint64_t address = instance_at(i);
+        v8::Value v8_value(llscan_->v8(), address);
+        std::string res = printer.Stringify(v8_value, err);
+        json.BeginObject();
+        json.Key("address");
+        json.Address(address);
+        json.Key("value");
+        if (err.Success())
+          json.String(res);
+        else
+          json.Null();
+        json.EndObject();
+      }
+      json.EndArray();
+      // The byte limit may have stopped the page early
+      pagination_.next_offset = i;
+      json.Key("truncated");
+      json.Bool(i < total);
+      json.EndObject();
+      sink.Write("\n");
+
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    ResultSink sink(result);
+    sink.set_limit(printer_options.byte_limit);
+    Printer printer(llscan_->v8(), printer_options);
+    for (; i < final_p_offset && !sink.full(); i++) {
+      Error err;
+      v8::Value v8_value(llscan_->v8(), instance_at(i));
+      printer.Print(v8_value, &sink, err);
+      sink.Write("\n");
+    }
+    sink.Flush();
+    if (sink.full()) {
+      result.Printf("\n(output truncated after %zu bytes)\n", sink.written());
+      // The instance being printed was cut, the next page starts with it
+      // unless it's the only one shown, so paging always moves forward
+      if (i - 1 > initial_p_offset) i--;
     }
-    if (it != t->GetInstances().end()) {
+    pagination_.next_offset = i;
+    if (i < total) {
       result.Printf("..........\n");
     }
-    result.Printf("(Showing %d to %d of %d instances)\n", initial_p_offset + 1,
-                  final_p_offset, pagination_.total_entries);
+    result.Printf("(Showing %d to %d of %d instances)\n",
+                  std::min(initial_p_offset + 1, total), i, total);
 
   } else {
     // "No objects found with type name %s", type_name
@@ -296,6 +628,650 @@ bool FindInstancesCmd::DoExecute(SBDebugger d, char** cmd,
 }
 
 
+Error FindInstancesCmd::WriteToFile(SBTarget target,
+                                    const Printer::PrinterOptions& options,
+                                    const std::vector<uint64_t>& addresses) {
+  std::ofstream file(options.output_file,
+                     std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!file.is_open())
+    return Error::Failure("Can't open %s for writing: %s",
+                          options.output_file.c_str(), strerror(errno));
+
+  // Workers only read from here on, so resolve every constant up front
+  v8::LLV8* llv8 = llscan_->v8();
+  llv8->LoadAllConstants();
+
+  // Rendered blocks are written in address order, workers may run ahead of
+  // the writer by a bounded number of blocks.
+  const size_t kBlockSize = 256;
+  size_t block_count = (addresses.size() + kBlockSize - 1) / kBlockSize;
+  size_t worker_count = std::thread::hardware_concurrency();
+  worker_count = std::max<size_t>(1, std::min<size_t>(worker_count, 16));
+  worker_count = std::min(worker_count, std::max<size_t>(1, block_count));
+  size_t window = worker_count * 4;
+
+  std::vector<std::string> blocks(block_count);
+  std::vector<bool> done(block_count, false);
+  std::atomic<size_t> next_block(0);
+  size_t written = 0;
+  std::mutex mutex;
+  std::condition_variable block_done;
+  std::condition_variable block_written;
+
+  // The file has no colors, rang's mode is global so the workers can't set
+  // it themselves.
+  rang::setControlMode(rang::control::Off);
+
+  auto worker = [&]() {
+    v8::ReadCache cache(llv8);
+    v8::ReadCache::Scope scope(&cache);
+    Printer printer(llv8, options);
+
+    while (true) {
+      size_t block = next_block++;
+      if (block >= block_count) break;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        block_written.wait(lock, [&] { return block < written + window; });
+      }
+
+      std::string out;
+      size_t end = std::min(addresses.size(), (block + 1) * kBlockSize);
+      for (size_t i = block * kBlockSize; i < end; i++) {
+        Error err;
+        v8::Value v8_value(llv8, addresses[i]);
+        out += printer.Stringify(v8_value, err);
+        out += "\n";
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      blocks[block] = std::move(out);
+      done[block] = true;
+      block_done.notify_one();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < worker_count; i++) workers.emplace_back(worker);
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (written < block_count) {
+      block_done.wait(lock, [&] { return done[written]; });
+      std::string out = std::move(blocks[written]);
+      written++;
+      block_written.notify_all();
+
+      lock.unlock();
+      file.write(out.data(), out.size());
+      lock.lock();
+    }
+  }
+
+  for (std::thread& t : workers) t.join();
+
+  Settings::GetSettings()->RestoreColor();
+
+  file.close();
+  if (file.fail())
+    return Error::Failure("Failed to write %s", options.output_file.c_str());
+  return Error::Ok();
+}
+
+
+bool DumpPerfMapCmd::DoExecute(SBDebugger d, char** cmd,
+                               SBCommandReturnObject& result) {
+  SBTarget target = d.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.SetError("No valid process, please start something\n");
+    return false;
+  }
+
+  // Same name perf looks for, unless told otherwise
+  std::string path;
+  if (cmd != nullptr && *cmd != nullptr) {
+    path = *cmd;
+  } else {
+    uint64_t pid = target.GetProcess().GetProcessID();
+    if (pid == 0) {
+      result.SetError("Unknown pid, USAGE: v8 dump perfmap [file]\n");
+      return false;
+    }
+    path = "/tmp/perf-" + std::to_string(pid) + ".map";
+  }
+
+  // Load V8 constants from postmortem data
+  llscan_->v8()->Load(target);
+
+  /* The heap scan fills the code map. */
+  if (!llscan_->ScanHeapForObjects(target, result)) {
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    Error err = Error::Failure("Failed to open %s: %s", path.c_str(),
+                               strerror(errno));
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  v8::CodeMap* code_map = llscan_->v8()->code_map();
+  size_t entries = 0;
+  for (const v8::CodeMap::Entry& entry : code_map->GetCode()) {
+    // Builtins are named by the binary's own symbols, and bytecode runs in
+    // the interpreter's builtins.
+    if (entry.function == 0 || code_map->IsBuiltin(entry.start)) continue;
+
+    Error err;
+    v8::JSFunction fn(llscan_->v8(), entry.function);
+    v8::SharedFunctionInfo info = fn.Info(err);
+    if (err.Fail()) continue;
+    std::string name = info.ProperName(err);
+    if (err.Fail()) continue;
+
+    std::string script_name;
+    int64_t line = 0;
+    int64_t column = 0;
+    if (info.GetLocation(script_name, line, column, err)) {
+      name += " " + script_name + ":" + std::to_string(line + 1) + ":" +
+              std::to_string(column);
+    }
+
+    // perf's format: hex start, hex size, then the symbol name
+    fprintf(file, "%" PRIx64 " %" PRIx64 " JS:%s\n", entry.start, entry.size,
+            name.c_str());
+    entries++;
+  }
+
+  if (fclose(file) != 0) {
+    Error err =
+        Error::Failure("Failed to write %s: %s", path.c_str(), strerror(errno));
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  result.Printf("Wrote %zu entries to %s\n", entries, path.c_str());
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+
+namespace {
+
+// Node and edge types, in the order they're listed in the snapshot's meta
+enum SnapshotNodeType {
+  kSnapshotNodeHidden,
+  kSnapshotNodeArray,
+  kSnapshotNodeString,
+  kSnapshotNodeObject,
+  kSnapshotNodeCode,
+  kSnapshotNodeClosure,
+  kSnapshotNodeRegExp,
+  kSnapshotNodeNumber,
+  kSnapshotNodeNative,
+  kSnapshotNodeSynthetic,
+  kSnapshotNodeConsString,
+  kSnapshotNodeSlicedString,
+  kSnapshotNodeSymbol,
+  kSnapshotNodeBigInt,
+  kSnapshotNodeObjectShape
+};
+
+enum SnapshotEdgeType {
+  kSnapshotEdgeContext,
+  kSnapshotEdgeElement,
+  kSnapshotEdgeProperty,
+  kSnapshotEdgeInternal,
+  kSnapshotEdgeHidden,
+  kSnapshotEdgeShortcut,
+  kSnapshotEdgeWeak
+};
+
+// type, name, id, self_size, edge_count, trace_node_id
+const uint64_t kSnapshotNodeFields = 6;
+
+// Removed when the command returns, whether the snapshot was written or not
+class SnapshotTempFile {
+ public:
+  explicit SnapshotTempFile(const std::string& path)
+      : path_(path), file_(fopen(path.c_str(), "w+")) {}
+  ~SnapshotTempFile() {
+    if (file_ != nullptr) fclose(file_);
+    remove(path_.c_str());
+  }
+
+  inline FILE* file() { return file_; }
+  inline const std::string& path() { return path_; }
+
+  // Append the whole file to `out`
+  bool CopyTo(FILE* out) {
+    if (fflush(file_) != 0 || fseek(file_, 0, SEEK_SET) != 0) return false;
+    char buffer[64 * 1024];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file_)) > 0) {
+      if (fwrite(buffer, 1, length, out) != length) return false;
+    }
+    return ferror(file_) == 0;
+  }
+
+ private:
+  std::string path_;
+  FILE* file_;
+};
+
+// The snapshot's string table, written out as strings are first used.
+// Short strings, like property and constructor names, are deduplicated.
+// Longer ones are cut to kMaxLength and written every time they're used,
+// so the table's memory stays bounded by the number of distinct names.
+class SnapshotStrings {
+ public:
+  static const size_t kMaxDedupLength = 64;
+  static const size_t kMaxLength = 1024;
+
+  explicit SnapshotStrings(FILE* file)
+      : sink_(file), writer_(&sink_), count_(0) {
+    writer_.BeginArray();
+  }
+
+  uint64_t Get(const std::string& str) {
+    if (str.size() > kMaxDedupLength) return Add(str);
+
+    auto it = ids_.find(str);
+    if (it != ids_.end()) return it->second;
+    uint64_t id = Add(str);
+    ids_.emplace(str, id);
+    return id;
+  }
+
+  void Close() { writer_.EndArray(); }
+
+ private:
+  uint64_t Add(const std::string& str) {
+    if (str.size() <= kMaxLength) {
+      writer_.String(str);
+    } else {
+      // Don't cut a multi-byte UTF-8 sequence in half
+      size_t length = kMaxLength;
+      while (length > 0 && (str[length] & 0xc0) == 0x80) length--;
+      writer_.String(str.substr(0, length) + "...");
+    }
+    return count_++;
+  }
+
+  FileSink sink_;
+  JSONWriter writer_;
+  std::unordered_map<std::string, uint64_t> ids_;
+  uint64_t count_;
+};
+
+// Calls `fn` with the record and index of every scanned object, in address
+// order. Each type's instances are sorted already, so this is a merge.
+template <typename Fn>
+void ForEachSnapshotNode(TypeRecordMap& types, Fn fn) {
+  struct Cursor {
+    uint64_t address;
+    TypeRecord* type;
+    size_t index;
+
+    bool operator>(const Cursor& other) const {
+      return address > other.address;
+    }
+  };
+
+  std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> next;
+  for (auto& entry : types) {
+    if (entry.second->GetInstances().empty()) continue;
+    next.push({entry.second->GetInstances()[0], entry.second, 0});
+  }
+
+  uint64_t last = 0;
+  while (!next.empty()) {
+    Cursor cursor = next.top();
+    next.pop();
+
+    // An address is only recorded once per type, but be safe across types
+    if (cursor.address != last) fn(cursor.type, cursor.index);
+    last = cursor.address;
+
+    std::vector<uint64_t>& instances = cursor.type->GetInstances();
+    if (++cursor.index < instances.size()) {
+      cursor.address = instances[cursor.index];
+      next.push(cursor);
+    }
+  }
+}
+
+void WriteStringArray(JSONWriter* writer,
+                      std::initializer_list<const char*> values) {
+  writer->BeginArray();
+  for (const char* value : values) writer->String(value);
+  writer->EndArray();
+}
+
+
+// Everything before the nodes, with the counts DevTools preallocates from
+void WriteSnapshotHeader(JSONWriter* writer, uint64_t node_count,
+                         uint64_t edge_count) {
+  writer->BeginObject();
+  writer->Key("meta");
+  writer->BeginObject();
+  writer->Key("node_fields");
+  WriteStringArray(writer, {"type", "name", "id", "self_size", "edge_count",
+                            "trace_node_id"});
+  writer->Key("node_types");
+  writer->BeginArray();
+  WriteStringArray(writer, {"hidden", "array", "string", "object", "code",
+                            "closure", "regexp", "number", "native",
+                            "synthetic", "concatenated string",
+                            "sliced string", "symbol", "bigint",
+                            "object shape"});
+  writer->String("string");
+  writer->String("number");
+  writer->String("number");
+  writer->String("number");
+  writer->String("number");
+  writer->EndArray();
+  writer->Key("edge_fields");
+  WriteStringArray(writer, {"type", "name_or_index", "to_node"});
+  writer->Key("edge_types");
+  writer->BeginArray();
+  WriteStringArray(writer, {"context", "element", "property", "internal",
+                            "hidden", "shortcut", "weak"});
+  writer->String("string_or_number");
+  writer->String("node");
+  writer->EndArray();
+  writer->Key("trace_function_info_fields");
+  WriteStringArray(writer, {"function_id", "name", "script_name", "script_id",
+                            "line", "column"});
+  writer->Key("trace_node_fields");
+  WriteStringArray(writer,
+                   {"id", "function_info_index", "count", "size", "children"});
+  writer->Key("sample_fields");
+  WriteStringArray(writer, {"timestamp_us", "last_assigned_id"});
+  writer->Key("location_fields");
+  WriteStringArray(writer, {"object_index", "script_id", "line", "column"});
+  writer->EndObject();
+  writer->Key("node_count");
+  writer->Int(node_count);
+  writer->Key("edge_count");
+  writer->Int(edge_count);
+  writer->Key("trace_function_count");
+  writer->Int(0);
+  writer->EndObject();
+}
+
+}  // namespace
+
+
+// Decodes the objects into nodes and their references into edges. Only
+// references between scanned objects become edges, targets the scan doesn't
+// record (Smis, maps, contexts, ...) are dropped.
+class HeapSnapshotCmd::SnapshotBuilder {
+ public:
+  SnapshotBuilder(v8::LLV8* v8, const std::vector<uint64_t>& addresses,
+                  FILE* nodes, FILE* edges, SnapshotStrings* strings)
+      : v8_(v8),
+        addresses_(addresses),
+        retained_(addresses.size() + 1, false),
+        nodes_(nodes),
+        edges_(edges),
+        strings_(strings),
+        edge_count_(0),
+        node_edges_(0) {}
+
+  void AddNode(TypeRecord* type, size_t index, uint64_t ordinal);
+
+  inline uint64_t edge_count() { return edge_count_; }
+  // Whether another node has an edge to the node
+  inline bool IsRetained(uint64_t ordinal) { return retained_[ordinal]; }
+
+ private:
+  void AddEdge(SnapshotEdgeType type, uint64_t name_or_index,
+               uint64_t address);
+  SnapshotNodeType AddStringEdges(v8::String str, Error& err);
+  void AddObjectEdges(v8::JSObject js_object, bool is_array, Error& err);
+
+  v8::LLV8* v8_;
+  const std::vector<uint64_t>& addresses_;
+  // One bit per node, objects nothing refers to hang off the root
+  std::vector<bool> retained_;
+  FILE* nodes_;
+  FILE* edges_;
+  SnapshotStrings* strings_;
+  uint64_t edge_count_;
+  // Edges of the node being decoded
+  uint64_t node_edges_;
+};
+
+
+void HeapSnapshotCmd::SnapshotBuilder::AddNode(TypeRecord* type, size_t index,
+                                               uint64_t ordinal) {
+  uint64_t address = type->GetInstances()[index];
+  uint64_t size = type->GetInstanceSizes()[index];
+  SnapshotNodeType node_type = kSnapshotNodeObject;
+  std::string name = type->GetTypeName();
+  node_edges_ = 0;
+
+  Error err;
+  v8::HeapObject heap_object(v8_, address);
+  v8::HeapObject map_obj = heap_object.GetMap(err);
+  v8::Map map(map_obj);
+  int64_t instance_type = err.Success() ? map.GetType(err) : -1;
+
+  if (err.Fail()) {
+    node_type = kSnapshotNodeHidden;
+  } else if (instance_type < v8_->types()->kFirstNonstringType) {
+    v8::String str(heap_object);
+    node_type = AddStringEdges(str, err);
+    Error str_err;
+    std::string value = str.ToString(str_err);
+    if (str_err.Success()) name = value;
+  } else if (instance_type == v8_->types()->kJSArrayType) {
+    AddObjectEdges(v8::JSObject(heap_object), true, err);
+  } else {
+    AddObjectEdges(v8::JSObject(heap_object), false, err);
+  }
+
+  fprintf(nodes_, ",\n%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",0",
+          node_type, strings_->Get(name), ordinal * 2 + 1, size, node_edges_);
+}
+
+
+SnapshotNodeType HeapSnapshotCmd::SnapshotBuilder::AddStringEdges(
+    v8::String str, Error& err) {
+  v8::CheckedType<int64_t> repr = str.Representation(err);
+  if (!repr.Check()) return kSnapshotNodeString;
+
+  if (*repr == v8_->string()->kConsStringTag) {
+    v8::ConsString cons_str(str);
+    v8::String first = cons_str.First(err);
+    if (err.Success()) {
+      AddEdge(kSnapshotEdgeInternal, strings_->Get("first"), first.raw());
+    }
+    v8::String second = cons_str.Second(err);
+    if (err.Success()) {
+      AddEdge(kSnapshotEdgeInternal, strings_->Get("second"), second.raw());
+    }
+    return kSnapshotNodeConsString;
+  }
+
+  if (*repr == v8_->string()->kSlicedStringTag) {
+    v8::SlicedString sliced_str(str);
+    v8::String parent = sliced_str.Parent(err);
+    if (err.Success()) {
+      AddEdge(kSnapshotEdgeInternal, strings_->Get("parent"), parent.raw());
+    }
+    return kSnapshotNodeSlicedString;
+  }
+
+  return kSnapshotNodeString;
+}
+
+
+void HeapSnapshotCmd::SnapshotBuilder::AddObjectEdges(v8::JSObject js_object,
+                                                      bool is_array,
+                                                      Error& err) {
+  v8::JSObject::OwnProperties properties(&js_object, err);
+  if (err.Success()) {
+    for (v8::JSObject::OwnProperties::Iterator it = properties.begin();
+         it != properties.end(); it++) {
+      std::pair<v8::Value, v8::Value> entry = *it;
+      Error name_err;
+      std::string name = entry.first.ToString(name_err);
+      if (name_err.Fail()) continue;
+      AddEdge(kSnapshotEdgeProperty, strings_->Get(name), entry.second.raw());
+    }
+  }
+
+  // Other objects' elements may be dictionaries, only arrays' are decoded
+  if (!is_array) return;
+
+  Error elements_err;
+  int64_t length = js_object.GetArrayLength(elements_err);
+  v8::HeapObject elements_obj = js_object.Elements(elements_err);
+  v8::FixedArray elements(elements_obj);
+  for (int64_t i = 0; i < length && elements_err.Success(); i++) {
+    v8::Value element = elements.Get<v8::Value>(i, elements_err);
+    if (elements_err.Success()) {
+      AddEdge(kSnapshotEdgeElement, i, element.raw());
+    }
+  }
+}
+
+
+void HeapSnapshotCmd::SnapshotBuilder::AddEdge(SnapshotEdgeType type,
+                                               uint64_t name_or_index,
+                                               uint64_t address) {
+  auto it = std::lower_bound(addresses_.begin(), addresses_.end(), address);
+  if (it == addresses_.end() || *it != address) return;
+
+  // Node 0 is the root
+  uint64_t ordinal = it - addresses_.begin() + 1;
+  retained_[ordinal] = true;
+
+  fprintf(edges_, "%s%d,%" PRIu64 ",%" PRIu64, edge_count_ > 0 ? ",\n" : "",
+          type, name_or_index, ordinal * kSnapshotNodeFields);
+  edge_count_++;
+  node_edges_++;
+}
+
+
+bool HeapSnapshotCmd::DoExecute(SBDebugger d, char** cmd,
+                                SBCommandReturnObject& result) {
+  SBTarget target = d.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.SetError("No valid process, please start something\n");
+    return false;
+  }
+
+  if (cmd == nullptr || *cmd == nullptr) {
+    result.SetError("USAGE: v8 heapsnapshot file\n");
+    return false;
+  }
+  std::string path = *cmd;
+
+  // Load V8 constants from postmortem data
+  llscan_->v8()->Load(target);
+
+  if (!llscan_->ScanHeapForObjects(target, result)) {
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+
+  // Node ordinals, the root is 0 and the objects follow in address order
+  TypeRecordMap& types = llscan_->GetMapsToInstances();
+  std::vector<uint64_t> addresses;
+  ForEachSnapshotNode(types, [&](TypeRecord* type, size_t index) {
+    addresses.push_back(type->GetInstances()[index]);
+  });
+
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    Error err = Error::Failure("Failed to open %s: %s", path.c_str(),
+                               strerror(errno));
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  SnapshotTempFile nodes(path + ".nodes.tmp");
+  SnapshotTempFile edges(path + ".edges.tmp");
+  SnapshotTempFile strings_file(path + ".strings.tmp");
+  for (SnapshotTempFile* tmp : {&nodes, &edges, &strings_file}) {
+    if (tmp->file() != nullptr) continue;
+    Error err = Error::Failure("Failed to open %s: %s", tmp->path().c_str(),
+                               strerror(errno));
+    result.SetError(err.GetMessage());
+    fclose(file);
+    return false;
+  }
+
+  SnapshotStrings strings(strings_file.file());
+  uint64_t root_name = strings.Get("");
+  SnapshotBuilder builder(llscan_->v8(), addresses, nodes.file(),
+                          edges.file(), &strings);
+  {
+    v8::ReadCache cache(llscan_->v8());
+    v8::ReadCache::Scope scope(&cache);
+    uint64_t ordinal = 1;
+    ForEachSnapshotNode(types, [&](TypeRecord* type, size_t index) {
+      builder.AddNode(type, index, ordinal++);
+    });
+  }
+  strings.Close();
+
+  uint64_t node_count = addresses.size() + 1;
+  uint64_t root_edges = 0;
+  for (uint64_t i = 1; i < node_count; i++) {
+    if (!builder.IsRetained(i)) root_edges++;
+  }
+  uint64_t edge_count = builder.edge_count() + root_edges;
+
+  std::string header;
+  {
+    StringSink sink(&header);
+    JSONWriter writer(&sink);
+    WriteSnapshotHeader(&writer, node_count, edge_count);
+  }
+  fprintf(file, "{\"snapshot\":%s,\n\"nodes\":[", header.c_str());
+  fprintf(file, "%d,%" PRIu64 ",1,0,%" PRIu64 ",0", kSnapshotNodeSynthetic,
+          root_name, root_edges);
+  bool copied = nodes.CopyTo(file);
+
+  // The root's edges come first, to every object nothing else refers to
+  fprintf(file, "],\n\"edges\":[");
+  uint64_t root_edge = 0;
+  for (uint64_t i = 1; i < node_count; i++) {
+    if (builder.IsRetained(i)) continue;
+    fprintf(file, "%s%d,%" PRIu64 ",%" PRIu64, root_edge > 0 ? ",\n" : "",
+            kSnapshotEdgeElement, root_edge, i * kSnapshotNodeFields);
+    root_edge++;
+  }
+  if (root_edges > 0 && builder.edge_count() > 0) fprintf(file, ",\n");
+  copied = copied && edges.CopyTo(file);
+
+  fprintf(file,
+          "],\n\"trace_function_infos\":[],\n\"trace_tree\":[],\n"
+          "\"samples\":[],\n\"locations\":[],\n\"strings\":");
+  copied = copied && strings_file.CopyTo(file);
+  fprintf(file, "}\n");
+
+  if (fclose(file) != 0 || !copied) {
+    Error err =
+        Error::Failure("Failed to write %s: %s", path.c_str(), strerror(errno));
+    result.SetError(err.GetMessage());
+    return false;
+  }
+
+  result.Printf("Wrote %" PRIu64 " nodes and %" PRIu64 " edges to %s\n",
+                node_count, edge_count, path.c_str());
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+
 bool NodeInfoCmd::DoExecute(SBDebugger d, char** cmd,
                             SBCommandReturnObject& result) {
   SBTarget target = d.GetSelectedTarget();
@@ -312,11 +1288,34 @@ bool NodeInfoCmd::DoExecute(SBDebugger d, char** cmd,
     return false;
   }
 
+  bool json = false;
+  for (char** p = cmd; p != nullptr && *p != nullptr; p++) {
+    if (strcmp(*p, "-j") == 0 || strcmp(*p, "--json") == 0) json = true;
+  }
+
   std::string process_type_name("process");
 
   TypeRecordMap::iterator instance_it =
       llscan_->GetMapsToInstances().find(process_type_name);
 
+  if (json) {
+    ResultSink sink(result);
+    JSONWriter writer(&sink);
+    writer.BeginObject();
+    writer.Key("processes");
+    writer.BeginArray();
+    if (instance_it != llscan_->GetMapsToInstances().end()) {
+      for (auto it : instance_it->second->GetInstances()) {
+        v8::JSObject process_obj(llscan_->v8(), it);
+        WriteProcessJSON(process_obj, &writer);
+      }
+    }
+    writer.EndArray();
+    writer.EndObject();
+    sink.Write("\n");
+    return true;
+  }
+
   if (instance_it != llscan_->GetMapsToInstances().end()) {
     TypeRecord* t = instance_it->second;
     for (auto it : t->GetInstances()) {
@@ -469,6 +1468,87 @@ bool NodeInfoCmd::DoExecute(SBDebugger d, char** cmd,
   return true;
 }
 
+// Unreadable fields are left out instead of failing the whole entry.
+void NodeInfoCmd::WriteProcessJSON(v8::JSObject process_obj,
+                                   JSONWriter* json) {
+  Error pid_err;
+  v8::Value pid_val = process_obj.GetProperty("pid", pid_err);
+  // This isn't the process object we are looking for.
+  if (pid_val.v8() == nullptr) return;
+
+  json->BeginObject();
+  json->Key("address");
+  json->Address(process_obj.raw());
+  json->Key("pid");
+  json->Int(v8::Smi(pid_val).GetValue());
+
+  const char* const string_keys[] = {"platform", "arch", "version",
+                                     "execPath"};
+  for (const char* key : string_keys) {
+    Error err;
+    v8::Value val = process_obj.GetProperty(key, err);
+    if (val.v8() == nullptr) continue;
+    std::string str = v8::String(val).ToString(err);
+    if (err.Fail()) continue;
+    json->Key(key);
+    json->String(str);
+  }
+
+  // process.versions and process.release only hold strings
+  const char* const object_keys[] = {"versions", "release"};
+  for (const char* key : object_keys) {
+    Error err;
+    v8::Value val = process_obj.GetProperty(key, err);
+    if (val.v8() == nullptr) continue;
+    v8::JSObject obj(val);
+
+    std::vector<std::string> keys;
+    obj.Keys(keys, err);
+    std::sort(keys.begin(), keys.end());
+
+    json->Key(key);
+    json->BeginObject();
+    for (const std::string& k : keys) {
+      Error str_err;
+      v8::Value str_val = obj.GetProperty(k, str_err);
+      if (str_val.v8() == nullptr) continue;
+      std::string str = v8::String(str_val).ToString(str_err);
+      if (str_err.Fail()) continue;
+      json->Key(k);
+      json->String(str);
+    }
+    json->EndObject();
+  }
+
+  const char* const array_keys[] = {"argv", "execArgv"};
+  for (const char* key : array_keys) {
+    Error err;
+    v8::Value val = process_obj.GetProperty(key, err);
+    if (val.v8() == nullptr) continue;
+    json->Key(key);
+    WriteStringsJSON(v8::JSArray(val), json);
+  }
+
+  json->EndObject();
+}
+
+
+void NodeInfoCmd::WriteStringsJSON(v8::JSArray array, JSONWriter* json) {
+  json->BeginArray();
+  Error err;
+  int64_t length = array.GetArrayLength(err);
+  for (int64_t i = 0; i < length; ++i) {
+    Error element_err;
+    v8::Value element_val = array.GetArrayElement(i, element_err);
+    if (element_val.v8() == nullptr) continue;
+    std::string str = v8::String(element_val).ToString(element_err);
+    if (element_err.Fail()) continue;
+    json->String(str);
+  }
+  json->EndArray();
+}
+
+
 bool FindReferencesCmd::DoExecute(SBDebugger d, char** cmd,
                                   SBCommandReturnObject& result) {
   if (cmd == nullptr || *cmd == nullptr) {
@@ -583,8 +1663,32 @@ bool FindReferencesCmd::DoExecute(SBDebugger d, char** cmd,
 
   // Get the list of references for the given search value, property or string
   ReferencesVector* references = scanner->GetReferences();
-  PrintReferences(result, references, scanner, &scan_options,
-                  &already_visited_references);
+  if (scan_options.json) {
+    ResultSink sink(result);
+    JSONWriter json(&sink);
+    json_ = &json;
+    scanner->set_json(&json);
+    json.BeginObject();
+    json.Key("references");
+    json.BeginArray();
+    PrintReferences(result, references, scanner, &scan_options,
+                    &already_visited_references);
+    json.EndArray();
+    json.Key("partial_objects");
+    json.Int(scanner->partial_objects());
+    json.EndObject();
+    sink.Write("\n");
+    json_ = nullptr;
+  } else {
+    PrintReferences(result, references, scanner, &scan_options,
+                    &already_visited_references);
+    if (scanner->partial_objects() > 0) {
+      result.Printf("(%" PRIu64
+                    " objects could not be fully decoded, references from "
+                    "them may be missing)\n",
+                    scanner->partial_objects());
+    }
+  }
 
   delete scanner;
 
@@ -640,10 +1744,12 @@ void FindReferencesCmd::PrintRecursiveReferences(
 
   std::string branch = std::string(padding * level, ' ') + "+ ";
 
-  result.Printf("%s", branch.c_str());
+  // JSON references carry their level, the tree is implied by their order
+  if (json_ == nullptr) result.Printf("%s", branch.c_str());
 
   if (find(visited_references->begin(), visited_references->end(), address) !=
       visited_references->end()) {
+    if (json_ != nullptr) return;
     std::stringstream seen_str;
     seen_str << rang::fg::red << " [seen above]" << rang::fg::reset
              << std::endl;
@@ -652,6 +1758,7 @@ void FindReferencesCmd::PrintRecursiveReferences(
     visited_references->push_back(address);
     v8::Value value(llscan_->v8(), address);
     ReferenceScanner scanner_(llscan_, value);
+    scanner_.set_json(json_);
     ReferencesVector* references_ = scanner_.GetReferences();
     PrintReferences(result, references_, &scanner_, options, visited_references,
                     level + 1);
@@ -718,6 +1825,7 @@ char** FindReferencesCmd::ParseScanOptions(char** cmd, ScanOptions* options) {
                                  {"name", no_argument, nullptr, 'n'},
                                  {"string", no_argument, nullptr, 's'},
                                  {"recursive", no_argument, nullptr, 'r'},
+                                 {"json", no_argument, nullptr, 'j'},
                                  {nullptr, 0, nullptr, 0}};
 
   int argc = 1;
@@ -737,10 +1845,11 @@ char** FindReferencesCmd::ParseScanOptions(char** cmd, ScanOptions* options) {
   optind = 0;
   opterr = 1;
   do {
-    int arg = getopt_long(argc, args, "vnsr", opts, nullptr);
+    int arg = getopt_long(argc, args, "vnsrj", opts, nullptr);
     if (arg == -1) break;
 
-    if (found_scan_type) {
+    // Only one search type can be given
+    if (found_scan_type && arg != 'r' && arg != 'j') {
       options->scan_type = ScanOptions::ScanType::kBadOption;
       break;
     }
@@ -749,6 +1858,9 @@ char** FindReferencesCmd::ParseScanOptions(char** cmd, ScanOptions* options) {
       case 'r':
         options->recursive_scan = true;
         break;
+      case 'j':
+        options->json = true;
+        break;
       case 'v':
         options->scan_type = ScanOptions::ScanType::kFieldValue;
         found_scan_type = true;
@@ -807,14 +1919,18 @@ void FindReferencesCmd::ReferenceScanner::PrintContextRefs(
                         search_value_.raw(), c.raw());
         }
 
-        std::stringstream ss;
-        ss << rang::fg::cyan << "0x%" PRIx64 << rang::fg::reset << ": "
-           << rang::fg::magenta << "Context" << rang::style::bold
-           << rang::fg::yellow << ".%s" << rang::fg::reset << rang::style::reset
-           << "=" << rang::fg::cyan << "0x%" PRIx64 << rang::fg::reset << "\n";
-
-        result.Printf(ss.str().c_str(), c.raw(), name.c_str(),
-                      search_value_.raw());
+        if (!WriteReference(c.raw(), "Context", name, search_value_.raw(),
+                            level)) {
+          std::stringstream ss;
+          ss << rang::fg::cyan << "0x%" PRIx64 << rang::fg::reset << ": "
+             << rang::fg::magenta << "Context" << rang::style::bold
+             << rang::fg::yellow << ".%s" << rang::fg::reset
+             << rang::style::reset << "=" << rang::fg::cyan << "0x%" PRIx64
+             << rang::fg::reset << "\n";
+
+          result.Printf(ss.str().c_str(), c.raw(), name.c_str(),
+                        search_value_.raw());
+        }
 
         if (options->recursive_scan) {
           cli_cmd_->PrintRecursiveReferences(
@@ -846,6 +1962,69 @@ std::string FindReferencesCmd::ObjectScanner::GetArrayReferenceString(
 }
 
 
+void FindReferencesCmd::ObjectScanner::CheckProperties(
+    v8::JSObject& js_obj, const v8::JSObject::OwnProperties& properties,
+    Error& err) {
+  if (properties.error().Success()) return;
+
+  if (partial_objects_.insert(js_obj.raw()).second) {
+    PRINT_DEBUG("Properties of 0x%016" PRIx64 " were only partially decoded",
+                js_obj.raw());
+  }
+  err = properties.error();
+}
+
+
+bool FindReferencesCmd::ObjectScanner::WriteReference(
+    uint64_t object, const std::string& type_name, const std::string& name,
+    uint64_t value, int level, const std::string* str) {
+  if (json_ == nullptr) return false;
+
+  json_->BeginObject();
+  json_->Key("object");
+  json_->Address(object);
+  json_->Key("type");
+  json_->String(type_name);
+  json_->Key("property");
+  json_->String(name);
+  json_->Key("value");
+  json_->Address(value);
+  if (str != nullptr) {
+    json_->Key("string");
+    json_->String(*str);
+  }
+  json_->Key("level");
+  json_->Int(level);
+  json_->EndObject();
+  return true;
+}
+
+
+bool FindReferencesCmd::ObjectScanner::WriteReference(
+    uint64_t object, const std::string& type_name, int64_t index,
+    uint64_t value, int level, const std::string* str) {
+  if (json_ == nullptr) return false;
+
+  json_->BeginObject();
+  json_->Key("object");
+  json_->Address(object);
+  json_->Key("type");
+  json_->String(type_name);
+  json_->Key("index");
+  json_->Int(index);
+  json_->Key("value");
+  json_->Address(value);
+  if (str != nullptr) {
+    json_->Key("string");
+    json_->String(*str);
+  }
+  json_->Key("level");
+  json_->Int(level);
+  json_->EndObject();
+  return true;
+}
+
+
 void FindReferencesCmd::ReferenceScanner::PrintRefs(
     SBCommandReturnObject& result, v8::JSObject& js_obj, Error& err,
     int level) {
@@ -860,6 +2039,9 @@ void FindReferencesCmd::ReferenceScanner::PrintRefs(
 
     std::string type_name = js_obj.GetTypeName(err);
 
+    if (WriteReference(js_obj.raw(), type_name, i, search_value_.raw(), level))
+      continue;
+
     std::string reference_template(GetArrayReferenceString(level));
     result.Printf(reference_template.c_str(), js_obj.raw(), type_name.c_str(),
                   i, search_value_.raw());
@@ -868,22 +2050,29 @@ void FindReferencesCmd::ReferenceScanner::PrintRefs(
   // Walk all the properties in this object.
   // We only create strings for the field names that match the search
   // value.
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
+  v8::JSObject::OwnProperties properties(&js_obj, err);
   if (err.Fail()) {
     return;
   }
-  for (auto entry : entries) {
+  for (v8::JSObject::OwnProperties::Iterator it = properties.begin();
+       it != properties.end(); it++) {
+    std::pair<v8::Value, v8::Value> entry = *it;
     v8::Value v = entry.second;
     if (v.raw() == search_value_.raw()) {
       std::string key = entry.first.ToString(err);
       std::string type_name = js_obj.GetTypeName(err);
 
+      if (WriteReference(js_obj.raw(), type_name, key, search_value_.raw(),
+                         level))
+        continue;
+
       std::string reference_template(GetPropertyReferenceString(level));
 
       result.Printf(reference_template.c_str(), js_obj.raw(), type_name.c_str(),
                     key.c_str(), search_value_.raw());
     }
   }
+  CheckProperties(js_obj, properties, err);
 }
 
 
@@ -902,9 +2091,12 @@ void FindReferencesCmd::ReferenceScanner::PrintRefs(
     if (err.Success() && parent.raw() == search_value_.raw()) {
       std::string type_name = sliced_str.GetTypeName(err);
 
-      std::string reference_template(GetPropertyReferenceString(level));
-      result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
-                    "<Parent>", search_value_.raw());
+      if (!WriteReference(str.raw(), type_name, "<Parent>", search_value_.raw(),
+                          level)) {
+        std::string reference_template(GetPropertyReferenceString(level));
+        result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
+                      "<Parent>", search_value_.raw());
+      }
     }
   } else if (*repr == v8->string()->kConsStringTag) {
     v8::ConsString cons_str(str);
@@ -913,18 +2105,24 @@ void FindReferencesCmd::ReferenceScanner::PrintRefs(
     if (err.Success() && first.raw() == search_value_.raw()) {
       std::string type_name = cons_str.GetTypeName(err);
 
-      std::string reference_template(GetPropertyReferenceString(level));
-      result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
-                    "<First>", search_value_.raw());
+      if (!WriteReference(str.raw(), type_name, "<First>", search_value_.raw(),
+                          level)) {
+        std::string reference_template(GetPropertyReferenceString(level));
+        result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
+                      "<First>", search_value_.raw());
+      }
     }
 
     v8::String second = cons_str.Second(err);
     if (err.Success() && second.raw() == search_value_.raw()) {
       std::string type_name = cons_str.GetTypeName(err);
 
-      std::string reference_template(GetPropertyReferenceString(level));
-      result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
-                    "<Second>", search_value_.raw());
+      if (!WriteReference(str.raw(), type_name, "<Second>", search_value_.raw(),
+                          level)) {
+        std::string reference_template(GetPropertyReferenceString(level));
+        result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
+                      "<Second>", search_value_.raw());
+      }
     }
   } else if (*repr == v8->string()->kThinStringTag) {
     v8::ThinString thin_str(str);
@@ -932,9 +2130,12 @@ void FindReferencesCmd::ReferenceScanner::PrintRefs(
     if (err.Success() && actual.raw() == search_value_.raw()) {
       std::string type_name = thin_str.GetTypeName(err);
 
-      std::string reference_template(GetPropertyReferenceString(level));
-      result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
-                    "<Actual>", search_value_.raw());
+      if (!WriteReference(str.raw(), type_name, "<Actual>", search_value_.raw(),
+                          level)) {
+        std::string reference_template(GetPropertyReferenceString(level));
+        result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
+                      "<Actual>", search_value_.raw());
+      }
     }
   }
   // Nothing to do for other kinds of string.
@@ -962,11 +2163,13 @@ void FindReferencesCmd::ReferenceScanner::ScanRefs(v8::JSObject& js_obj,
   // Walk all the properties in this object.
   // We only create strings for the field names that match the search
   // value.
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
+  v8::JSObject::OwnProperties properties(&js_obj, err);
   if (err.Fail()) {
     return;
   }
-  for (auto entry : entries) {
+  for (v8::JSObject::OwnProperties::Iterator it = properties.begin();
+       it != properties.end(); it++) {
+    std::pair<v8::Value, v8::Value> entry = *it;
     v8::Value v = entry.second;
 
     if (already_saved.count(v.raw())) continue;
@@ -975,6 +2178,7 @@ void FindReferencesCmd::ReferenceScanner::ScanRefs(v8::JSObject& js_obj,
     references->push_back(js_obj.raw());
     already_saved.insert(v.raw());
   }
+  CheckProperties(js_obj, properties, err);
 }
 
 
@@ -1045,11 +2249,13 @@ void FindReferencesCmd::PropertyScanner::PrintRefs(
   // Walk all the properties in this object.
   // We only create strings for the field names that match the search
   // value.
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
+  v8::JSObject::OwnProperties properties(&js_obj, err);
   if (err.Fail()) {
     return;
   }
-  for (auto entry : entries) {
+  for (v8::JSObject::OwnProperties::Iterator it = properties.begin();
+       it != properties.end(); it++) {
+    std::pair<v8::Value, v8::Value> entry = *it;
     v8::HeapObject nameObj(entry.first);
     std::string key = entry.first.ToString(err);
     if (err.Fail()) {
@@ -1058,11 +2264,18 @@ void FindReferencesCmd::PropertyScanner::PrintRefs(
     if (key == search_value_) {
       std::string type_name = js_obj.GetTypeName(err);
 
-      std::string reference_template(GetPropertyReferenceString());
-      result.Printf(reference_template.c_str(), js_obj.raw(), type_name.c_str(),
-                    key.c_str(), entry.second.raw());
+      if (!WriteReference(js_obj.raw(), type_name, key, entry.second.raw(),
+                          level)) {
+        std::string reference_template(GetPropertyReferenceString());
+        result.Printf(reference_template.c_str(), js_obj.raw(),
+                      type_name.c_str(), key.c_str(), entry.second.raw());
+      }
+
+      // Property names are unique, no need to decode the rest.
+      break;
     }
   }
+  CheckProperties(js_obj, properties, err);
 }
 
 
@@ -1074,11 +2287,13 @@ void FindReferencesCmd::PropertyScanner::ScanRefs(v8::JSObject& js_obj,
   // We only create strings for the field names that match the search
   // value.
   ReferencesVector* references;
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
+  v8::JSObject::OwnProperties properties(&js_obj, err);
   if (err.Fail()) {
     return;
   }
-  for (auto entry : entries) {
+  for (v8::JSObject::OwnProperties::Iterator it = properties.begin();
+       it != properties.end(); it++) {
+    std::pair<v8::Value, v8::Value> entry = *it;
     v8::HeapObject nameObj(entry.first);
     std::string key = entry.first.ToString(err);
     if (err.Fail()) {
@@ -1087,6 +2302,7 @@ void FindReferencesCmd::PropertyScanner::ScanRefs(v8::JSObject& js_obj,
     references = llscan_->GetReferencesByProperty(key);
     references->push_back(js_obj.raw());
   }
+  CheckProperties(js_obj, properties, err);
 }
 
 
@@ -1126,6 +2342,9 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
       if (err.Success() && search_value_ == value) {
         std::string type_name = js_obj.GetTypeName(err);
 
+        if (WriteReference(js_obj.raw(), type_name, i, v.raw(), level, &value))
+          continue;
+
         std::stringstream ss;
         ss << rang::fg::cyan << std::hex << js_obj.raw() << std::dec
            << rang::fg::reset;
@@ -1140,9 +2359,11 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
   // Walk all the properties in this object.
   // We only create strings for the field names that match the search
   // value.
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
+  v8::JSObject::OwnProperties properties(&js_obj, err);
   if (err.Success()) {
-    for (auto entry : entries) {
+    for (v8::JSObject::OwnProperties::Iterator it = properties.begin();
+         it != properties.end(); it++) {
+      std::pair<v8::Value, v8::Value> entry = *it;
       v8::HeapObject valueObj(entry.second);
       int64_t type = valueObj.GetType(err);
       if (err.Fail()) {
@@ -1161,6 +2382,10 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
           }
           std::string type_name = js_obj.GetTypeName(err);
 
+          if (WriteReference(js_obj.raw(), type_name, key, entry.second.raw(),
+                             level, &value))
+            continue;
+
           std::stringstream ss;
           ss << rang::fg::cyan << "0x" << std::hex << js_obj.raw() << std::dec
              << rang::fg::reset << ": " << type_name.c_str() << "."
@@ -1172,6 +2397,7 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
         }
       }
     }
+    CheckProperties(js_obj, properties, err);
   }
 }
 
@@ -1194,9 +2420,12 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
     std::string parent = parent_str.ToString(err);
     if (err.Success() && search_value_ == parent) {
       std::string type_name = sliced_str.GetTypeName(err);
-      result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n", str.raw(),
-                    type_name.c_str(), "<Parent>", parent_str.raw(),
-                    parent.c_str());
+      if (!WriteReference(str.raw(), type_name, "<Parent>", parent_str.raw(),
+                          level, &parent)) {
+        result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n", str.raw(),
+                      type_name.c_str(), "<Parent>", parent_str.raw(),
+                      parent.c_str());
+      }
     }
   } else if (*repr == v8->string()->kConsStringTag) {
     v8::ConsString cons_str(str);
@@ -1215,9 +2444,12 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
 
       if (err.Success() && search_value_ == first) {
         std::string type_name = cons_str.GetTypeName(err);
-        result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n", str.raw(),
-                      type_name.c_str(), "<First>", first_str.raw(),
-                      first.c_str());
+        if (!WriteReference(str.raw(), type_name, "<First>", first_str.raw(),
+                            level, &first)) {
+          result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n",
+                        str.raw(), type_name.c_str(), "<First>",
+                        first_str.raw(), first.c_str());
+        }
       }
     }
 
@@ -1235,9 +2467,12 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
 
       if (err.Success() && search_value_ == second) {
         std::string type_name = cons_str.GetTypeName(err);
-        result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n", str.raw(),
-                      type_name.c_str(), "<Second>", second_str.raw(),
-                      second.c_str());
+        if (!WriteReference(str.raw(), type_name, "<Second>", second_str.raw(),
+                            level, &second)) {
+          result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n",
+                        str.raw(), type_name.c_str(), "<Second>",
+                        second_str.raw(), second.c_str());
+        }
       }
     }
   }
@@ -1282,9 +2517,11 @@ void FindReferencesCmd::StringScanner::ScanRefs(v8::JSObject& js_obj,
   // Walk all the properties in this object.
   // We only create strings for the field names that match the search
   // value.
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
+  v8::JSObject::OwnProperties properties(&js_obj, err);
   if (err.Success()) {
-    for (auto entry : entries) {
+    for (v8::JSObject::OwnProperties::Iterator it = properties.begin();
+         it != properties.end(); it++) {
+      std::pair<v8::Value, v8::Value> entry = *it;
       v8::HeapObject valueObj(entry.second);
       int64_t type = valueObj.GetType(err);
       if (err.Fail()) {
@@ -1303,6 +2540,7 @@ void FindReferencesCmd::StringScanner::ScanRefs(v8::JSObject& js_obj,
         already_saved.insert(value);
       }
     }
+    CheckProperties(js_obj, properties, err);
   }
 }
 
@@ -1383,25 +2621,27 @@ ReferencesVector* FindReferencesCmd::StringScanner::GetReferences() {
 FindJSObjectsVisitor::FindJSObjectsVisitor(SBTarget& target, LLScan* llscan)
     : target_(target), llscan_(llscan) {
   found_count_ = 0;
-  address_byte_size_ = target_.GetProcess().GetAddressByteSize();
+  word_size_ = llscan_->v8()->common()->kTaggedSize;
 }
 
 
 /* Visit every address, a bit brute force but it works. */
 uint64_t FindJSObjectsVisitor::Visit(uint64_t location, uint64_t word) {
+  if (llscan_->v8()->common()->PointerCompression())
+    word = llscan_->v8()->DecompressTagged(location, word);
   v8::Value v8_value(llscan_->v8(), word);
 
   Error err;
   // Test if this is SMI
   // Skip inspecting things that look like Smi's, they aren't objects.
   v8::Smi smi(v8_value);
-  if (smi.Check()) return address_byte_size_;
+  if (smi.Check()) return word_size_;
 
   v8::HeapObject heap_object(v8_value);
-  if (!heap_object.Check()) return address_byte_size_;
+  if (!heap_object.Check()) return word_size_;
 
   v8::HeapObject map_object = heap_object.GetMap(err);
-  if (err.Fail() || !map_object.Check()) return address_byte_size_;
+  if (err.Fail() || !map_object.Check()) return word_size_;
 
   v8::Map map(map_object);
 
@@ -1409,8 +2649,9 @@ uint64_t FindJSObjectsVisitor::Visit(uint64_t location, uint64_t word) {
   if (map_cache_.count(map.raw()) == 0) {
     map_info.Load(map, heap_object, llscan_->v8(), err);
     if (err.Fail()) {
-      return address_byte_size_;
+      return word_size_;
     }
+    map_info.isolate = llscan_->GetIsolateIndex(map);
     // Cache result
     map_cache_.emplace(map.raw(), map_info);
   } else {
@@ -1419,16 +2660,32 @@ uint64_t FindJSObjectsVisitor::Visit(uint64_t location, uint64_t word) {
 
   if (map_info.is_context) {
     InsertOnContexts(word, err);
-    return address_byte_size_;
+    return word_size_;
+  }
+
+  if (map_info.type == llscan_->v8()->types()->kCodeType ||
+      map_info.type == llscan_->v8()->types()->kJSFunctionType) {
+    InsertOnCodeMap(heap_object, map_info.type, err);
+    err = Error::Ok();
   }
 
-  if (!map_info.is_histogram) return address_byte_size_;
+  if (!map_info.is_histogram) return word_size_;
 
-  InsertOnMapsToInstances(word, map, map_info, err);
-  InsertOnDetailedMapsToInstances(word, map, map_info, err);
+  int64_t size;
+  if (map_info.is_string) {
+    v8::String str(heap_object);
+    size = str.Size(err);
+  } else {
+    size = map.InstanceSize(err);
+  }
+  // A negative size would wrap around in the uint32_t instance sizes
+  if (err.Fail() || size < 0) return word_size_;
+
+  InsertOnMapsToInstances(word, size, map_info, err);
+  InsertOnDetailedMapsToInstances(word, size, map_info, err);
 
   if (err.Fail()) {
-    return address_byte_size_;
+    return word_size_;
   }
 
   found_count_++;
@@ -1436,7 +2693,7 @@ uint64_t FindJSObjectsVisitor::Visit(uint64_t location, uint64_t word) {
   /* Just advance one word.
    * (Should advance by object size, assuming objects can't overlap!)
    */
-  return address_byte_size_;
+  return word_size_;
 }
 
 void FindJSObjectsVisitor::InsertOnContexts(uint64_t word, Error& err) {
@@ -1445,8 +2702,30 @@ void FindJSObjectsVisitor::InsertOnContexts(uint64_t word, Error& err) {
   contexts->insert(word);
 }
 
+void FindJSObjectsVisitor::InsertOnCodeMap(v8::HeapObject heap_object,
+                                           int64_t type, Error& err) {
+  v8::LLV8* v8 = llscan_->v8();
+  if (v8->code()->kStartOffset == -1 || v8->code()->kSizeOffset == -1) return;
+
+  // Functions name the code they run, code objects alone are just ranges
+  v8::Code code(heap_object);
+  uint64_t function = 0;
+  if (type == v8->types()->kJSFunctionType) {
+    v8::JSFunction fn(heap_object);
+    code = fn.GetCode(err);
+    if (err.Fail() || !code.Check()) return;
+    // Newer V8s point at a CodeDataContainer instead
+    if (code.GetType(err) != v8->types()->kCodeType || err.Fail()) return;
+    function = fn.raw();
+  }
+
+  int64_t size = code.Size(err);
+  if (err.Fail()) return;
+  v8->code_map()->AddCode(code.Start(), size, function);
+}
+
 void FindJSObjectsVisitor::InsertOnMapsToInstances(
-    uint64_t word, v8::Map map, FindJSObjectsVisitor::MapCacheEntry map_info,
+    uint64_t word, uint64_t size, FindJSObjectsVisitor::MapCacheEntry map_info,
     Error& err) {
   TypeRecord* t;
 
@@ -1455,11 +2734,11 @@ void FindJSObjectsVisitor::InsertOnMapsToInstances(
   // No entry in the map, create a new one.
   if (*pp == nullptr) *pp = new TypeRecord(map_info.type_name);
   t = *pp;
-  t->AddInstance(word, map.InstanceSize(err));
+  t->AddInstance(word, size, map_info.isolate);
 }
 
 void FindJSObjectsVisitor::InsertOnDetailedMapsToInstances(
-    uint64_t word, v8::Map map, FindJSObjectsVisitor::MapCacheEntry map_info,
+    uint64_t word, uint64_t size, FindJSObjectsVisitor::MapCacheEntry map_info,
     Error& err) {
   DetailedTypeRecord* t;
 
@@ -1477,7 +2756,90 @@ void FindJSObjectsVisitor::InsertOnDetailedMapsToInstances(
                                  map_info.indexed_properties_count_);
   }
   t = *pp;
-  t->AddInstance(word, map.InstanceSize(err));
+  t->AddInstance(word, size, map_info.isolate);
+}
+
+
+void TypeRecord::Finalize() {
+  // Memory regions are scanned in address order, so there is only work to do
+  // if a platform reports them out of order or overlapping.
+  bool sorted = true;
+  for (size_t i = 1; i < instances_.size() && sorted; i++)
+    sorted = instances_[i - 1] < instances_[i];
+  if (sorted) return;
+
+  std::vector<size_t> order(instances_.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return instances_[a] < instances_[b];
+  });
+
+  std::vector<uint64_t> instances;
+  std::vector<uint32_t> sizes;
+  std::vector<uint32_t> isolates;
+  instances.reserve(order.size());
+  sizes.reserve(order.size());
+  isolates.reserve(order.size());
+  instance_count_ = 0;
+  total_instance_size_ = 0;
+  for (size_t i : order) {
+    if (!instances.empty() && instances.back() == instances_[i]) continue;
+    instances.push_back(instances_[i]);
+    sizes.push_back(instance_sizes_[i]);
+    isolates.push_back(instance_isolates_[i]);
+    instance_count_++;
+    total_instance_size_ += instance_sizes_[i];
+  }
+
+  instances_.swap(instances);
+  instance_sizes_.swap(sizes);
+  instance_isolates_.swap(isolates);
+  size_order_.clear();
+}
+
+
+void TypeRecord::KeepIsolate(uint32_t isolate) {
+  size_t kept = 0;
+  instance_count_ = 0;
+  total_instance_size_ = 0;
+  for (size_t i = 0; i < instances_.size(); i++) {
+    if (instance_isolates_[i] != isolate) continue;
+    instances_[kept] = instances_[i];
+    instance_sizes_[kept] = instance_sizes_[i];
+    instance_isolates_[kept] = isolate;
+    kept++;
+    instance_count_++;
+    total_instance_size_ += instance_sizes_[i];
+  }
+
+  instances_.resize(kept);
+  instance_sizes_.resize(kept);
+  instance_isolates_.resize(kept);
+  size_order_.clear();
+}
+
+
+void TypeRecord::GetAddressRange(uint64_t start, uint64_t end, size_t* first,
+                                 size_t* last) {
+  auto begin = std::lower_bound(instances_.begin(), instances_.end(), start);
+  auto finish = end == 0
+                    ? instances_.end()
+                    : std::lower_bound(begin, instances_.end(), end);
+  *first = begin - instances_.begin();
+  *last = finish - instances_.begin();
+}
+
+
+std::vector<size_t>& TypeRecord::GetSizeOrder() {
+  if (size_order_.size() == instances_.size()) return size_order_;
+
+  size_order_.resize(instances_.size());
+  for (size_t i = 0; i < size_order_.size(); i++) size_order_[i] = i;
+  std::stable_sort(size_order_.begin(), size_order_.end(),
+                   [this](size_t a, size_t b) {
+                     return instance_sizes_[a] > instance_sizes_[b];
+                   });
+  return size_order_;
 }
 
 
@@ -1510,6 +2872,9 @@ bool LLScan::ScanHeapForObjects(lldb::SBTarget target,
     target_ = target;
   }
 
+  // Environments identify the isolates
+  if (node_ != nullptr) node_->Load(target);
+
   /* If we've reached here we have access to information about the valid memory
    * regions in the process and can scan for objects.
    */
@@ -1519,6 +2884,10 @@ bool LLScan::ScanHeapForObjects(lldb::SBTarget target,
     FindJSObjectsVisitor v(target, this);
 
     ScanMemoryRegions(v);
+
+    for (auto entry : mapstoinstances_) entry.second->Finalize();
+    for (auto entry : detailedmapstoinstances_) entry.second->Finalize();
+    CountIsolateInstances();
   }
 
   return true;
@@ -1551,6 +2920,10 @@ bool FindJSObjectsVisitor::MapCacheEntry::Load(v8::Map map,
                                                v8::HeapObject heap_object,
                                                v8::LLV8* llv8, Error& err) {
   is_histogram = false;
+  is_string = false;
+
+  type = map.GetType(err);
+  if (err.Fail()) return false;
 
   is_context = v8::Context::IsContext(llv8, heap_object, err);
   if (err.Fail()) return false;
@@ -1562,6 +2935,9 @@ bool FindJSObjectsVisitor::MapCacheEntry::Load(v8::Map map,
   // On success load type name
   if (is_histogram) type_name = heap_object.GetTypeName(err);
 
+  is_string = v8::String::IsString(llv8, heap_object, err);
+  if (err.Fail()) return false;
+
   v8::HeapObject descriptors_obj = map.InstanceDescriptors(err);
   RETURN_IF_INVALID(descriptors_obj, false);
 
@@ -1569,7 +2945,6 @@ bool FindJSObjectsVisitor::MapCacheEntry::Load(v8::Map map,
   own_descriptors_count_ = map.NumberOfOwnDescriptors(err);
   if (err.Fail()) return false;
 
-  int64_t type = map.GetType(err);
   indexed_properties_count_ = 0;
   if (v8::JSObject::IsObjectType(llv8, type) ||
       (type == llv8->types()->kJSArrayType)) {
@@ -1597,13 +2972,19 @@ inline static ByteOrder GetHostByteOrder() {
 }
 
 void LLScan::ScanMemoryRegions(FindJSObjectsVisitor& v) {
-  const uint64_t addr_size = process_.GetAddressByteSize();
+  const uint64_t addr_size = v.word_size();
   bool swap_bytes = process_.GetByteOrder() != GetHostByteOrder();
 
   // Pages are usually around 1mb, so this should more than enough
   const uint64_t block_size = 1024 * 1024 * addr_size;
   unsigned char* block = new unsigned char[block_size];
 
+  // Compressed values only decode to heap objects inside the isolate's
+  // cage, memory outside of it can't hold them.
+  uint64_t cage_start = static_cast<uint64_t>(llv8_->CageBase());
+  uint64_t cage_end =
+      cage_start != 0 ? cage_start + (1ULL << 32) : UINT64_MAX;
+
   lldb::SBMemoryRegionInfoList memory_regions = process_.GetMemoryRegions();
   lldb::SBMemoryRegionInfo region_info;
 
@@ -1614,8 +2995,12 @@ void LLScan::ScanMemoryRegions(FindJSObjectsVisitor& v) {
       continue;
     }
 
-    uint64_t address = region_info.GetRegionBase();
-    uint64_t len = region_info.GetRegionEnd() - region_info.GetRegionBase();
+    uint64_t address = std::max<uint64_t>(region_info.GetRegionBase(),
+                                          cage_start);
+    uint64_t region_end = std::min<uint64_t>(region_info.GetRegionEnd(),
+                                             cage_end);
+    if (address >= region_end) continue;
+    uint64_t len = region_end - address;
 
     /* Brute force search - query every address - but allow the visitor code to
      * say how far to move on so we don't read every byte.
@@ -1667,6 +3052,70 @@ void LLScan::ScanMemoryRegions(FindJSObjectsVisitor& v) {
   delete[] block;
 }
 
+uint32_t LLScan::GetIsolateIndex(v8::Map map) {
+  if (isolates_.empty()) isolates_.resize(1);
+
+  Error err;
+  v8::HeapObject meta_map = map.GetMap(err);
+  if (err.Fail() || !meta_map.Check()) return 0;
+
+  auto it = isolate_by_meta_map_.find(meta_map.raw());
+  if (it != isolate_by_meta_map_.end()) return it->second;
+
+  // Meta maps created for a native context point back to it
+  IsolateRecord record;
+  v8::HeapObject constructor = v8::Map(meta_map).MaybeConstructor(err);
+  if (err.Success() && constructor.Check() &&
+      v8::Context::IsContext(llv8_, constructor, err)) {
+    v8::Context context(constructor);
+    if (context.IsNative(err)) {
+      record.native_context = context.raw();
+      if (node_ != nullptr &&
+          node_->env()->kEnvContextEmbedderDataIndex != -1) {
+        Error env_err;
+        record.environment =
+            node_->env()->CurrentEnvironmentFromContext(context, env_err);
+        if (env_err.Fail()) record.environment = 0;
+      }
+    }
+  }
+
+  uint32_t index = 0;
+  if (record.native_context != 0) {
+    // vm contexts share their isolate's Environment
+    for (size_t i = 1; i < isolates_.size() && index == 0; i++) {
+      bool same = record.environment != 0
+                      ? isolates_[i].environment == record.environment
+                      : isolates_[i].native_context == record.native_context;
+      if (same) index = i;
+    }
+    if (index == 0) {
+      index = isolates_.size();
+      isolates_.push_back(record);
+    }
+  }
+
+  isolate_by_meta_map_[meta_map.raw()] = index;
+  return index;
+}
+
+
+void LLScan::CountIsolateInstances() {
+  if (isolates_.empty()) isolates_.resize(1);
+
+  for (auto entry : mapstoinstances_) {
+    TypeRecord* t = entry.second;
+    std::vector<uint32_t>& isolates = t->GetInstanceIsolates();
+    std::vector<uint32_t>& sizes = t->GetInstanceSizes();
+    for (size_t i = 0; i < isolates.size(); i++) {
+      IsolateRecord& record = isolates_[isolates[i]];
+      record.instance_count++;
+      record.total_instance_size += sizes[i];
+    }
+  }
+}
+
+
 void LLScan::ClearMapsToInstances() {
   TypeRecord* t;
   for (auto entry : mapstoinstances_) {
@@ -1674,6 +3123,8 @@ void LLScan::ClearMapsToInstances() {
     delete t;
   }
   mapstoinstances_.clear();
+  isolates_.clear();
+  isolate_by_meta_map_.clear();
 }
 
 void LLScan::ClearReferences() {
@@ -4,7 +4,9 @@
 #include <lldb/API/LLDB.h>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "src/error.h"
 #include "src/llnode.h"
@@ -13,6 +15,8 @@
 namespace llnode {
 
 class LLScan;
+class TypeRecord;
+class DetailedTypeRecord;
 
 typedef std::vector<uint64_t> ReferencesVector;
 typedef std::unordered_set<uint64_t> ContextVector;
@@ -21,13 +25,16 @@ typedef std::map<uint64_t, ReferencesVector*> ReferencesByValueMap;
 typedef std::map<std::string, ReferencesVector*> ReferencesByPropertyMap;
 typedef std::map<std::string, ReferencesVector*> ReferencesByStringMap;
 
+typedef std::map<std::string, TypeRecord*> TypeRecordMap;
+typedef std::map<std::string, DetailedTypeRecord*> DetailedTypeRecordMap;
+
 
 // New type defining pagination options
 // It should be feasible to use it to any commands that output
 // a list of information
 struct cmd_pagination_t {
   int total_entries = 0;
-  int current_page = 0;
+  int next_offset = 0;
   int output_limit = 0;
   std::string command = "";
 };
@@ -42,8 +49,13 @@ class FindObjectsCmd : public CommandBase {
   bool DoExecute(lldb::SBDebugger d, char** cmd,
                  lldb::SBCommandReturnObject& result) override;
 
-  void SimpleOutput(lldb::SBCommandReturnObject& result);
-  void DetailedOutput(lldb::SBCommandReturnObject& result);
+  void SimpleOutput(lldb::SBCommandReturnObject& result, TypeRecordMap& maps);
+  void DetailedOutput(lldb::SBCommandReturnObject& result,
+                      DetailedTypeRecordMap& maps);
+  void JSONOutput(lldb::SBCommandReturnObject& result, TypeRecordMap& maps,
+                  DetailedTypeRecordMap& detailed_maps, bool detailed);
+  // Instances and sizes of each isolate's heap
+  void IsolatesOutput(lldb::SBCommandReturnObject& result, bool json);
 
  private:
   LLScan* llscan_;
@@ -59,6 +71,12 @@ class FindInstancesCmd : public CommandBase {
                  lldb::SBCommandReturnObject& result) override;
 
  private:
+  // Render the instances on worker threads and write them, in order, to
+  // options.output_file
+  Error WriteToFile(lldb::SBTarget target,
+                    const Printer::PrinterOptions& options,
+                    const std::vector<uint64_t>& addresses);
+
   LLScan* llscan_;
   bool detailed_;
   cmd_pagination_t pagination_;
@@ -72,19 +90,54 @@ class NodeInfoCmd : public CommandBase {
   bool DoExecute(lldb::SBDebugger d, char** cmd,
                  lldb::SBCommandReturnObject& result) override;
 
+ private:
+  void WriteProcessJSON(v8::JSObject process_obj, JSONWriter* json);
+  void WriteStringsJSON(v8::JSArray array, JSONWriter* json);
+
+  LLScan* llscan_;
+};
+
+class DumpPerfMapCmd : public CommandBase {
+ public:
+  DumpPerfMapCmd(LLScan* llscan) : llscan_(llscan) {}
+  ~DumpPerfMapCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+
  private:
   LLScan* llscan_;
 };
 
+// Writes the scanned objects, and the references between them, as a
+// .heapsnapshot for Chrome DevTools. Nodes, edges and strings go to
+// temporary files next to the snapshot as they're decoded and are joined
+// once the counts the header needs are known.
+class HeapSnapshotCmd : public CommandBase {
+ public:
+  HeapSnapshotCmd(LLScan* llscan) : llscan_(llscan) {}
+  ~HeapSnapshotCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+
+ private:
+  class SnapshotBuilder;
+
+  LLScan* llscan_;
+};
+
 class ScanOptions {
  public:
   // Defines what are we looking for
   enum ScanType { kFieldValue, kPropertyName, kStringValue, kBadOption };
 
-  ScanOptions() : scan_type(ScanType::kFieldValue), recursive_scan(false) {}
+  ScanOptions()
+      : scan_type(ScanType::kFieldValue), recursive_scan(false), json(false) {}
 
   ScanType scan_type;
   bool recursive_scan;
+  bool json;
 };
 
 class FindReferencesCmd : public CommandBase {
@@ -99,8 +152,19 @@ class FindReferencesCmd : public CommandBase {
 
   class ObjectScanner {
    public:
+    ObjectScanner() : json_(nullptr) {}
     virtual ~ObjectScanner() {}
 
+    // References are written to `json` instead of the result when set
+    inline void set_json(JSONWriter* json) { json_ = json; }
+
+    // Objects whose properties couldn't all be decoded, references from
+    // them may be missing. Each object counts once, however many times it
+    // was walked.
+    inline uint64_t partial_objects() const {
+      return partial_objects_.size();
+    }
+
     virtual bool AreReferencesLoaded() { return false; };
 
     virtual ReferencesVector* GetReferences() { return nullptr; };
@@ -122,6 +186,25 @@ class FindReferencesCmd : public CommandBase {
 
     std::string GetPropertyReferenceString(int level = 0);
     std::string GetArrayReferenceString(int level = 0);
+
+   protected:
+    // Return false when not in JSON mode, the caller prints text instead.
+    // `str` is the referenced string's contents, for string searches.
+    bool WriteReference(uint64_t object, const std::string& type_name,
+                        const std::string& name, uint64_t value, int level,
+                        const std::string* str = nullptr);
+    bool WriteReference(uint64_t object, const std::string& type_name,
+                        int64_t index, uint64_t value, int level,
+                        const std::string* str = nullptr);
+
+    // Called once the properties of `js_obj` were walked, records the object
+    // and sets `err` if the walk stopped short.
+    void CheckProperties(v8::JSObject& js_obj,
+                         const v8::JSObject::OwnProperties& properties,
+                         Error& err);
+
+    JSONWriter* json_;
+    std::unordered_set<uint64_t> partial_objects_;
   };
 
   void PrintReferences(lldb::SBCommandReturnObject& result,
@@ -213,6 +296,8 @@ class FindReferencesCmd : public CommandBase {
 
  private:
   LLScan* llscan_;  // FindReferencesCmd::llscan_
+  // Set while a --json search is being printed
+  JSONWriter* json_ = nullptr;
 };
 
 class MemoryVisitor {
@@ -222,8 +307,6 @@ class MemoryVisitor {
   virtual uint64_t Visit(uint64_t location, uint64_t available) = 0;
 };
 
-class DetailedTypeRecord;
-
 class TypeRecord {
  public:
   TypeRecord(std::string& type_name)
@@ -232,16 +315,39 @@ class TypeRecord {
   inline std::string& GetTypeName() { return type_name_; };
   inline uint64_t GetInstanceCount() { return instance_count_; };
   inline uint64_t GetTotalInstanceSize() { return total_instance_size_; };
-  inline std::unordered_set<uint64_t>& GetInstances() { return instances_; };
+  // Sorted by address once the scan is finished
+  inline std::vector<uint64_t>& GetInstances() { return instances_; };
+
+  inline void AddInstance(uint64_t address, uint64_t size, uint32_t isolate) {
+    instances_.push_back(address);
+    instance_sizes_.push_back(static_cast<uint32_t>(size));
+    instance_isolates_.push_back(isolate);
+    instance_count_++;
+    total_instance_size_ += size;
+  };
 
-  inline void AddInstance(uint64_t address, uint64_t size) {
-    auto result = instances_.insert(address);
-    if (result.second) {
-      instance_count_++;
-      total_instance_size_ += size;
-    }
+  inline std::vector<uint32_t>& GetInstanceSizes() { return instance_sizes_; };
+  // Index into LLScan::GetIsolates() of each instance
+  inline std::vector<uint32_t>& GetInstanceIsolates() {
+    return instance_isolates_;
   };
 
+  // Sort the instances by address and drop duplicates, called after the
+  // heap scan.
+  void Finalize();
+
+  // Indices of the instances between `start` (inclusive) and `end`
+  // (exclusive) addresses. An `end` of 0 means no upper bound.
+  void GetAddressRange(uint64_t start, uint64_t end, size_t* first,
+                       size_t* last);
+
+  // Indices into GetInstances() from the largest instance to the smallest,
+  // ties are kept in address order.
+  std::vector<size_t>& GetSizeOrder();
+
+  // Drop the instances of every other isolate, for per-isolate copies
+  void KeepIsolate(uint32_t isolate);
+
   /* Sort records by instance count, use the other fields as tie breakers
    * to give consistent ordering.
    */
@@ -261,7 +367,10 @@ class TypeRecord {
   std::string type_name_;
   uint64_t instance_count_;
   uint64_t total_instance_size_;
-  std::unordered_set<uint64_t> instances_;
+  std::vector<uint64_t> instances_;
+  std::vector<uint32_t> instance_sizes_;
+  std::vector<uint32_t> instance_isolates_;
+  std::vector<size_t> size_order_;
 };
 
 class DetailedTypeRecord : public TypeRecord {
@@ -282,8 +391,15 @@ class DetailedTypeRecord : public TypeRecord {
   uint64_t indexed_properties_count_;
 };
 
-typedef std::map<std::string, TypeRecord*> TypeRecordMap;
-typedef std::map<std::string, DetailedTypeRecord*> DetailedTypeRecordMap;
+// A V8 heap found by the scan. Objects are attributed through the native
+// context of their map's meta map, and identified by the Environment of
+// that context, or the context itself without Node.js constants.
+struct IsolateRecord {
+  uint64_t environment = 0;
+  uint64_t native_context = 0;
+  uint64_t instance_count = 0;
+  uint64_t total_instance_size = 0;
+};
 
 class FindJSObjectsVisitor : MemoryVisitor {
  public:
@@ -294,6 +410,10 @@ class FindJSObjectsVisitor : MemoryVisitor {
 
   uint32_t FoundCount() { return found_count_; }
 
+  // Size of the words to visit: tagged values are half-width with pointer
+  // compression.
+  uint32_t word_size() { return word_size_; }
+
  private:
   // TODO (mmarchini): this could be an option for findjsobjects
   static const size_t kNumberOfPropertiesForDetailedOutput = 3;
@@ -302,8 +422,11 @@ class FindJSObjectsVisitor : MemoryVisitor {
     enum ShowArrayLength { kShowArrayLength, kDontShowArrayLength };
 
     std::string type_name;
+    int64_t type;
+    uint32_t isolate = 0;
     bool is_histogram;
     bool is_context;
+    bool is_string;
 
     std::vector<std::string> properties_;
     uint64_t own_descriptors_count_ = 0;
@@ -320,15 +443,16 @@ class FindJSObjectsVisitor : MemoryVisitor {
   static bool IsAHistogramType(v8::Map& map, Error& err);
 
   void InsertOnContexts(uint64_t word, Error& err);
-  void InsertOnMapsToInstances(uint64_t word, v8::Map map,
+  void InsertOnCodeMap(v8::HeapObject heap_object, int64_t type, Error& err);
+  void InsertOnMapsToInstances(uint64_t word, uint64_t size,
                                FindJSObjectsVisitor::MapCacheEntry map_info,
                                Error& err);
   void InsertOnDetailedMapsToInstances(
-      uint64_t word, v8::Map map, FindJSObjectsVisitor::MapCacheEntry map_info,
-      Error& err);
+      uint64_t word, uint64_t size,
+      FindJSObjectsVisitor::MapCacheEntry map_info, Error& err);
 
   lldb::SBTarget& target_;
-  uint32_t address_byte_size_;
+  uint32_t word_size_;
   uint32_t found_count_;
 
   LLScan* const llscan_;
@@ -338,7 +462,8 @@ class FindJSObjectsVisitor : MemoryVisitor {
 
 class LLScan {
  public:
-  LLScan(v8::LLV8* llv8) : llv8_(llv8) {}
+  LLScan(v8::LLV8* llv8, node::Node* node = nullptr)
+      : llv8_(llv8), node_(node) {}
 
   v8::LLV8* v8() { return llv8_; }
 
@@ -387,10 +512,16 @@ class LLScan {
   inline bool AreContextsLoaded() { return contexts_.size() > 0; };
   inline ContextVector* GetContexts() { return &contexts_; }
 
+  // Isolates, numbered from 1, index 0 holds objects that couldn't be
+  // attributed
+  inline std::vector<IsolateRecord>& GetIsolates() { return isolates_; }
+  uint32_t GetIsolateIndex(v8::Map map);
+
   v8::LLV8* llv8_;
 
  private:
   void ScanMemoryRegions(FindJSObjectsVisitor& v);
+  void CountIsolateInstances();
   void ClearMapsToInstances();
   void ClearReferences();
 
@@ -403,6 +534,10 @@ class LLScan {
   ReferencesByPropertyMap references_by_property_;
   ReferencesByStringMap references_by_string_;
   ContextVector contexts_;
+
+  node::Node* node_;
+  std::vector<IsolateRecord> isolates_;
+  std::unordered_map<uint64_t, uint32_t> isolate_by_meta_map_;
 };
 
 }  // namespace llnode
@@ -22,15 +22,18 @@ using lldb::SBSymbolContext;
 using lldb::SBSymbolContextList;
 using lldb::SBTarget;
 
-void Module::Assign(SBTarget target, Common* common) {
-  loaded_ = false;
-  target_ = target;
+void Module::Assign(SBTarget target, ConstantResolver* resolver,
+                    Common* common) {
+  Constants::Assign(target, resolver);
   common_ = common;
 }
 
 
 void Common::Load() {
-  kPointerSize = 1 << LoadConstant("PointerSizeLog2", "SystemPointerSizeLog2");
+  int64_t pointer_size_log2 =
+      LoadConstant("PointerSizeLog2", "SystemPointerSizeLog2");
+  kPointerSize = 1 << pointer_size_log2;
+  kTaggedSize = 1 << LoadConstant("TaggedSizeLog2", pointer_size_log2);
   kVersionMajor = LoadRawConstant("v8::internal::Version::major_");
   kVersionMinor = LoadRawConstant("v8::internal::Version::minor_");
   kVersionPatch = LoadRawConstant("v8::internal::Version::patch_");
@@ -143,7 +146,7 @@ void JSObject::Load() {
     common_->Load();
 
     // TODO(indutny): check V8 version?
-    kInternalFieldsOffset = kElementsOffset + common_->kPointerSize;
+    kInternalFieldsOffset = kElementsOffset + common_->kTaggedSize;
   }
 }
 
@@ -162,12 +165,14 @@ void JSFunction::Load() {
   kSharedInfoOffset =
       LoadConstant("class_JSFunction__shared__SharedFunctionInfo");
   kContextOffset = LoadConstant("class_JSFunction__context__Context");
+  kCodeOffset = LoadConstant("class_JSFunction__code__Code",
+                             "class_JSFunction__code__CodeT");
 
   if (kContextOffset == -1) {
     common_->Load();
 
     // TODO(indutny): check V8 version?
-    kContextOffset = kSharedInfoOffset + common_->kPointerSize;
+    kContextOffset = kSharedInfoOffset + common_->kTaggedSize;
   }
 }
 
@@ -313,6 +318,31 @@ void SlicedString::Load() {
   kOffsetOffset = LoadConstant({"class_SlicedString__offset__SMI"});
 }
 
+void ExternalString::Load() {
+  kResourceOffset = LoadConstant({"class_ExternalString__resource__Object",
+                                  "class_ExternalString__resource__Address"});
+  if (!kResourceOffset.Check()) {
+    // The resource is the first field after the String header, which is also
+    // where ConsString keeps its first half.
+    kResourceOffset = LoadConstant({"class_ConsString__first__String"});
+  }
+
+  // Cached external strings keep a copy of resource->data() right after the
+  // resource pointer, so we can read the characters without having to call
+  // into the (virtual) resource.
+  if (kResourceOffset.Check()) {
+    common_->Load();
+    kResourceDataOffset = LoadOptionalConstant(
+        {"class_ExternalString__resource_data__Address",
+         "class_ExternalString__resource_data__uintptr_t"},
+        *kResourceOffset + common_->kPointerSize);
+  }
+
+  kUncachedExternalStringMask = LoadConstant(
+      "UncachedExternalStringMask", "ShortExternalStringMask", 1 << 4);
+}
+
+
 void ThinString::Load() {
   kActualOffset = LoadConstant({"class_ThinString__actual__String"});
 }
@@ -523,7 +553,7 @@ void Symbol::Load() {
   if (maybe_name_offset.Check()) {
     int name_offset = *maybe_name_offset;
 
-    name_offset += common_->kPointerSize;
+    name_offset += common_->kTaggedSize;
     // class Name extends HeapObject and has only one uint32 field
     name_offset += sizeof(uint32_t);
     // class Symbol extends Name and has one int32 field before name
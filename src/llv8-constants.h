@@ -15,7 +15,8 @@ class Common;
 
 class Module : public Constants {
  public:
-  void Assign(lldb::SBTarget target, Common* common = nullptr);
+  void Assign(lldb::SBTarget target, ConstantResolver* resolver,
+              Common* common = nullptr);
 
   inline std::string constant_prefix() override { return "v8dbg_"; }
 
@@ -28,10 +29,15 @@ class Common : public Module {
   CONSTANTS_DEFAULT_METHODS(Common);
 
   int64_t kPointerSize;
+  // Size of tagged fields on the heap, which is smaller than kPointerSize
+  // when V8 is built with pointer compression.
+  int64_t kTaggedSize;
   int64_t kVersionMajor;
   int64_t kVersionMinor;
   int64_t kVersionPatch;
 
+  inline bool PointerCompression() const { return kTaggedSize < kPointerSize; }
+
   bool CheckLowestVersion(int64_t major, int64_t minor, int64_t patch);
   bool CheckHighestVersion(int64_t major, int64_t minor, int64_t patch);
 
@@ -126,6 +132,7 @@ class JSFunction : public Module {
 
   int64_t kSharedInfoOffset;
   int64_t kContextOffset;
+  int64_t kCodeOffset;
 
  protected:
   void Load();
@@ -312,6 +319,18 @@ class SlicedString : public Module {
   void Load();
 };
 
+class ExternalString : public Module {
+ public:
+  CONSTANTS_DEFAULT_METHODS(ExternalString);
+
+  Constant<int64_t> kResourceOffset;
+  Constant<int64_t> kResourceDataOffset;
+  int64_t kUncachedExternalStringMask;
+
+ protected:
+  void Load();
+};
+
 class ThinString : public Module {
  public:
   CONSTANTS_DEFAULT_METHODS(ThinString);
@@ -21,6 +21,11 @@ inline std::string CheckedType<T>::ToString(const char* fmt) {
 
 template <class T>
 inline CheckedType<T> LLV8::LoadUnsigned(int64_t addr, uint32_t byte_size) {
+  ReadCache* cache = ReadCache::Current(this);
+  uint64_t cached;
+  if (cache != nullptr && cache->ReadUnsigned(addr, byte_size, &cached))
+    return CheckedType<T>(cached);
+
   SBError sberr;
   int64_t value = process_.ReadUnsignedFromMemory(static_cast<addr_t>(addr),
                                                   byte_size, sberr);
@@ -50,6 +55,17 @@ inline CheckedType<int32_t> LLV8::LoadValue<CheckedType<int32_t>>(
   return LoadUnsigned<int32_t>(addr, 4);
 }
 
+// Compressed Smis are sign-extended, while compressed heap object pointers
+// are offsets from the base of the 4GB-aligned pointer cage. Until the
+// isolate's cage is known, the cage holding the field is used instead.
+inline int64_t LLV8::DecompressTagged(int64_t addr, int64_t value) {
+  if ((value & smi()->kTagMask) == smi()->kTag)
+    return static_cast<int32_t>(value);
+  int64_t base = CageBase();
+  if (base == 0) base = addr & ~static_cast<int64_t>(0xffffffff);
+  return base | (value & 0xffffffff);
+}
+
 template <class T>
 inline T LLV8::LoadValue(int64_t addr, Error& err) {
   int64_t ptr;
@@ -73,6 +89,22 @@ inline T LLV8::LoadValue(int64_t addr, Error& err) {
   return res;
 }
 
+template <class T>
+inline T LLV8::LoadTaggedValue(int64_t addr, Error& err) {
+  if (!common()->PointerCompression()) return LoadValue<T>(addr, err);
+
+  int64_t ptr = LoadTagged(addr, err);
+  if (err.Fail()) return T();
+
+  T res = T(this, ptr);
+  if (!res.Check()) {
+    err = Error(true, "The value %lx is not a valid value", addr);
+    return T();
+  }
+
+  return res;
+}
+
 
 inline bool Smi::Check() const {
   return valid_ && (raw() & v8()->smi()->kTagMask) == v8()->smi()->kTag;
@@ -100,6 +132,11 @@ int64_t HeapObject::LeaField(int64_t off) const {
 
 
 inline int64_t HeapObject::LoadField(int64_t off, Error& err) {
+  return v8()->LoadTagged(LeaField(off), err);
+}
+
+
+inline int64_t HeapObject::LoadRawField(int64_t off, Error& err) {
   return v8()->LoadPtr(LeaField(off), err);
 }
 
@@ -125,7 +162,7 @@ inline double HeapObject::LoadFieldValue<double>(int64_t off, Error& err) {
 
 template <class T>
 inline T HeapObject::LoadFieldValue(int64_t off, Error& err) {
-  T res = v8()->LoadValue<T>(LeaField(off), err);
+  T res = v8()->LoadTaggedValue<T>(LeaField(off), err);
   if (err.Fail()) return T();
   if (!res.Check()) {
     err = Error::Failure("Invalid field value %s at 0x%016" PRIx64,
@@ -327,7 +364,7 @@ inline int64_t Map::InObjectProperties(Error& err) {
     return 0;
   }
   if (v8()->map()->kInObjectPropertiesOffset != -1) {
-    return LoadField(v8()->map()->kInObjectPropertiesOffset, err) & 0xff;
+    return LoadRawField(v8()->map()->kInObjectPropertiesOffset, err) & 0xff;
   } else {
     // NOTE(mmarchini): V8 6.4 changed semantics for
     // in_objects_properties_offset (see
@@ -336,7 +373,7 @@ inline int64_t Map::InObjectProperties(Error& err) {
     // same implementation from
     // https://chromium-review.googlesource.com/c/v8/v8/+/776720/9/src/objects-inl.h#3027.
     int64_t in_object_properties_start_offset =
-        LoadField(v8()->map()->kInObjectPropertiesStartOffset, err) & 0xff;
+        LoadRawField(v8()->map()->kInObjectPropertiesStartOffset, err) & 0xff;
     int64_t instance_size =
         v8()->LoadUnsigned(LeaField(v8()->map()->kInstanceSizeOffset), 1, err);
     return instance_size - in_object_properties_start_offset;
@@ -345,16 +382,16 @@ inline int64_t Map::InObjectProperties(Error& err) {
 
 inline int64_t Map::ConstructorFunctionIndex(Error& err) {
   if (v8()->map()->kInObjectPropertiesOffset != -1) {
-    return LoadField(v8()->map()->kInObjectPropertiesOffset, err) & 0xff;
+    return LoadRawField(v8()->map()->kInObjectPropertiesOffset, err) & 0xff;
   } else {
-    return LoadField(v8()->map()->kInObjectPropertiesStartOffset, err) & 0xff;
+    return LoadRawField(v8()->map()->kInObjectPropertiesStartOffset, err) & 0xff;
   }
 }
 
 inline int64_t Map::InstanceSize(Error& err) {
   return v8()->LoadUnsigned(LeaField(v8()->map()->kInstanceSizeOffset), 1,
                             err) *
-         v8()->common()->kPointerSize;
+         v8()->common()->kTaggedSize;
 }
 
 ACCESSOR(JSObject, Properties, js_object()->kPropertiesOffset, HeapObject)
@@ -393,7 +430,7 @@ inline std::string JSObject::GetName(Error& err) {
 
 template <class T>
 inline T JSObject::GetInObjectValue(int64_t size, int index, Error& err) {
-  return LoadFieldValue<T>(size + index * v8()->common()->kPointerSize, err);
+  return LoadFieldValue<T>(size + index * v8()->common()->kTaggedSize, err);
 }
 
 inline HeapNumber JSObject::GetDoubleField(int64_t index, Error err) {
@@ -554,7 +591,7 @@ String SharedFunctionInfo::Name(Error& err) {
 inline int64_t Code::Start() { return LeaField(v8()->code()->kStartOffset); }
 
 inline int64_t Code::Size(Error& err) {
-  return LoadField(v8()->code()->kSizeOffset, err) & 0xffffffff;
+  return LoadRawField(v8()->code()->kSizeOffset, err) & 0xffffffff;
 }
 
 ACCESSOR(Oddball, Kind, oddball()->kKindOffset, Smi)
@@ -696,13 +733,13 @@ inline CheckedType<uintptr_t> JSTypedArray::GetData() {
 inline ScopeInfo::PositionInfo ScopeInfo::MaybePositionInfo(Error& err) {
   ScopeInfo::PositionInfo position_info = {
       .start_position = 0, .end_position = 0, .is_valid = false};
-  auto kPointerSize = v8()->common()->kPointerSize;
-  int bytes_offset = kPointerSize * ContextLocalIndex(err);
+  auto kTaggedSize = v8()->common()->kTaggedSize;
+  int bytes_offset = kTaggedSize * ContextLocalIndex(err);
   if (err.Fail()) return position_info;
 
   Smi context_local_count = ContextLocalCount(err);
   if (err.Fail()) return position_info;
-  bytes_offset += 2 * kPointerSize * context_local_count.GetValue();
+  bytes_offset += 2 * kTaggedSize * context_local_count.GetValue();
 
   int64_t data_offset =
       v8()->scope_info()->kIsFixedArray ? v8()->fixed_array()->kDataOffset : 0;
@@ -715,7 +752,7 @@ inline ScopeInfo::PositionInfo ScopeInfo::MaybePositionInfo(Error& err) {
     Smi maybe_start_position =
         HeapObject::LoadFieldValue<Smi>(bytes_offset, err);
     if (err.Success() && maybe_start_position.IsSmi(err)) {
-      bytes_offset += kPointerSize;
+      bytes_offset += kTaggedSize;
       Smi maybe_end_position =
           HeapObject::LoadFieldValue<Smi>(bytes_offset, err);
       if (err.Success() && maybe_end_position.IsSmi(err)) {
@@ -727,14 +764,14 @@ inline ScopeInfo::PositionInfo ScopeInfo::MaybePositionInfo(Error& err) {
     }
 
     tries--;
-    bytes_offset += kPointerSize;
+    bytes_offset += kTaggedSize;
   }
   return position_info;
 }
 
 // TODO(indutny): this field is a Smi on 32bit
 inline int64_t SharedFunctionInfo::ParameterCount(Error& err) {
-  int64_t field = LoadField(v8()->shared_info()->kParameterCountOffset, err);
+  int64_t field = LoadRawField(v8()->shared_info()->kParameterCountOffset, err);
   if (err.Fail()) return -1;
 
   field &= 0xffff;
@@ -762,7 +799,7 @@ inline int64_t SharedFunctionInfo::StartPosition(Error& err) {
     return uncompiled_data.start_position(err);
   }
 
-  int64_t field = LoadField(v8()->shared_info()->kStartPositionOffset, err);
+  int64_t field = LoadRawField(v8()->shared_info()->kStartPositionOffset, err);
   if (err.Fail()) return -1;
 
   field &= 0xffffffff;
@@ -794,7 +831,7 @@ inline int64_t SharedFunctionInfo::EndPosition(Error& err) {
     return uncompiled_data.end_position(err);
   }
 
-  int64_t field = LoadField(v8()->shared_info()->kEndPositionOffset, err);
+  int64_t field = LoadRawField(v8()->shared_info()->kEndPositionOffset, err);
   if (err.Fail()) return -1;
 
   field &= 0xffffffff;
@@ -806,6 +843,15 @@ ACCESSOR(JSFunction, Info, js_function()->kSharedInfoOffset,
          SharedFunctionInfo);
 ACCESSOR(JSFunction, GetContext, js_function()->kContextOffset, HeapObject);
 
+inline Code JSFunction::GetCode(Error& err) {
+  if (!Check()) return Code();
+  if (v8()->js_function()->kCodeOffset == -1) {
+    err = Error::Failure("JSFunction code offset not available");
+    return Code();
+  }
+  return LoadFieldValue<Code>(v8()->js_function()->kCodeOffset, err);
+}
+
 SAFE_ACCESSOR(ConsString, First, cons_string()->kFirstOffset, String);
 SAFE_ACCESSOR(ConsString, Second, cons_string()->kSecondOffset, String);
 
@@ -860,15 +906,6 @@ inline std::string SlicedString::ToString(Error& err) {
   if (err.Fail()) return std::string();
   RETURN_IF_INVALID(parent, std::string());
 
-  // TODO - Remove when we add support for external strings
-  // We can't use the offset and length safely if we get "(external)"
-  // instead of the original parent string.
-  CheckedType<int64_t> repr = parent.Representation(err);
-  RETURN_IF_INVALID(repr, std::string());
-  if (*repr == v8()->string()->kExternalStringTag) {
-    return parent.ToString(err);
-  }
-
   Smi offset = Offset(err);
   if (err.Fail()) return std::string();
   RETURN_IF_INVALID(offset, std::string());
@@ -876,20 +913,37 @@ inline std::string SlicedString::ToString(Error& err) {
   CheckedType<int32_t> length = Length(err);
   RETURN_IF_INVALID(length, std::string());
 
-  std::string tmp = parent.ToString(err);
-  if (err.Fail()) return std::string();
+  CheckedType<int32_t> parent_length = parent.Length(err);
+  RETURN_IF_INVALID(parent_length, std::string());
 
   int64_t off = offset.GetValue();
-  int64_t tmp_size = tmp.size();
-  if (off > tmp_size || *length > tmp_size || *length < 0 || off < 0) {
+  if (off > *parent_length || *length > *parent_length - off || *length < 0 ||
+      off < 0) {
     err = Error::Failure("Failed to display sliced string 0x%016" PRIx64
                          " (offset = 0x%016" PRIx64
                          ", length = %d) from parent string 0x%016" PRIx64
-                         " (length = 0x%016" PRIx64 ")",
-                         raw(), off, *length, parent.raw(), tmp_size);
+                         " (length = %d)",
+                         raw(), off, *length, parent.raw(), *parent_length);
     return std::string(err.GetMessage());
   }
-  return tmp.substr(offset.GetValue(), *length);
+
+  // Offset and length are in code units, so slice the parent's characters
+  // before decoding them rather than the decoded UTF-8 string.
+  CheckedType<int64_t> chars = parent.FlatChars(err);
+  if (err.Fail()) return std::string();
+  if (!chars.Check()) {
+    err = Error::Failure("Sliced string 0x%016" PRIx64
+                         " has a non-flat parent 0x%016" PRIx64,
+                         raw(), parent.raw());
+    return std::string();
+  }
+
+  int64_t encoding = parent.Encoding(err);
+  if (err.Fail()) return std::string();
+
+  if (encoding == v8()->string()->kTwoByteStringTag)
+    return v8()->LoadTwoByteString(*chars + off * 2, *length, err);
+  return v8()->LoadString(*chars + off, *length, err);
 }
 
 inline std::string ThinString::ToString(Error& err) {
@@ -902,6 +956,44 @@ inline std::string ThinString::ToString(Error& err) {
   return tmp;
 }
 
+inline CheckedType<int64_t> ExternalString::ResourceData(Error& err) {
+  RETURN_IF_THIS_INVALID(CheckedType<int64_t>());
+
+  int64_t type = GetType(err);
+  if (err.Fail()) return CheckedType<int64_t>();
+
+  // Uncached external strings don't keep resource->data() around, and we
+  // can't call into the resource from a core dump.
+  if (type & v8()->external_string()->kUncachedExternalStringMask)
+    return CheckedType<int64_t>();
+
+  CheckedType<int64_t> data =
+      LoadCheckedField<int64_t>(v8()->external_string()->kResourceDataOffset);
+  RETURN_IF_INVALID(data, CheckedType<int64_t>());
+  if (*data == 0) return CheckedType<int64_t>();
+  return data;
+}
+
+inline std::string ExternalString::ToString(Error& err) {
+  CheckedType<int64_t> data = ResourceData(err);
+  if (err.Fail()) return std::string();
+  if (!data.Check()) {
+    err = Error::Failure(
+        "Can't load data of uncached external string 0x%016" PRIx64, raw());
+    return std::string();
+  }
+
+  CheckedType<int32_t> len = Length(err);
+  RETURN_IF_INVALID(len, std::string());
+
+  int64_t encoding = Encoding(err);
+  if (err.Fail()) return std::string();
+
+  if (encoding == v8()->string()->kTwoByteStringTag)
+    return v8()->LoadTwoByteString(*data, *len, err);
+  return v8()->LoadString(*data, *len, err);
+}
+
 inline int64_t FixedArray::LeaData() const {
   return LeaField(v8()->fixed_array()->kDataOffset);
 }
@@ -909,7 +1001,7 @@ inline int64_t FixedArray::LeaData() const {
 template <class T>
 inline T FixedArray::Get(int index, Error& err) {
   int64_t off =
-      v8()->fixed_array()->kDataOffset + index * v8()->common()->kPointerSize;
+      v8()->fixed_array()->kDataOffset + index * v8()->common()->kTaggedSize;
   return LoadFieldValue<T>(off, err);
 }
 
@@ -924,9 +1016,9 @@ inline T DescriptorArray::Get(int index, int64_t offset) {
     return FixedArray::Get<T>(
         *(v8()->descriptor_array()->kFirstIndex) + index + offset, err);
   } else if (v8()->descriptor_array()->kHeaderSize.Check()) {
-    index *= v8()->common()->kPointerSize;
+    index *= v8()->common()->kTaggedSize;
     index += *(v8()->descriptor_array()->kHeaderSize);
-    index += (v8()->common()->kPointerSize * offset);
+    index += (v8()->common()->kTaggedSize * offset);
     return LoadFieldValue<T>(index, err);
   } else {
     PRINT_DEBUG(
@@ -1076,17 +1168,17 @@ inline Smi ScopeInfo::ParameterCount(Error& err) {
       v8()->scope_info()->kIsFixedArray ? v8()->fixed_array()->kDataOffset : 0;
   return HeapObject::LoadFieldValue<Smi>(
       data_offset + v8()->scope_info()->kParameterCountOffset *
-                        v8()->common()->kPointerSize,
+                        v8()->common()->kTaggedSize,
       err);
 }
 
 inline Smi ScopeInfo::ContextLocalCount(Error& err) {
   int64_t data_offset = v8()->scope_info()->kIsFixedArray
                             ? v8()->fixed_array()->kDataOffset
-                            : v8()->common()->kPointerSize;
+                            : v8()->common()->kTaggedSize;
   return HeapObject::LoadFieldValue<Smi>(
       data_offset + v8()->scope_info()->kContextLocalCountOffset *
-                        v8()->common()->kPointerSize,
+                        v8()->common()->kTaggedSize,
       err);
 }
 
@@ -1098,9 +1190,9 @@ inline int ScopeInfo::ContextLocalIndex(Error& err) {
 inline String ScopeInfo::ContextLocalName(int index, Error& err) {
   int64_t data_offset = v8()->scope_info()->kIsFixedArray
                             ? v8()->fixed_array()->kDataOffset
-                            : v8()->common()->kPointerSize;
+                            : v8()->common()->kTaggedSize;
   int proper_index = data_offset + (ContextLocalIndex(err) + index) *
-                                       v8()->common()->kPointerSize;
+                                       v8()->common()->kTaggedSize;
   if (err.Fail()) return String();
   return HeapObject::LoadFieldValue<String>(proper_index, err);
 }
@@ -1110,14 +1202,14 @@ inline HeapObject ScopeInfo::MaybeFunctionName(Error& err) {
   // third slot after ContextLocalCount. Since there are missing postmortem
   // metadata to determine in which slot its being stored for the present
   // ScopeInfo, we try to find it heuristically.
-  auto kPointerSize = v8()->common()->kPointerSize;
+  auto kTaggedSize = v8()->common()->kTaggedSize;
   HeapObject likely_function_name;
-  int bytes_offset = kPointerSize * ContextLocalIndex(err);
+  int bytes_offset = kTaggedSize * ContextLocalIndex(err);
   if (err.Fail()) return likely_function_name;
 
   Smi context_local_count = ContextLocalCount(err);
   if (err.Fail()) return likely_function_name;
-  bytes_offset += 2 * kPointerSize * context_local_count.GetValue();
+  bytes_offset += 2 * kTaggedSize * context_local_count.GetValue();
 
   int64_t data_offset =
       v8()->scope_info()->kIsFixedArray ? v8()->fixed_array()->kDataOffset : 0;
@@ -1137,7 +1229,7 @@ inline HeapObject ScopeInfo::MaybeFunctionName(Error& err) {
     }
 
     tries--;
-    bytes_offset += kPointerSize;
+    bytes_offset += kTaggedSize;
   }
 
   if (likely_function_name.Check()) {
@@ -1,11 +1,18 @@
 #include <assert.h>
+#include <string.h>
 
 #include <algorithm>
 #include <cinttypes>
 #include <cstdarg>
+#include <cstdlib>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif  // defined(__SSE2__)
 
 #include "deps/rang/include/rang.hpp"
 #include "llv8-inl.h"
@@ -21,52 +28,322 @@ using lldb::SBTarget;
 
 static std::string kConstantPrefix = "v8dbg_";
 
+#define V8_CONSTANTS_MODULES(V) \
+  V(smi)                        \
+  V(heap_obj)                   \
+  V(map)                        \
+  V(js_object)                  \
+  V(heap_number)                \
+  V(js_array)                   \
+  V(js_function)                \
+  V(shared_info)                \
+  V(uncompiled_data)            \
+  V(code)                       \
+  V(scope_info)                 \
+  V(context)                    \
+  V(script)                     \
+  V(string)                     \
+  V(one_byte_string)            \
+  V(two_byte_string)            \
+  V(cons_string)                \
+  V(sliced_string)              \
+  V(thin_string)                \
+  V(external_string)            \
+  V(fixed_array_base)           \
+  V(fixed_array)                \
+  V(fixed_typed_array_base)     \
+  V(js_typed_array)             \
+  V(oddball)                    \
+  V(js_array_buffer)            \
+  V(js_array_buffer_view)       \
+  V(js_regexp)                  \
+  V(js_date)                    \
+  V(descriptor_array)           \
+  V(name_dictionary)            \
+  V(frame)                      \
+  V(symbol)                     \
+  V(types)
+
 void LLV8::Load(SBTarget target) {
   // Reload process anyway
   process_ = target.GetProcess();
 
+  // Sources may have changed if the process ran since the last command
+  uint32_t stop_id = process_.GetStopID();
+  if (target_ != target || stop_id != stop_id_) {
+    script_cache_.Clear();
+    cage_base_loaded_ = false;
+    stop_id_ = stop_id;
+  }
+
+  // Persist the constants resolved lazily since the last command
+  if (resolver_.cache_dirty()) resolver_.SaveCache();
+
   // No need to reload
-  if (target_ == target) return;
+  if (target_ == target && generation_ == resolver_.generation()) return;
+
+  if (target_ != target) {
+    resolver_.Assign(target);
+    code_map_.Assign(target);
+
+    // Layout profiles to use for constants missing from the binary
+    const char* profiles = getenv("LLNODE_LAYOUT_PROFILES");
+    if (profiles != nullptr && *profiles != '\0') {
+      Error err;
+      resolver_.LoadProfile(profiles, err);
+      if (err.Fail()) PRINT_DEBUG("%s", err.GetMessage());
+    }
+  }
+  target_ = target;
+  generation_ = resolver_.generation();
+
+  common.Assign(target, &resolver_);
+#define V(module) module.Assign(target, &resolver_, &common);
+  V8_CONSTANTS_MODULES(V)
+#undef V
+
+  // First time we see this binary, resolve everything so it gets cached.
+  // That's only attempted once per target, even if the cache can't be saved.
+  if (resolver_.needs_cache() && populated_target_ != target) {
+    populated_target_ = target;
+    LoadAllConstants();
+    resolver_.SaveCache();
+  }
+}
+
+
+void LLV8::LoadAllConstants() {
+  common();
+#define V(module) module();
+  V8_CONSTANTS_MODULES(V)
+#undef V
+}
+
+#undef V8_CONSTANTS_MODULES
+
+
+int64_t LLV8::CageBase() {
+  if (cage_base_loaded_) return cage_base_;
+
+  // Values decompressed while searching use the cage of their own field
+  cage_base_loaded_ = true;
+  cage_base_ = 0;
+  if (!common()->PointerCompression()) return 0;
+
+  // Builds with a shared cage keep its base in a static
+  const char* const statics[] = {
+      "v8::internal::MainCage::base_",
+      "v8::internal::V8HeapCompressionScheme::base_"};
+  for (const char* name : statics) {
+    Constant<int64_t> base = Constants::LookupConstant(target_, name);
+    if (base.Check() && *base != 0) {
+      cage_base_ = *base;
+      return cage_base_;
+    }
+  }
+
+  // Otherwise the isolate root is in the cage of the functions on the
+  // JavaScript frames, whose stack slots hold full pointers.
+  for (uint32_t t = 0; t < process_.GetNumThreads(); t++) {
+    lldb::SBThread thread = process_.GetThreadAtIndex(t);
+    for (uint32_t i = 0; i < thread.GetNumFrames(); i++) {
+      lldb::SBFrame frame = thread.GetFrameAtIndex(i);
+      if (frame.GetSymbol().IsValid()) continue;
+
+      Error err;
+      JSFrame js_frame(this, static_cast<int64_t>(frame.GetFP()));
+      JSFunction function = js_frame.GetFunction(err);
+      if (err.Fail()) continue;
+
+      cage_base_ = function.raw() & ~static_cast<int64_t>(0xffffffff);
+      return cage_base_;
+    }
+  }
+
+  PRINT_DEBUG("Couldn't find the pointer cage of the isolate");
+  return 0;
+}
+
+static thread_local ReadCache* current_read_cache = nullptr;
+
+ReadCache::ReadCache(LLV8* llv8)
+    : llv8_(llv8),
+      process_(llv8->process_),
+      big_endian_(process_.GetByteOrder() == lldb::eByteOrderBig),
+      pointer_size_(process_.GetAddressByteSize()),
+      pages_(kPages) {}
+
+
+ReadCache* ReadCache::Current(const LLV8* llv8) {
+  ReadCache* cache = current_read_cache;
+  return cache != nullptr && cache->llv8_ == llv8 ? cache : nullptr;
+}
+
+
+ReadCache::Scope::Scope(ReadCache* cache) : previous_(current_read_cache) {
+  current_read_cache = cache;
+}
+
+
+ReadCache::Scope::~Scope() { current_read_cache = previous_; }
+
+
+bool ReadCache::Read(uint64_t addr, void* buf, size_t size) {
+  uint8_t* out = static_cast<uint8_t*>(buf);
+  while (size > 0) {
+    uint64_t base = addr & ~static_cast<uint64_t>(kPageSize - 1);
+    Page& page = pages_[(base / kPageSize) % kPages];
+    if (page.base != base) {
+      // Pages at the edge of a mapping can't be read whole, leave those to
+      // the uncached path.
+      SBError sberr;
+      size_t read = process_.ReadMemory(base, page.data, kPageSize, sberr);
+      if (sberr.Fail() || read != kPageSize) {
+        page.base = UINT64_MAX;
+        return false;
+      }
+      page.base = base;
+    }
+
+    size_t offset = addr - base;
+    size_t chunk = std::min(size, kPageSize - offset);
+    memcpy(out, page.data + offset, chunk);
+    out += chunk;
+    addr += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+
+bool ReadCache::ReadUnsigned(uint64_t addr, uint32_t byte_size,
+                             uint64_t* value) {
+  uint8_t bytes[8];
+  if (byte_size > sizeof(bytes) || !Read(addr, bytes, byte_size))
+    return false;
+
+  uint64_t res = 0;
+  for (uint32_t i = 0; i < byte_size; i++) {
+    uint32_t index = big_endian_ ? i : byte_size - i - 1;
+    res = (res << 8) | bytes[index];
+  }
+  *value = res;
+  return true;
+}
+
 
+void CodeMap::Assign(lldb::SBTarget target) {
   target_ = target;
+  builtins_.clear();
+  code_.clear();
+  builtins_loaded_ = false;
+  code_sorted_ = true;
+}
+
+
+void CodeMap::AddCode(uint64_t start, uint64_t size, uint64_t function) {
+  if (size == 0) return;
+  code_.push_back({start, size, std::string(), function});
+  code_sorted_ = false;
+}
+
+
+static bool CompareEntries(const CodeMap::Entry& a, const CodeMap::Entry& b) {
+  // Entries with a function first, so they survive the dedupe
+  if (a.start != b.start) return a.start < b.start;
+  return a.function > b.function;
+}
+
+
+void CodeMap::LoadBuiltins() {
+  builtins_loaded_ = true;
+
+  static const char kPrefix[] = "Builtins_";
+  const size_t prefix_length = sizeof(kPrefix) - 1;
+  for (uint32_t i = 0; i < target_.GetNumModules(); i++) {
+    lldb::SBModule module = target_.GetModuleAtIndex(i);
+    size_t num_symbols = module.GetNumSymbols();
+    for (size_t j = 0; j < num_symbols; j++) {
+      lldb::SBSymbol symbol = module.GetSymbolAtIndex(j);
+      const char* name = symbol.GetName();
+      if (name == nullptr || strncmp(name, kPrefix, prefix_length) != 0)
+        continue;
+
+      uint64_t start = symbol.GetStartAddress().GetLoadAddress(target_);
+      uint64_t end = symbol.GetEndAddress().GetLoadAddress(target_);
+      if (start == LLDB_INVALID_ADDRESS || end <= start) continue;
+      builtins_.push_back(
+          {start, end - start, std::string(name + prefix_length), 0});
+    }
+  }
+
+  std::sort(builtins_.begin(), builtins_.end(), CompareEntries);
+}
+
+
+bool CodeMap::HasBuiltins() {
+  if (!builtins_loaded_) LoadBuiltins();
+  return !builtins_.empty();
+}
+
+
+const CodeMap::Entry* CodeMap::Find(const std::vector<Entry>& entries,
+                                    uint64_t pc) {
+  // Last entry starting at or before pc
+  auto it = std::upper_bound(
+      entries.begin(), entries.end(), pc,
+      [](uint64_t pc, const Entry& entry) { return pc < entry.start; });
+  if (it == entries.begin()) return nullptr;
+  --it;
+  return pc < it->start + it->size ? &*it : nullptr;
+}
+
+
+bool CodeMap::IsBuiltin(uint64_t pc) {
+  if (!builtins_loaded_) LoadBuiltins();
+  return Find(builtins_, pc) != nullptr;
+}
+
 
-  common.Assign(target);
-  smi.Assign(target, &common);
-  heap_obj.Assign(target, &common);
-  map.Assign(target, &common);
-  js_object.Assign(target, &common);
-  heap_number.Assign(target, &common);
-  js_array.Assign(target, &common);
-  js_function.Assign(target, &common);
-  shared_info.Assign(target, &common);
-  uncompiled_data.Assign(target, &common);
-  code.Assign(target, &common);
-  scope_info.Assign(target, &common);
-  context.Assign(target, &common);
-  script.Assign(target, &common);
-  string.Assign(target, &common);
-  one_byte_string.Assign(target, &common);
-  two_byte_string.Assign(target, &common);
-  cons_string.Assign(target, &common);
-  sliced_string.Assign(target, &common);
-  thin_string.Assign(target, &common);
-  fixed_array_base.Assign(target, &common);
-  fixed_array.Assign(target, &common);
-  fixed_typed_array_base.Assign(target, &common);
-  js_typed_array.Assign(target, &common);
-  oddball.Assign(target, &common);
-  js_array_buffer.Assign(target, &common);
-  js_array_buffer_view.Assign(target, &common);
-  js_regexp.Assign(target, &common);
-  js_date.Assign(target, &common);
-  descriptor_array.Assign(target, &common);
-  name_dictionary.Assign(target, &common);
-  frame.Assign(target, &common);
-  symbol.Assign(target, &common);
-  types.Assign(target, &common);
+void CodeMap::SortCode() {
+  if (code_sorted_) return;
+  std::sort(code_.begin(), code_.end(), CompareEntries);
+  code_.erase(std::unique(code_.begin(), code_.end(),
+                          [](const Entry& a, const Entry& b) {
+                            return a.start == b.start;
+                          }),
+              code_.end());
+  code_sorted_ = true;
 }
 
+
+const std::vector<CodeMap::Entry>& CodeMap::GetCode() {
+  SortCode();
+  return code_;
+}
+
+
+const CodeMap::Entry* CodeMap::Find(uint64_t pc) {
+  if (!builtins_loaded_) LoadBuiltins();
+  SortCode();
+
+  // Builtin trampolines on the heap point into the embedded blob, so the
+  // builtin names take precedence.
+  const Entry* entry = Find(builtins_, pc);
+  if (entry == nullptr) entry = Find(code_, pc);
+  return entry;
+}
+
+
 int64_t LLV8::LoadPtr(int64_t addr, Error& err) {
+  ReadCache* cache = ReadCache::Current(this);
+  uint64_t cached;
+  if (cache != nullptr &&
+      cache->ReadUnsigned(addr, cache->pointer_size(), &cached)) {
+    err = Error::Ok();
+    return cached;
+  }
+
   SBError sberr;
   int64_t value =
       process_.ReadPointerFromMemory(static_cast<addr_t>(addr), sberr);
@@ -81,7 +358,25 @@ int64_t LLV8::LoadPtr(int64_t addr, Error& err) {
   return value;
 }
 
+// Load a tagged field from the heap, decompressing it on builds with pointer
+// compression.
+int64_t LLV8::LoadTagged(int64_t addr, Error& err) {
+  if (!common()->PointerCompression()) return LoadPtr(addr, err);
+
+  int64_t value = LoadUnsigned(addr, common()->kTaggedSize, err);
+  if (err.Fail()) return -1;
+
+  return DecompressTagged(addr, value);
+}
+
 int64_t LLV8::LoadUnsigned(int64_t addr, uint32_t byte_size, Error& err) {
+  ReadCache* cache = ReadCache::Current(this);
+  uint64_t cached;
+  if (cache != nullptr && cache->ReadUnsigned(addr, byte_size, &cached)) {
+    err = Error::Ok();
+    return cached;
+  }
+
   SBError sberr;
   int64_t value = process_.ReadUnsignedFromMemory(static_cast<addr_t>(addr),
                                                   byte_size, sberr);
@@ -99,9 +394,15 @@ int64_t LLV8::LoadUnsigned(int64_t addr, uint32_t byte_size, Error& err) {
 
 
 double LLV8::LoadDouble(int64_t addr, Error& err) {
+  ReadCache* cache = ReadCache::Current(this);
+  uint64_t cached;
   SBError sberr;
-  int64_t value = process_.ReadUnsignedFromMemory(static_cast<addr_t>(addr),
-                                                  sizeof(double), sberr);
+  int64_t value;
+  if (cache != nullptr && cache->ReadUnsigned(addr, sizeof(double), &cached))
+    value = cached;
+  else
+    value = process_.ReadUnsignedFromMemory(static_cast<addr_t>(addr),
+                                            sizeof(double), sberr);
   if (sberr.Fail()) {
     err = Error::Failure(
         "Failed to load double from v8 memory, "
@@ -132,16 +433,62 @@ std::string LLV8::LoadBytes(int64_t addr, size_t length, Error& err) {
     return std::string();
   }
 
-  std::string res;
-  char tmp[10];
+  // Format as "xx, xx, ..." straight into a preallocated string, two
+  // nibble lookups per byte instead of a snprintf() call.
+  static const char kHexDigits[] = "0123456789abcdef";
+  std::string res(length == 0 ? 0 : length * 4 - 2, ' ');
+  char* out = &res[0];
   for (size_t i = 0; i < length; ++i) {
-    snprintf(tmp, sizeof(tmp), "%s%02x", (i == 0 ? "" : ", "), buf[i]);
-    res += tmp;
+    if (i != 0) {
+      *out++ = ',';
+      out++;
+    }
+    *out++ = kHexDigits[buf[i] >> 4];
+    *out++ = kHexDigits[buf[i] & 0xf];
   }
   delete[] buf;
   return res;
 }
 
+// Transcode `length` Latin-1 characters, which is what one byte strings
+// hold, into UTF-8 so they can be mixed with transcoded two byte strings.
+static void AppendLatin1AsUtf8(const uint8_t* chars, size_t length,
+                               std::string* out) {
+  size_t i = 0;
+  while (i < length) {
+#if defined(__SSE2__)
+    // ASCII fast path: copy sixteen characters at a time while none of them
+    // has the high bit set.
+    while (i + 16 <= length) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars + i));
+      if (_mm_movemask_epi8(chunk) != 0) break;
+      out->append(reinterpret_cast<const char*>(chars + i), 16);
+      i += 16;
+    }
+#endif  // defined(__SSE2__)
+    // Scalar path for the tail and everything that is not plain ASCII.
+    for (; i < length; i++) {
+      uint8_t c = chars[i];
+      if (c < 0x80) {
+        out->push_back(static_cast<char>(c));
+#if defined(__SSE2__)
+        // Go back to the vectorized loop if the next block may be ASCII.
+        if (i + 1 + 16 <= length && chars[i + 1] < 0x80) {
+          i++;
+          break;
+        }
+#endif  // defined(__SSE2__)
+        continue;
+      }
+
+      out->push_back(static_cast<char>(0xc0 | (c >> 6)));
+      out->push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    }
+  }
+}
+
+
 std::string LLV8::LoadString(int64_t addr, int64_t length, Error& err) {
   if (length < 0) {
     err = Error::Failure("Failed to load V8 one byte string - Invalid length");
@@ -150,8 +497,12 @@ std::string LLV8::LoadString(int64_t addr, int64_t length, Error& err) {
 
   char* buf = new char[length + 1];
   SBError sberr;
-  process_.ReadMemory(static_cast<addr_t>(addr), buf,
-                      static_cast<size_t>(length), sberr);
+  ReadCache* cache = ReadCache::Current(this);
+  if (cache == nullptr || static_cast<size_t>(length) > ReadCache::kPageSize ||
+      !cache->Read(addr, buf, static_cast<size_t>(length))) {
+    process_.ReadMemory(static_cast<addr_t>(addr), buf,
+                        static_cast<size_t>(length), sberr);
+  }
   if (sberr.Fail()) {
     err = Error::Failure(
         "Failed to load v8 one byte string memory, "
@@ -161,39 +512,110 @@ std::string LLV8::LoadString(int64_t addr, int64_t length, Error& err) {
     return std::string();
   }
 
-  buf[length] = '\0';
-
-  std::string res = buf;
+  // Characters after a NUL were never shown, keep it that way
+  size_t chars = strnlen(buf, static_cast<size_t>(length));
+  std::string res;
+  res.reserve(chars);
+  AppendLatin1AsUtf8(reinterpret_cast<const uint8_t*>(buf), chars, &res);
   delete[] buf;
   err = Error::Ok();
   return res;
 }
 
 
+// Transcode `length` UTF-16 code units into UTF-8. Unpaired surrogates are
+// replaced with U+FFFD, like V8's own String::WriteUtf8() does.
+static void AppendUtf16AsUtf8(const uint16_t* units, size_t length,
+                              std::string* out) {
+  size_t i = 0;
+  while (i < length) {
+#if defined(__SSE2__)
+    // ASCII fast path: narrow eight code units at a time while none of them
+    // has bits set above 0x7f.
+    const __m128i non_ascii = _mm_set1_epi16(static_cast<int16_t>(0xff80));
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 8 <= length) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(units + i));
+      __m128i high = _mm_and_si128(chunk, non_ascii);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xffff) break;
+      char narrow[16];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(narrow),
+                       _mm_packus_epi16(chunk, chunk));
+      out->append(narrow, 8);
+      i += 8;
+    }
+#endif  // defined(__SSE2__)
+    // Scalar path for the tail and everything that is not plain ASCII.
+    for (; i < length; i++) {
+      uint32_t c = units[i];
+      if (c < 0x80) {
+        out->push_back(static_cast<char>(c));
+#if defined(__SSE2__)
+        // Go back to the vectorized loop if the next block may be ASCII.
+        if (i + 1 + 8 <= length && units[i + 1] < 0x80) {
+          i++;
+          break;
+        }
+#endif  // defined(__SSE2__)
+        continue;
+      }
+
+      if (c >= 0xd800 && c <= 0xdfff) {
+        if (c <= 0xdbff && i + 1 < length && units[i + 1] >= 0xdc00 &&
+            units[i + 1] <= 0xdfff) {
+          c = 0x10000 + ((c - 0xd800) << 10) + (units[i + 1] - 0xdc00);
+          i++;
+        } else {
+          c = 0xfffd;
+        }
+      }
+
+      if (c < 0x800) {
+        out->push_back(static_cast<char>(0xc0 | (c >> 6)));
+      } else if (c < 0x10000) {
+        out->push_back(static_cast<char>(0xe0 | (c >> 12)));
+        out->push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+      } else {
+        out->push_back(static_cast<char>(0xf0 | (c >> 18)));
+        out->push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+        out->push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+      }
+      out->push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    }
+  }
+}
+
+
 std::string LLV8::LoadTwoByteString(int64_t addr, int64_t length, Error& err) {
   if (length < 0) {
     err = Error::Failure("Failed to load V8 two byte string - Invalid length");
     return std::string();
   }
 
-  char* buf = new char[length * 2 + 1];
+  std::vector<uint16_t> buf(static_cast<size_t>(length));
   SBError sberr;
-  process_.ReadMemory(static_cast<addr_t>(addr), buf,
-                      static_cast<size_t>(length * 2), sberr);
+  ReadCache* cache = ReadCache::Current(this);
+  if (length > 0 &&
+      (cache == nullptr ||
+       static_cast<size_t>(length * 2) > ReadCache::kPageSize ||
+       !cache->Read(addr, buf.data(), static_cast<size_t>(length * 2)))) {
+    process_.ReadMemory(static_cast<addr_t>(addr), buf.data(),
+                        static_cast<size_t>(length * 2), sberr);
+  }
   if (sberr.Fail()) {
     err = Error::Failure(
         "Failed to load V8 two byte string memory, "
         "addr=0x%016" PRIx64 ", length=%" PRId64,
         addr, length);
-    delete[] buf;
     return std::string();
   }
 
-  for (int64_t i = 0; i < length; i++) buf[i] = buf[i * 2];
-  buf[length] = '\0';
-
-  std::string res = buf;
-  delete[] buf;
+  std::string res;
+  // Most strings in practice are either ASCII or BMP text, so reserve for
+  // the common case and let the string grow for the rest.
+  res.reserve(static_cast<size_t>(length));
+  AppendUtf16AsUtf8(buf.data(), buf.size(), &res);
   err = Error::Ok();
   return res;
 }
@@ -430,6 +852,29 @@ std::string SharedFunctionInfo::GetPostfix(Error& err) {
   return res + tmp;
 }
 
+bool SharedFunctionInfo::GetLocation(std::string& script_name, int64_t& line,
+                                     int64_t& column, Error& err) {
+  RETURN_IF_THIS_INVALID(false);
+
+  Script script = GetScript(err);
+  if (err.Fail() || !script.Check()) return false;
+
+  int64_t type = script.GetType(err);
+  if (err.Fail() || type != v8()->types()->kScriptType) return false;
+
+  String name = script.Name(err);
+  if (err.Fail()) return false;
+
+  int64_t start_pos = StartPosition(err);
+  if (err.Fail()) return false;
+
+  script_name = name.ToString(err);
+  if (err.Fail()) return false;
+
+  script.GetLineColumnFromPos(start_pos, line, column, err);
+  return err.Success();
+}
+
 std::string SharedFunctionInfo::ToString(Error& err) {
   std::string res = ProperName(err);
   if (err.Fail()) return std::string();
@@ -438,50 +883,141 @@ std::string SharedFunctionInfo::ToString(Error& err) {
 }
 
 
-// return end_char+1, which may be less than line_limit if source
-// ends before end_inclusive
-void Script::GetLines(uint64_t start_line, std::string lines[],
-                      uint64_t line_limit, uint32_t& lines_found, Error& err) {
-  lines_found = 0;
+std::shared_ptr<const ScriptCache::Entry> ScriptCache::Get(uint64_t script) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(script);
+  if (it == entries_.end()) return nullptr;
+  return it->second;
+}
+
+
+void ScriptCache::Insert(uint64_t script,
+                         std::shared_ptr<const Entry> entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_[script] = entry;
+}
+
+
+void ScriptCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+}
+
+
+// \r\n, \n and \r all end a line, \r\n is recorded at the \n
+static void FindLineEnds(const std::string& source,
+                         std::vector<size_t>& line_ends) {
+  const char* data = source.data();
+  size_t length = source.length();
+
+  // memchr is vectorized, most sources never need the slow loop
+  if (memchr(data, '\r', length) == nullptr) {
+    const char* p = data;
+    while ((p = static_cast<const char*>(
+                memchr(p, '\n', data + length - p))) != nullptr) {
+      line_ends.push_back(p - data);
+      p++;
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] == '\r' && i + 1 < length && data[i + 1] == '\n') i++;
+    if (data[i] == '\n' || data[i] == '\r') line_ends.push_back(i);
+  }
+}
+
+
+std::shared_ptr<const ScriptCache::Entry> Script::GetCachedSource(
+    Error& err) {
+  ScriptCache* cache = &v8()->script_cache_;
+  std::shared_ptr<const ScriptCache::Entry> cached = cache->Get(raw());
+  if (cached != nullptr) return cached;
 
   HeapObject source = Source(err);
-  if (err.Fail()) return;
+  if (err.Fail()) return nullptr;
 
   int64_t type = source.GetType(err);
-  if (err.Fail()) return;
+  if (err.Fail()) return nullptr;
 
   // No source
   if (type > v8()->types()->kFirstNonstringType) {
     err = Error::Failure("No source, source_type=%" PRId64, type);
-    return;
+    return nullptr;
   }
 
+  std::shared_ptr<ScriptCache::Entry> entry(new ScriptCache::Entry());
   String str(source);
-  std::string source_str = str.ToString(err);
-  uint64_t limit = source_str.length();
-
-  uint64_t length = 0;
-  uint64_t line_i = 0;
-  uint64_t i = 0;
-  for (; i < limit && lines_found < line_limit; i++) {
-    // \r\n should ski adding a line and column on \r
-    if (source_str[i] == '\r' && i < limit - 1 && source_str[i + 1] == '\n') {
-      i++;
-    }
-    if (source_str[i] == '\n' || source_str[i] == '\r') {
-      if (line_i >= start_line) {
-        lines[lines_found] = std::string(source_str, i - length, length);
-        lines_found++;
-      }
-      line_i++;
-      length = 0;
-    } else {
-      length++;
-    }
-  }
-  if (line_i >= start_line && length != 0 && lines_found < line_limit) {
-    lines[lines_found] = std::string(source_str, limit - length, length);
-    lines_found++;
+  entry->source = str.ToString(err);
+  if (err.Fail()) return nullptr;
+  FindLineEnds(entry->source, entry->line_ends);
+
+  cache->Insert(raw(), entry);
+  return entry;
+}
+
+
+bool Script::FindLineInLineEnds(int64_t pos, int64_t& line,
+                                int64_t& line_start, Error& err) {
+  if (v8()->script()->kLineEndsOffset == -1) return false;
+
+  HeapObject line_ends_obj = LineEnds(err);
+  if (err.Fail() || !line_ends_obj.Check()) return false;
+
+  int64_t type = line_ends_obj.GetType(err);
+  if (err.Fail() || type != v8()->types()->kFixedArrayType) return false;
+
+  FixedArray line_ends(line_ends_obj);
+  Smi length_smi = line_ends.Length(err);
+  if (err.Fail()) return false;
+  int64_t length = length_smi.GetValue();
+  if (length <= 0) return false;
+
+  // First line end at or after pos, read straight from the array
+  int64_t low = 0;
+  int64_t high = length;
+  while (low < high) {
+    int64_t mid = low + (high - low) / 2;
+    Smi end = line_ends.Get<Smi>(mid, err);
+    if (err.Fail()) return false;
+    if (end.GetValue() < pos)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  line = low;
+  line_start = 0;
+  if (low > 0) {
+    Smi end = line_ends.Get<Smi>(low - 1, err);
+    if (err.Fail()) return false;
+    line_start = end.GetValue() + 1;
+  }
+  return true;
+}
+
+
+// return end_char+1, which may be less than line_limit if source
+// ends before end_inclusive
+void Script::GetLines(uint64_t start_line, std::string lines[],
+                      uint64_t line_limit, uint32_t& lines_found, Error& err) {
+  lines_found = 0;
+
+  std::shared_ptr<const ScriptCache::Entry> entry = GetCachedSource(err);
+  if (err.Fail()) return;
+
+  const std::string& source = entry->source;
+  const std::vector<size_t>& line_ends = entry->line_ends;
+  for (uint64_t line = start_line;
+       line <= line_ends.size() && lines_found < line_limit; line++) {
+    size_t start = line == 0 ? 0 : line_ends[line - 1] + 1;
+    size_t end = line < line_ends.size() ? line_ends[line] : source.length();
+
+    // A break at the very end doesn't start another line
+    if (line == line_ends.size() && start == end) break;
+
+    if (end > start && source[end] == '\n' && source[end - 1] == '\r') end--;
+    lines[lines_found++] = source.substr(start, end - start);
   }
 }
 
@@ -491,32 +1027,22 @@ void Script::GetLineColumnFromPos(int64_t pos, int64_t& line, int64_t& column,
   line = 0;
   column = 0;
 
-  String source = Source(err);
-  if (err.Fail()) return;
-
-  int64_t type = source.GetType(err);
-  if (err.Fail()) return;
+  int64_t line_start = 0;
+  if (!FindLineInLineEnds(pos, line, line_start, err)) {
+    err = Error::Ok();
+    std::shared_ptr<const ScriptCache::Entry> entry = GetCachedSource(err);
+    if (err.Fail()) return;
 
-  // No source
-  if (type > v8()->types()->kFirstNonstringType) {
-    err = Error(true, "No source");
-    return;
+    const std::vector<size_t>& line_ends = entry->line_ends;
+    pos = std::min(pos, static_cast<int64_t>(entry->source.length()));
+    line = std::lower_bound(line_ends.begin(), line_ends.end(),
+                            static_cast<size_t>(pos)) -
+           line_ends.begin();
+    line_start = line == 0 ? 0 : line_ends[line - 1] + 1;
   }
 
-  std::string source_str = source.ToString(err);
-  int64_t limit = source_str.length();
-  if (limit > pos) limit = pos;
-
-  for (int64_t i = 0; i < limit; i++, column++) {
-    // \r\n should ski adding a line and column on \r
-    if (source_str[i] == '\r' && i < limit - 1 && source_str[i + 1] == '\n') {
-      i++;
-    }
-    if (source_str[i] == '\n' || source_str[i] == '\r') {
-      column = 0;
-      line++;
-    }
-  }
+  // Columns after the first line have always been counted from 1
+  column = pos - line_start + (line > 0 ? 1 : 0);
 }
 
 bool Value::IsHoleOrUndefined(Error& err) {
@@ -775,9 +1301,9 @@ std::string String::ToString(Error& err) {
     return sliced.ToString(err);
   }
 
-  // TODO(indutny): add support for external strings
   if (*repr == v8()->string()->kExternalStringTag) {
-    return std::string("(external)");
+    ExternalString external(this);
+    return external.ToString(err);
   }
 
   if (*repr == v8()->string()->kThinStringTag) {
@@ -790,6 +1316,69 @@ std::string String::ToString(Error& err) {
 }
 
 
+CheckedType<int64_t> String::FlatChars(Error& err) {
+  CheckedType<int64_t> repr = Representation(err);
+  RETURN_IF_INVALID(repr, CheckedType<int64_t>());
+
+  if (*repr == v8()->string()->kSeqStringTag) {
+    int64_t encoding = Encoding(err);
+    if (err.Fail()) return CheckedType<int64_t>();
+
+    if (encoding == v8()->string()->kOneByteStringTag)
+      return LeaField(v8()->one_byte_string()->kCharsOffset);
+    if (encoding == v8()->string()->kTwoByteStringTag)
+      return LeaField(v8()->two_byte_string()->kCharsOffset);
+    return CheckedType<int64_t>();
+  }
+
+  if (*repr == v8()->string()->kExternalStringTag) {
+    ExternalString external(this);
+    return external.ResourceData(err);
+  }
+
+  return CheckedType<int64_t>();
+}
+
+
+int64_t String::Size(Error& err) {
+  CheckedType<int64_t> repr = Representation(err);
+  if (!repr.Check()) {
+    if (err.Success()) err = Error::Failure("Invalid string representation");
+    return -1;
+  }
+
+  CheckedType<int32_t> len = Length(err);
+  if (!len.Check()) {
+    if (err.Success()) err = Error::Failure("Invalid string length");
+    return -1;
+  }
+
+  int64_t encoding = Encoding(err);
+  if (err.Fail()) return -1;
+  int64_t chars_size =
+      *len * (encoding == v8()->string()->kTwoByteStringTag ? 2 : 1);
+
+  // Sequential strings have a variable size, so their map doesn't know it.
+  if (*repr == v8()->string()->kSeqStringTag) {
+    int64_t chars_offset = encoding == v8()->string()->kTwoByteStringTag
+                               ? v8()->two_byte_string()->kCharsOffset
+                               : v8()->one_byte_string()->kCharsOffset;
+    int64_t alignment = v8()->common()->kTaggedSize;
+    int64_t size = chars_offset + chars_size;
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  HeapObject map_obj = GetMap(err);
+  if (err.Fail()) return -1;
+  Map map(map_obj);
+  int64_t size = map.InstanceSize(err);
+  if (err.Fail()) return -1;
+
+  if (*repr == v8()->string()->kExternalStringTag) size += chars_size;
+  return size;
+}
+
+
 // Context locals iterator implementations
 Context::Locals::Locals(Context* context, Error& err) {
   context_ = context;
@@ -857,221 +1446,267 @@ void JSObject::Keys(std::vector<std::string>& keys, Error& err) {
   keys.clear();
 
   // First handle array indices.
-  ElementKeys(keys, err);
-
-  HeapObject map_obj = GetMap(err);
+  OwnElements elements(this, err);
+  if (err.Fail()) return;
 
-  Map map(map_obj);
+  for (OwnElements::Iterator it = elements.begin(); it != elements.end();
+       it++) {
+    keys.push_back(std::to_string((*it).first));
+  }
 
-  bool is_dict = map.IsDictionary(err);
+  OwnProperties properties(this, err, true);
   if (err.Fail()) return;
 
-  if (is_dict) {
-    DictionaryKeys(keys, err);
-  } else {
-    DescriptorKeys(keys, map, err);
-  }
+  for (OwnProperties::Iterator it = properties.begin();
+       it != properties.end(); it++) {
+    Value key = (*it).first;
+    if (!key.Check()) {
+      keys.push_back("???");
+      continue;
+    }
 
-  return;
+    std::string key_name = key.ToString(err);
+    if (err.Fail()) return;
+
+    keys.push_back(key_name);
+  }
+  if (properties.error().Fail()) err = properties.error();
 }
 
 
 std::vector<std::pair<Value, Value>> JSObject::Entries(Error& err) {
-  HeapObject map_obj = GetMap(err);
-
-  Map map(map_obj);
-  bool is_dict = map.IsDictionary(err);
+  OwnProperties properties(this, err);
   if (err.Fail()) return {};
 
-  if (is_dict) {
-    return DictionaryEntries(err);
-  } else {
-    return DescriptorEntries(map, err);
+  std::vector<std::pair<Value, Value>> entries;
+  for (OwnProperties::Iterator it = properties.begin();
+       it != properties.end(); it++) {
+    entries.push_back(*it);
   }
+  if (properties.error().Fail()) err = properties.error();
+  return entries;
 }
 
 
-std::vector<std::pair<Value, Value>> JSObject::DictionaryEntries(Error& err) {
-  HeapObject dictionary_obj = Properties(err);
-  if (err.Fail()) return {};
+JSObject::OwnProperties::OwnProperties(JSObject* js_object, Error& err,
+                                       bool keys_only)
+    : js_object_(*js_object),
+      keys_only_(keys_only),
+      is_dictionary_(false),
+      count_(0),
+      in_object_count_(0),
+      instance_size_(0) {
+  HeapObject map_obj = js_object->GetMap(err);
+  if (err.Fail()) return;
 
-  NameDictionary dictionary(dictionary_obj);
+  Map map(map_obj);
+  is_dictionary_ = map.IsDictionary(err);
+  if (err.Fail()) return;
 
-  int64_t length = dictionary.Length(err);
-  if (err.Fail()) return {};
+  properties_ = js_object->Properties(err);
+  if (err.Fail()) return;
 
-  std::vector<std::pair<Value, Value>> entries;
-  for (int64_t i = 0; i < length; i++) {
-    Value key = dictionary.GetKey(i, err);
+  if (is_dictionary_) {
+    NameDictionary dictionary(properties_);
+    int64_t length = dictionary.Length(err);
+    if (err.Fail()) return;
+    count_ = length;
+    return;
+  }
 
-    if (err.Fail()) return entries;
+  descriptors_ = map.InstanceDescriptors(err);
+  if (!descriptors_.Check()) return;
 
-    // Skip holes
-    bool is_hole = key.IsHoleOrUndefined(err);
-    if (err.Fail()) return entries;
-    if (is_hole) continue;
+  int64_t own_descriptors_count = map.NumberOfOwnDescriptors(err);
+  if (err.Fail()) return;
 
-    Value value = dictionary.GetValue(i, err);
+  in_object_count_ = map.InObjectProperties(err);
+  if (err.Fail()) return;
 
-    entries.push_back(std::pair<Value, Value>(key, value));
-  }
-  return entries;
+  instance_size_ = map.InstanceSize(err);
+  if (err.Fail()) return;
+
+  count_ = own_descriptors_count;
 }
 
 
-std::vector<std::pair<Value, Value>> JSObject::DescriptorEntries(Map map,
-                                                                 Error& err) {
-  HeapObject descriptors_obj = map.InstanceDescriptors(err);
-  RETURN_IF_INVALID(descriptors_obj, {});
+JSObject::OwnProperties::Iterator JSObject::OwnProperties::begin() {
+  return Iterator(0, this);
+}
 
-  DescriptorArray descriptors(descriptors_obj);
 
-  int64_t own_descriptors_count = map.NumberOfOwnDescriptors(err);
-  if (err.Fail()) return {};
+JSObject::OwnProperties::Iterator JSObject::OwnProperties::end() {
+  return Iterator(count_, this);
+}
 
-  int64_t in_object_count = map.InObjectProperties(err);
-  if (err.Fail()) return {};
 
-  int64_t instance_size = map.InstanceSize(err);
-  if (err.Fail()) return {};
+const JSObject::OwnProperties::Iterator JSObject::OwnProperties::Iterator::
+operator++(int) {
+  current_++;
+  Advance();
+  return *this;
+}
 
-  HeapObject extra_properties_obj = Properties(err);
-  if (err.Fail()) return {};
 
-  FixedArray extra_properties(extra_properties_obj);
+bool JSObject::OwnProperties::Iterator::operator!=(
+    JSObject::OwnProperties::Iterator that) {
+  return current_ != that.current_ || outer_ != that.outer_;
+}
 
-  std::vector<std::pair<Value, Value>> entries;
-  for (int64_t i = 0; i < own_descriptors_count; i++) {
-    Smi details = descriptors.GetDetails(i);
-    if (!details.Check()) {
-      PRINT_DEBUG("Failed to get details for index %ld", i);
-      entries.push_back(std::pair<Value, Value>(Value(), Value()));
-      continue;
-    }
 
-    Value key = descriptors.GetKey(i);
-    if (!key.Check()) continue;
+void JSObject::OwnProperties::Iterator::Advance() {
+  for (; current_ < outer_->count_; current_++) {
+    DecodeResult result = outer_->Decode(current_, entry_);
+    if (result == kEntry) return;
+    if (result == kStop) break;
+  }
+  current_ = outer_->count_;
+}
 
-    if (descriptors.IsConstFieldDetails(details) ||
-        descriptors.IsDescriptorDetails(details)) {
-      Value value;
 
-      value = descriptors.GetValue(i);
-      if (!value.Check()) continue;
+JSObject::OwnProperties::DecodeResult JSObject::OwnProperties::Decode(
+    int64_t index, std::pair<Value, Value>& entry) {
+  Error err;
 
-      entries.push_back(std::pair<Value, Value>(key, value));
-      continue;
-    }
+  if (is_dictionary_) {
+    NameDictionary dictionary(properties_);
 
-    // Skip non-fields for now, Object.keys(obj) does
-    // not seem to return these (for example the "length"
-    // field on an array).
-    if (!descriptors.IsFieldDetails(details)) continue;
+    Value key = dictionary.GetKey(index, err);
+    if (err.Fail()) {
+      error_ = err;
+      return kStop;
+    }
 
-    if (descriptors.IsDoubleField(details)) continue;
+    // Skip holes
+    bool is_hole = key.IsHoleOrUndefined(err);
+    if (err.Fail()) {
+      error_ = err;
+      return kStop;
+    }
+    if (is_hole) return kSkip;
 
-    int64_t index = descriptors.FieldIndex(details) - in_object_count;
+    if (keys_only_) {
+      entry = std::pair<Value, Value>(key, Value());
+      return kEntry;
+    }
 
-    Value value;
-    if (index < 0) {
-      value = GetInObjectValue<Value>(instance_size, index, err);
-    } else {
-      value = extra_properties.Get<Value>(index, err);
+    Value value = dictionary.GetValue(index, err);
+    if (err.Fail()) {
+      if (error_.Success()) error_ = err;
+      return kSkip;
     }
 
-    entries.push_back(std::pair<Value, Value>(key, value));
+    entry = std::pair<Value, Value>(key, value);
+    return kEntry;
   }
 
-  return entries;
-}
+  DescriptorArray descriptors(descriptors_);
 
+  Smi details = descriptors.GetDetails(index);
+  if (!details.Check()) {
+    PRINT_DEBUG("Failed to get details for index %ld", index);
+    entry = std::pair<Value, Value>(Value(), Value());
+    return kEntry;
+  }
 
-void JSObject::ElementKeys(std::vector<std::string>& keys, Error& err) {
-  HeapObject elements_obj = Elements(err);
-  if (err.Fail()) return;
+  Value key = descriptors.GetKey(index);
+  if (!key.Check()) return kSkip;
 
-  FixedArray elements(elements_obj);
+  // Keys() only reports fields, see below
+  if (keys_only_) {
+    if (!descriptors.IsFieldDetails(details)) return kSkip;
+    entry = std::pair<Value, Value>(key, Value());
+    return kEntry;
+  }
 
-  Smi length_smi = elements.Length(err);
-  if (err.Fail()) return;
+  if (descriptors.IsConstFieldDetails(details) ||
+      descriptors.IsDescriptorDetails(details)) {
+    Value value = descriptors.GetValue(index);
+    if (!value.Check()) return kSkip;
 
-  int64_t length = length_smi.GetValue();
-  for (int i = 0; i < length; ++i) {
-    // Add keys for anything that isn't a hole.
-    Value value = elements.Get<Value>(i, err);
-    if (err.Fail()) continue;
-    ;
-
-    bool is_hole = value.IsHole(err);
-    if (err.Fail()) continue;
-    if (!is_hole) {
-      keys.push_back(std::to_string(i));
-    }
+    entry = std::pair<Value, Value>(key, value);
+    return kEntry;
+  }
+
+  // Skip non-fields for now, Object.keys(obj) does
+  // not seem to return these (for example the "length"
+  // field on an array).
+  if (!descriptors.IsFieldDetails(details)) return kSkip;
+
+  if (descriptors.IsDoubleField(details)) return kSkip;
+
+  int64_t field_index = descriptors.FieldIndex(details) - in_object_count_;
+
+  Value value;
+  if (field_index < 0) {
+    JSObject js_object(js_object_);
+    value = js_object.GetInObjectValue<Value>(instance_size_, field_index, err);
+  } else {
+    FixedArray extra_properties(properties_);
+    value = extra_properties.Get<Value>(field_index, err);
+  }
+  if (err.Fail()) {
+    if (error_.Success()) error_ = err;
+    return kSkip;
   }
+
+  entry = std::pair<Value, Value>(key, value);
+  return kEntry;
 }
 
-void JSObject::DictionaryKeys(std::vector<std::string>& keys, Error& err) {
-  HeapObject dictionary_obj = Properties(err);
-  if (err.Fail()) return;
 
-  NameDictionary dictionary(dictionary_obj);
+JSObject::OwnElements::OwnElements(JSObject* js_object, Error& err)
+    : length_(0) {
+  elements_ = js_object->Elements(err);
+  if (err.Fail()) return;
 
-  int64_t length = dictionary.Length(err);
+  FixedArray elements(elements_);
+  Smi length_smi = elements.Length(err);
   if (err.Fail()) return;
 
-  for (int64_t i = 0; i < length; i++) {
-    Value key = dictionary.GetKey(i, err);
-    if (err.Fail()) return;
+  length_ = length_smi.GetValue();
+}
 
-    // Skip holes
-    bool is_hole = key.IsHoleOrUndefined(err);
-    if (err.Fail()) return;
-    if (is_hole) continue;
 
-    std::string key_name = key.ToString(err);
-    if (err.Fail()) {
-      // TODO - should I continue onto the next key here instead.
-      return;
-    }
+JSObject::OwnElements::Iterator JSObject::OwnElements::begin() {
+  return Iterator(0, this);
+}
 
-    keys.push_back(key_name);
-  }
+
+JSObject::OwnElements::Iterator JSObject::OwnElements::end() {
+  return Iterator(length_, this);
 }
 
-void JSObject::DescriptorKeys(std::vector<std::string>& keys, Map map,
-                              Error& err) {
-  HeapObject descriptors_obj = map.InstanceDescriptors(err);
-  RETURN_IF_INVALID(descriptors_obj, );
 
-  DescriptorArray descriptors(descriptors_obj);
-  int64_t own_descriptors_count = map.NumberOfOwnDescriptors(err);
-  if (err.Fail()) return;
+const JSObject::OwnElements::Iterator JSObject::OwnElements::Iterator::
+operator++(int) {
+  current_++;
+  Advance();
+  return *this;
+}
 
-  for (int64_t i = 0; i < own_descriptors_count; i++) {
-    Smi details = descriptors.GetDetails(i);
-    if (!details.Check()) {
-      PRINT_DEBUG("Failed to get details for index %ld", i);
-      keys.push_back("???");
-      continue;
-    }
 
-    Value key = descriptors.GetKey(i);
-    RETURN_IF_INVALID(key, );
+bool JSObject::OwnElements::Iterator::operator!=(
+    JSObject::OwnElements::Iterator that) {
+  return current_ != that.current_ || outer_ != that.outer_;
+}
 
-    // Skip non-fields for now, Object.keys(obj) does
-    // not seem to return these (for example the "length"
-    // field on an array).
-    if (!descriptors.IsFieldDetails(details)) {
-      continue;
-    }
 
-    std::string key_name = key.ToString(err);
+void JSObject::OwnElements::Iterator::Advance() {
+  FixedArray elements(outer_->elements_);
+  for (; current_ < outer_->length_; current_++) {
+    Error err;
+    Value value = elements.Get<Value>(current_, err);
+    // Add anything that isn't a hole.
+    bool is_hole = err.Success() && value.IsHole(err);
     if (err.Fail()) {
-      // TODO - should I continue onto the next key here instead.
-      return;
+      if (outer_->error_.Success()) outer_->error_ = err;
+      continue;
     }
+    if (is_hole) continue;
 
-    keys.push_back(key_name);
+    entry_ = std::pair<int64_t, Value>(current_, value);
+    return;
   }
 }
 
@@ -1,8 +1,13 @@
 #ifndef SRC_LLV8_H_
 #define SRC_LLV8_H_
 
+#include <cstdint>
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <lldb/API/LLDB.h>
 
@@ -21,6 +26,9 @@ class Printer;
 class FindJSObjectsVisitor;
 class FindReferencesCmd;
 class FindObjectsCmd;
+class DumpBufferCmd;
+class HeapSnapshotCmd;
+class LLNodeApi;
 
 namespace v8 {
 
@@ -118,6 +126,8 @@ class HeapObject : public Value {
   inline bool Check() const;
   inline int64_t LeaField(int64_t off) const;
   inline int64_t LoadField(int64_t off, Error& err);
+  // Load a full word, for fields which don't hold tagged values
+  inline int64_t LoadRawField(int64_t off, Error& err);
 
   template <class T>
   inline CheckedType<T> LoadCheckedField(Constant<int64_t> off);
@@ -173,9 +183,36 @@ class String : public HeapObject {
 
   std::string ToString(Error& err);
 
+  // Address of the characters of a flat (sequential or external) string.
+  CheckedType<int64_t> FlatChars(Error& err);
+
+  // Bytes used by the string: the heap object plus, for external strings,
+  // the characters kept outside of the V8 heap.
+  int64_t Size(Error& err);
+
   static inline bool IsString(LLV8* v8, HeapObject heap_object, Error& err);
 };
 
+// Decoded script sources and their line breaks, by Script address, so
+// large scripts are decoded once per stop instead of once per frame.
+class ScriptCache {
+ public:
+  struct Entry {
+    std::string source;
+    // Offset of the last character of each line break in source
+    std::vector<size_t> line_ends;
+  };
+
+  std::shared_ptr<const Entry> Get(uint64_t script);
+  void Insert(uint64_t script, std::shared_ptr<const Entry> entry);
+  void Clear();
+
+ private:
+  // Printers on --output workers share the cache
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, std::shared_ptr<const Entry>> entries_;
+};
+
 class Script : public HeapObject {
  public:
   V8_VALUE_DEFAULT_METHODS(Script, HeapObject)
@@ -189,6 +226,12 @@ class Script : public HeapObject {
                 uint32_t& lines_found, Error& err);
   void GetLineColumnFromPos(int64_t pos, int64_t& line, int64_t& column,
                             Error& err);
+
+ private:
+  std::shared_ptr<const ScriptCache::Entry> GetCachedSource(Error& err);
+  // Binary search the line ends V8 computed for the script, if any
+  bool FindLineInLineEnds(int64_t pos, int64_t& line, int64_t& line_start,
+                          Error& err);
 };
 
 class Code : public HeapObject {
@@ -214,6 +257,10 @@ class SharedFunctionInfo : public HeapObject {
   std::string ProperName(Error& err);
   std::string GetPostfix(Error& err);
   std::string ToString(Error& err);
+  // Script name and 0-based line and column where the function starts.
+  // Returns false for functions without a Script.
+  bool GetLocation(std::string& script_name, int64_t& line, int64_t& column,
+                   Error& err);
 
  private:
   inline String name(Error& err);
@@ -275,6 +322,15 @@ class ThinString : public String {
   inline std::string ToString(Error& err);
 };
 
+class ExternalString : public String {
+ public:
+  V8_VALUE_DEFAULT_METHODS(ExternalString, String)
+
+  inline CheckedType<int64_t> ResourceData(Error& err);
+
+  inline std::string ToString(Error& err);
+};
+
 // Numbers on the heap can be a boxed HeapNumber or a unboxed double.
 class HeapNumber : public HeapObject {
  public:
@@ -331,15 +387,100 @@ class JSObject : public HeapObject {
 
   inline HeapNumber GetDoubleField(int64_t index, Error err);
 
+  // Iterator class to walk the own named properties of an object one at a
+  // time, yielding the same key/value pairs as Entries() without
+  // materializing them. The map and its descriptors are only read once.
+  class OwnProperties {
+   public:
+    class Iterator {
+     public:
+      inline std::pair<Value, Value> operator*() { return entry_; }
+      const JSObject::OwnProperties::Iterator operator++(int);
+      bool operator!=(JSObject::OwnProperties::Iterator that);
+
+      inline Iterator(int64_t current, OwnProperties* outer)
+          : current_(current), outer_(outer) {
+        Advance();
+      }
+
+     private:
+      // Move to the next property at or after current_.
+      void Advance();
+
+      int64_t current_;
+      OwnProperties* outer_;
+      std::pair<Value, Value> entry_;
+    };
+
+    // With `keys_only`, values aren't read and only the keys Keys() reports
+    // are yielded, paired with an empty Value.
+    OwnProperties(JSObject* js_object, Error& err, bool keys_only = false);
+
+    Iterator begin();
+    Iterator end();
+
+    // First property that couldn't be decoded. Dictionaries stop there,
+    // other objects skip the property and go on.
+    inline const Error& error() const { return error_; }
+
+   private:
+    enum DecodeResult { kEntry, kSkip, kStop };
+
+    DecodeResult Decode(int64_t index, std::pair<Value, Value>& entry);
+
+    HeapObject js_object_;
+    bool keys_only_;
+    bool is_dictionary_;
+    int64_t count_;
+    HeapObject descriptors_;
+    HeapObject properties_;
+    int64_t in_object_count_;
+    int64_t instance_size_;
+    Error error_;
+  };
+
+  // Iterator class to walk the elements of an object which aren't holes,
+  // yielding their index and value.
+  class OwnElements {
+   public:
+    class Iterator {
+     public:
+      inline std::pair<int64_t, Value> operator*() { return entry_; }
+      const JSObject::OwnElements::Iterator operator++(int);
+      bool operator!=(JSObject::OwnElements::Iterator that);
+
+      inline Iterator(int64_t current, OwnElements* outer)
+          : current_(current), outer_(outer) {
+        Advance();
+      }
+
+     private:
+      // Move to the next element at or after current_.
+      void Advance();
+
+      int64_t current_;
+      OwnElements* outer_;
+      std::pair<int64_t, Value> entry_;
+    };
+
+    OwnElements(JSObject* js_object, Error& err);
+
+    Iterator begin();
+    Iterator end();
+
+    // First element that couldn't be read, it was skipped.
+    inline const Error& error() const { return error_; }
+
+   private:
+    HeapObject elements_;
+    int64_t length_;
+    Error error_;
+  };
+
  protected:
   friend class llnode::Printer;
   template <class T>
   inline T GetInObjectValue(int64_t size, int index, Error& err);
-  void ElementKeys(std::vector<std::string>& keys, Error& err);
-  void DictionaryKeys(std::vector<std::string>& keys, Error& err);
-  void DescriptorKeys(std::vector<std::string>& keys, Map map, Error& err);
-  std::vector<std::pair<Value, Value>> DictionaryEntries(Error& err);
-  std::vector<std::pair<Value, Value>> DescriptorEntries(Map map, Error& err);
   Value GetDictionaryProperty(std::string key_name, Error& err);
   Value GetDescriptorProperty(std::string key_name, Map map, Error& err);
 };
@@ -432,6 +573,7 @@ class JSFunction : public JSObject {
 
   inline SharedFunctionInfo Info(Error& err);
   inline HeapObject GetContext(Error& err);
+  inline Code GetCode(Error& err);
   inline std::string Name(Error& err);
 
   std::string GetDebugLine(std::string args, Error& err);
@@ -647,12 +789,116 @@ class JSFrame : public Value {
   friend class llnode::Printer;
 };
 
+// Page cache for heap reads. A thread that decodes many objects installs its
+// own with ReadCache::Scope, reads on other threads go to the process as
+// before. Only meant for stopped processes and core dumps.
+class ReadCache {
+ public:
+  explicit ReadCache(LLV8* llv8);
+
+  // Return false if the memory can't be read, the caller then reads it from
+  // the process to get the error.
+  bool Read(uint64_t addr, void* buf, size_t size);
+  bool ReadUnsigned(uint64_t addr, uint32_t byte_size, uint64_t* value);
+
+  inline uint32_t pointer_size() const { return pointer_size_; }
+
+  // Cache of the current thread, if any and if it reads llv8's process, so
+  // one thread can decode several processes
+  static ReadCache* Current(const LLV8* llv8);
+
+  class Scope {
+   public:
+    explicit Scope(ReadCache* cache);
+    ~Scope();
+
+   private:
+    ReadCache* previous_;
+  };
+
+  static const size_t kPageSize = 4096;
+
+ private:
+  static const size_t kPages = 256;
+
+  struct Page {
+    Page() : base(UINT64_MAX) {}
+
+    uint64_t base;
+    uint8_t data[kPageSize];
+  };
+
+  const LLV8* llv8_;
+  lldb::SBProcess process_;
+  bool big_endian_;
+  uint32_t pointer_size_;
+  std::vector<Page> pages_;
+};
+
+// Sorted address ranges of V8 code, to name PCs that can't be decoded as
+// JS frames. Embedded builtins come from the binary's `Builtins_*` symbols,
+// JIT code is added by the heap scan.
+class CodeMap {
+ public:
+  struct Entry {
+    uint64_t start;
+    uint64_t size;
+    // Builtin name, empty for JIT code
+    std::string name;
+    // A JSFunction running this code, if the heap scan found one
+    uint64_t function;
+  };
+
+  CodeMap() : builtins_loaded_(false), code_sorted_(true) {}
+
+  // Forget everything known about the previous target
+  void Assign(lldb::SBTarget target);
+
+  void AddCode(uint64_t start, uint64_t size, uint64_t function);
+
+  // Entry containing pc, or nullptr
+  const Entry* Find(uint64_t pc);
+
+  // False for binaries without embedded builtins
+  bool HasBuiltins();
+  bool IsBuiltin(uint64_t pc);
+
+  // JIT code found by the heap scan, sorted by address
+  const std::vector<Entry>& GetCode();
+
+ private:
+  void LoadBuiltins();
+  void SortCode();
+  static const Entry* Find(const std::vector<Entry>& entries, uint64_t pc);
+
+  lldb::SBTarget target_;
+  std::vector<Entry> builtins_;
+  std::vector<Entry> code_;
+  bool builtins_loaded_;
+  bool code_sorted_;
+};
+
 class LLV8 {
  public:
-  LLV8() : target_(lldb::SBTarget()) {}
+  LLV8()
+      : target_(lldb::SBTarget()),
+        generation_(0),
+        stop_id_(0),
+        cage_base_(0),
+        cage_base_loaded_(false) {}
 
   void Load(lldb::SBTarget target);
 
+  // Resolve every V8 constant now instead of on first use.
+  void LoadAllConstants();
+
+  inline ConstantResolver* resolver() { return &resolver_; }
+  inline CodeMap* code_map() { return &code_map_; }
+
+  // Base of the 4GB pointer cage holding the isolate's heap on builds with
+  // pointer compression, 0 when it couldn't be determined.
+  int64_t CageBase();
+
  private:
   template <class T>
   inline T LoadValue(int64_t addr, Error& err);
@@ -662,6 +908,10 @@ class LLV8 {
 
   int64_t LoadConstant(const char* name);
   int64_t LoadPtr(int64_t addr, Error& err);
+  int64_t LoadTagged(int64_t addr, Error& err);
+  inline int64_t DecompressTagged(int64_t addr, int64_t value);
+  template <class T>
+  inline T LoadTaggedValue(int64_t addr, Error& err);
   template <class T>
   inline CheckedType<T> LoadUnsigned(int64_t addr, uint32_t byte_size);
   int64_t LoadUnsigned(int64_t addr, uint32_t byte_size, Error& err);
@@ -673,6 +923,15 @@ class LLV8 {
 
   lldb::SBTarget target_;
   lldb::SBProcess process_;
+  ConstantResolver resolver_;
+  uint64_t generation_;
+  // Target whose constants were all resolved to populate the cache
+  lldb::SBTarget populated_target_;
+  CodeMap code_map_;
+  ScriptCache script_cache_;
+  uint32_t stop_id_;
+  int64_t cage_base_;
+  bool cage_base_loaded_;
 
   constants::Common common;
   constants::Smi smi;
@@ -694,6 +953,7 @@ class LLV8 {
   constants::ConsString cons_string;
   constants::SlicedString sliced_string;
   constants::ThinString thin_string;
+  constants::ExternalString external_string;
   constants::FixedArrayBase fixed_array_base;
   constants::FixedTypedArrayBase fixed_typed_array_base;
   constants::JSTypedArray js_typed_array;
@@ -725,6 +985,7 @@ class LLV8 {
   friend class ConsString;
   friend class SlicedString;
   friend class ThinString;
+  friend class ExternalString;
   friend class HeapNumber;
   friend class JSObject;
   friend class JSError;
@@ -743,11 +1004,15 @@ class LLV8 {
   friend class JSRegExp;
   friend class JSDate;
   friend class CodeMap;
+  friend class ReadCache;
   friend class Symbol;
   friend class llnode::Printer;
   friend class llnode::FindJSObjectsVisitor;
   friend class llnode::FindObjectsCmd;
   friend class llnode::FindReferencesCmd;
+  friend class llnode::DumpBufferCmd;
+  friend class llnode::HeapSnapshotCmd;
+  friend class llnode::LLNodeApi;
   friend class llnode::node::constants::Environment;
 };
 
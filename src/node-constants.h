@@ -36,12 +36,14 @@ class Environment : public Module {
   int64_t kEnvContextEmbedderDataIndex;
   addr_t kCurrentEnvironment;
 
+  // Environment of a native context
+  addr_t CurrentEnvironmentFromContext(v8::Context context, Error& err);
+
  protected:
   void Load();
 
  private:
   addr_t LoadCurrentEnvironment(Error& err);
-  addr_t CurrentEnvironmentFromContext(v8::Context context, Error& err);
 };
 
 class ReqWrapQueue : public Module {
@@ -60,17 +60,33 @@ void Node::Load(SBTarget target) {
   // Reload process anyway
   process_ = target.GetProcess();
 
+  // Constants are resolved through V8's resolver, so make sure it's set up
+  // for this target.
+  ConstantResolver* resolver = llv8_->resolver();
+  llv8_->Load(target);
+
   // No need to reload
-  if (target_ == target) return;
+  if (target_ == target && generation_ == resolver->generation()) return;
 
   target_ = target;
+  generation_ = resolver->generation();
+
+#define V(Class, Attribute) Attribute.Assign(target, resolver);
+  CONSTANTS_LIST(V)
+#undef V
+
+  // Like in LLV8::Load(), populate the cache once per target
+  if (resolver->needs_cache() && populated_target_ != target) {
+    populated_target_ = target;
+    LoadAllConstants();
+    resolver->SaveCache();
+  }
+}
 
-  env.Assign(target);
-  req_wrap_queue.Assign(target);
-  req_wrap.Assign(target);
-  handle_wrap_queue.Assign(target);
-  handle_wrap.Assign(target);
-  base_object.Assign(target);
+void Node::LoadAllConstants() {
+#define V(Class, Attribute) Attribute();
+  CONSTANTS_LIST(V)
+#undef V
 }
 }  // namespace node
 }  // namespace llnode
@@ -82,20 +82,28 @@ class ReqWrap : public AsyncWrap {
 class Node {
  public:
 #define V(Class, Attribute) Attribute(constants::Class(llv8)),
-  Node(v8::LLV8* llv8) : CONSTANTS_LIST(V) target_(lldb::SBTarget()) {}
+  Node(v8::LLV8* llv8)
+      : CONSTANTS_LIST(V) llv8_(llv8), target_(lldb::SBTarget()),
+        generation_(0) {}
 #undef V
 
   inline lldb::SBProcess process() { return process_; };
 
   void Load(lldb::SBTarget target);
 
+  // Resolve every Node.js constant now instead of on first use.
+  void LoadAllConstants();
+
 #define V(Class, Attribute) constants::Class Attribute;
   CONSTANTS_LIST(V)
 #undef V
 
  private:
+  v8::LLV8* llv8_;
   lldb::SBTarget target_;
   lldb::SBProcess process_;
+  uint64_t generation_;
+  lldb::SBTarget populated_target_;
 };
 
 template <typename T, typename C>
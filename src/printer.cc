@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include <cinttypes>
 #include <iostream>
 #include <sstream>
@@ -5,9 +7,230 @@
 #include "deps/rang/include/rang.hpp"
 #include "src/llv8-inl.h"
 #include "src/printer.h"
+#include "src/settings.h"
 
 namespace llnode {
 
+void OutputSink::Write(const char* data, size_t length) {
+  if (full_) return;
+
+  if (limit_ != 0 && written_ + length > limit_) {
+    length = limit_ - written_;
+    // Don't cut a multi-byte UTF-8 sequence in half
+    while (length > 0 && (data[length] & 0xc0) == 0x80) length--;
+    full_ = true;
+  }
+
+  written_ += length;
+  if (length > 0) Append(data, length);
+}
+
+
+void ResultSink::Append(const char* data, size_t length) {
+  buffer_.append(data, length);
+  if (buffer_.size() >= kChunkSize) Flush();
+}
+
+
+void ResultSink::Flush() {
+  if (buffer_.empty()) return;
+  result_.Printf("%.*s", static_cast<int>(buffer_.size()), buffer_.data());
+  buffer_.clear();
+}
+
+
+void IndentSink::Append(const char* data, size_t length) {
+  const char* end = data + length;
+  while (data < end) {
+    const char* eol = static_cast<const char*>(memchr(data, '\n', end - data));
+    if (eol == nullptr) {
+      out_->Write(data, end - data);
+      return;
+    }
+    out_->Write(data, eol - data + 1);
+    out_->Write(indent_);
+    data = eol + 1;
+  }
+}
+
+
+JSONWriter::JSONWriter(OutputSink* sink) : sink_(sink), after_key_(false) {
+  rang::setControlMode(rang::control::Off);
+}
+
+
+JSONWriter::~JSONWriter() {
+  Settings::GetSettings()->RestoreColor();
+}
+
+
+void JSONWriter::Separate() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (first_.empty()) return;
+  if (!first_.back()) sink_->Write(",", 1);
+  first_.back() = false;
+}
+
+
+void JSONWriter::BeginObject() {
+  Separate();
+  sink_->Write("{", 1);
+  first_.push_back(true);
+}
+
+
+void JSONWriter::EndObject() {
+  first_.pop_back();
+  sink_->Write("}", 1);
+}
+
+
+void JSONWriter::BeginArray() {
+  Separate();
+  sink_->Write("[", 1);
+  first_.push_back(true);
+}
+
+
+void JSONWriter::EndArray() {
+  first_.pop_back();
+  sink_->Write("]", 1);
+}
+
+
+void JSONWriter::Key(const std::string& key) {
+  Separate();
+  WriteEscaped(key);
+  sink_->Write(":", 1);
+  after_key_ = true;
+}
+
+
+void JSONWriter::String(const std::string& value) {
+  Separate();
+  WriteEscaped(value);
+}
+
+
+void JSONWriter::Int(int64_t value) {
+  Separate();
+  char tmp[32];
+  int length = snprintf(tmp, sizeof(tmp), "%" PRId64, value);
+  sink_->Write(tmp, length);
+}
+
+
+void JSONWriter::Address(uint64_t value) {
+  Separate();
+  char tmp[32];
+  int length = snprintf(tmp, sizeof(tmp), "\"0x%016" PRIx64 "\"", value);
+  sink_->Write(tmp, length);
+}
+
+
+void JSONWriter::Bool(bool value) {
+  Separate();
+  sink_->Write(value ? "true" : "false");
+}
+
+
+void JSONWriter::Null() {
+  Separate();
+  sink_->Write("null", 4);
+}
+
+
+// Length of the well-formed UTF-8 sequence starting at `i`, or 0 if the
+// byte there doesn't start one.
+static size_t Utf8SequenceLength(const std::string& value, size_t i) {
+  unsigned char c = value[i];
+  size_t length;
+  uint32_t min;
+  if (c >= 0xc2 && c <= 0xdf) {
+    length = 2;
+    min = 0x80;
+  } else if (c >= 0xe0 && c <= 0xef) {
+    length = 3;
+    min = 0x800;
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    length = 4;
+    min = 0x10000;
+  } else {
+    return 0;
+  }
+  if (i + length > value.size()) return 0;
+
+  uint32_t code_point = c & (0x7f >> length);
+  for (size_t j = 1; j < length; j++) {
+    unsigned char next = value[i + j];
+    if ((next & 0xc0) != 0x80) return 0;
+    code_point = (code_point << 6) | (next & 0x3f);
+  }
+  // Overlong encodings, surrogates and code points past U+10FFFF
+  if (code_point < min || code_point > 0x10ffff ||
+      (code_point >= 0xd800 && code_point <= 0xdfff)) {
+    return 0;
+  }
+  return length;
+}
+
+
+void JSONWriter::WriteEscaped(const std::string& value) {
+  std::string res;
+  res.reserve(value.size() + 2);
+  res += '"';
+  for (size_t i = 0; i < value.size(); i++) {
+    char c = value[i];
+    if (static_cast<unsigned char>(c) >= 0x80) {
+      // Strings from V8 are UTF-8 already, but raw bytes read from the
+      // process may not be. Those are taken as Latin-1 so the document
+      // stays valid UTF-8.
+      size_t length = Utf8SequenceLength(value, i);
+      if (length == 0) {
+        char tmp[8];
+        snprintf(tmp, sizeof(tmp), "\\u%04x", static_cast<unsigned char>(c));
+        res += tmp;
+      } else {
+        res.append(value, i, length);
+        i += length - 1;
+      }
+      continue;
+    }
+
+    switch (c) {
+      case '"':
+        res += "\\\"";
+        break;
+      case '\\':
+        res += "\\\\";
+        break;
+      case '\n':
+        res += "\\n";
+        break;
+      case '\r':
+        res += "\\r";
+        break;
+      case '\t':
+        res += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char tmp[8];
+          snprintf(tmp, sizeof(tmp), "\\u%04x", static_cast<unsigned char>(c));
+          res += tmp;
+        } else {
+          res += c;
+        }
+    }
+  }
+  res += '"';
+  sink_->Write(res);
+}
+
+
 // Forward declarations
 template <>
 std::string Printer::Stringify(v8::Context ctx, Error& err);
@@ -18,6 +241,62 @@ std::string Printer::Stringify(v8::Value value, Error& err);
 template <>
 std::string Printer::Stringify(v8::HeapObject heap_object, Error& err);
 
+template <>
+void Printer::Print(v8::JSObject js_object, OutputSink* sink, Error& err);
+
+template <>
+void Printer::Print(v8::FixedArray fixed_array, OutputSink* sink, Error& err);
+
+template <>
+void Printer::Print(v8::HeapObject heap_object, OutputSink* sink, Error& err);
+
+
+template <typename T>
+void Printer::Print(T value, OutputSink* sink, Error& err) {
+  sink->Write(Stringify(value, err));
+}
+
+
+template <typename T>
+std::string Printer::PrintToString(T value, Error& err) {
+  std::string res;
+  StringSink sink(&res);
+  Print(value, &sink, err);
+  return res;
+}
+
+std::string FunctionNameCache::GetDebugLine(v8::JSFunction fn,
+                                            const std::string& args,
+                                            Error& err) {
+  v8::SharedFunctionInfo info = fn.Info(err);
+  if (err.Fail()) return std::string();
+
+  Entry entry;
+  bool found;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(info.raw());
+    found = it != entries_.end();
+    if (found) entry = it->second;
+  }
+
+  // Decoded without the lock, two threads may both decode a new function
+  if (!found) {
+    entry.name = info.ProperName(err);
+    if (err.Fail()) return std::string();
+    entry.postfix = info.GetPostfix(err);
+    if (err.Fail()) return std::string();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[info.raw()] = entry;
+  }
+
+  std::string res = entry.name;
+  if (!args.empty()) res += "(" + args + ")";
+  return res + " at " + entry.postfix;
+}
+
+
 template <>
 std::string Printer::Stringify(v8::JSFrame js_frame, Error& err) {
   v8::Value context = llv8_->LoadValue<v8::Value>(
@@ -73,6 +352,8 @@ std::string Printer::Stringify(v8::JSFrame js_frame, Error& err) {
 
   char tmp[128];
   snprintf(tmp, sizeof(tmp), " fn=0x%016" PRIx64, fn.raw());
+  if (name_cache_ != nullptr)
+    return name_cache_->GetDebugLine(fn, args, err) + tmp;
   return fn.GetDebugLine(args, err) + tmp;
 }
 
@@ -165,7 +446,18 @@ std::string Printer::Stringify(v8::String str, Error& err) {
 
   unsigned int len = options_.length;
 
-  if (len != 0 && val.length() > len) val = val.substr(0, len) + "...";
+  if (len != 0 && val.length() > len) {
+    // Count characters rather than bytes, so that we don't cut a multi-byte
+    // UTF-8 sequence in half.
+    size_t chars = 0;
+    for (size_t i = 0; i < val.length(); i++) {
+      if ((val[i] & 0xc0) == 0x80) continue;
+      if (chars++ == len) {
+        val = val.substr(0, i) + "...";
+        break;
+      }
+    }
+  }
 
   std::stringstream ss;
   ss << rang::fg::yellow << "<String: \"" + val + "\">" << rang::fg::reset;
@@ -174,29 +466,28 @@ std::string Printer::Stringify(v8::String str, Error& err) {
 
 
 template <>
-std::string Printer::Stringify(v8::FixedArray fixed_array, Error& err) {
+void Printer::Print(v8::FixedArray fixed_array, OutputSink* sink, Error& err) {
   v8::Smi length_smi = fixed_array.Length(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
   std::string res = "<FixedArray, len=" + length_smi.ToString(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
+  std::stringstream ss;
   if (options_.detailed) {
-    std::stringstream ss;
     ss << rang::fg::magenta << res;
-    std::string contents =
-        StringifyContents(fixed_array, length_smi.GetValue(), err);
-    if (!contents.empty()) {
-      ss << " contents" << rang::fg::reset << "={\n" + contents + "}";
-      res = ss.str();
-    }
-    res += ">";
+    sink->Write(ss.str());
+
+    ss.str("");
+    ss.clear();
+    ss << " contents" << rang::fg::reset << "={\n";
+    if (PrintContents(fixed_array, length_smi.GetValue(), sink, ss.str(), err))
+      sink->Write("}");
+    sink->Write(">");
   } else {
-    std::stringstream ss;
     ss << rang::fg::yellow << res + ">" << rang::fg::reset;
-    res = ss.str();
+    sink->Write(ss.str());
   }
-  return res;
 }
 
 
@@ -290,8 +581,8 @@ std::string Printer::Stringify(v8::Context ctx, Error& err) {
     v8::Value value = it.GetValue(err);
     if (err.Fail()) return std::string();
 
-    Printer printer(llv8_);
-    res += printer.Stringify(value, err);
+    StringSink sink(&res);
+    PrintChild(value, &sink, err);
     if (err.Fail()) return std::string();
   }
 
@@ -448,15 +739,15 @@ std::string Printer::Stringify(v8::JSTypedArray js_typed_array, Error& err) {
 
 
 template <>
-std::string Printer::Stringify(v8::Map map, Error& err) {
+void Printer::Print(v8::Map map, OutputSink* sink, Error& err) {
   // TODO(mmarchini): don't fail if can't load NumberOfOwnDescriptors
   int64_t own_descriptors_count = map.NumberOfOwnDescriptors(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
   std::string in_object_properties_or_constructor;
   int64_t in_object_properties_or_constructor_index;
   if (map.IsJSObjectMap(err)) {
-    if (err.Fail()) return std::string();
+    if (err.Fail()) return;
     in_object_properties_or_constructor_index = map.InObjectProperties(err);
     in_object_properties_or_constructor = std::string("in_object_size");
   } else {
@@ -464,10 +755,10 @@ std::string Printer::Stringify(v8::Map map, Error& err) {
         map.ConstructorFunctionIndex(err);
     in_object_properties_or_constructor = std::string("constructor_index");
   }
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
   int64_t instance_size = map.InstanceSize(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
   char tmp[256];
   std::stringstream ss;
@@ -494,33 +785,32 @@ std::string Printer::Stringify(v8::Map map, Error& err) {
            static_cast<int>(in_object_properties_or_constructor_index),
            static_cast<int>(instance_size));
 
-  if (!options_.detailed) {
-    return std::string(tmp) + ">";
+  if (!options_.detailed || !descriptors_obj.Check()) {
+    sink->Write(std::string(tmp) + ">");
+    return;
   }
 
-  if (descriptors_obj.Check()) {
-    v8::DescriptorArray descriptors(descriptors_obj);
-    if (err.Fail()) return std::string();
+  v8::DescriptorArray descriptors(descriptors_obj);
+  if (err.Fail()) return;
 
-    return std::string(tmp) + ":" +
-           Stringify<v8::FixedArray>(descriptors, err) + ">";
-  } else {
-    return std::string(tmp) + ">";
-  }
+  sink->Write(std::string(tmp) + ":");
+  Print<v8::FixedArray>(descriptors, sink, err);
+  sink->Write(">");
 }
 
 template <>
-std::string Printer::Stringify(v8::JSError js_error, Error& err) {
+void Printer::Print(v8::JSError js_error, OutputSink* sink, Error& err) {
   std::string name = js_error.GetName(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
   std::stringstream output;
 
   output << rang::fg::yellow << "<Object: " << name;
+  sink->Write(output.str());
 
   // Print properties in detailed mode
   if (options_.detailed) {
-    output << StringifyJSObjectFields(js_error, err);
+    PrintJSObjectFields(js_error, sink, err);
 
     if (js_error.HasStackTrace(err)) {
       v8::StackTrace stack_trace = js_error.GetStackTrace(err);
@@ -545,118 +835,120 @@ std::string Printer::Stringify(v8::JSError js_error, Error& err) {
       }
 
       error_stack << "  }";
-      output << error_stack.str();
+      sink->Write(error_stack.str());
     }
   }
 
+  output.str("");
+  output.clear();
   output << rang::fg::yellow << ">" << rang::fg::reset;
-  return output.str();
+  sink->Write(output.str());
 }
 
 
 template <>
-std::string Printer::Stringify(v8::JSObject js_object, Error& err) {
+void Printer::Print(v8::JSObject js_object, OutputSink* sink, Error& err) {
   std::string name = js_object.GetName(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
   std::stringstream output;
 
   output << rang::fg::yellow << "<Object: " << name;
+  sink->Write(output.str());
 
   // Print properties in detailed mode
-  if (options_.detailed) output << StringifyJSObjectFields(js_object, err);
+  if (options_.detailed) PrintJSObjectFields(js_object, sink, err);
 
+  output.str("");
+  output.clear();
   output << rang::fg::yellow << ">" << rang::fg::reset;
-
-  return output.str();
+  sink->Write(output.str());
 }
 
-std::string Printer::StringifyJSObjectFields(v8::JSObject js_object,
-                                             Error& err) {
+void Printer::PrintJSObjectFields(v8::JSObject js_object, OutputSink* sink,
+                                  Error& err) {
   std::stringstream output;
 
-  output << rang::fg::reset << " " << StringifyProperties(js_object, err);
-  if (err.Fail()) return std::string();
-
-  std::string fields = StringifyInternalFields(js_object, err);
-  if (err.Fail()) return std::string();
+  output << rang::fg::reset << " ";
+  sink->Write(output.str());
 
-  if (!fields.empty()) {
-    output << std::endl
-           << rang::fg::magenta << "  internal fields" << rang::fg::reset
-           << " {" << std::endl
-           << fields << "}";
-  }
+  PrintProperties(js_object, sink, err);
+  if (err.Fail()) return;
 
-  return output.str();
+  output.str("");
+  output.clear();
+  output << std::endl
+         << rang::fg::magenta << "  internal fields" << rang::fg::reset << " {"
+         << std::endl;
+  if (PrintInternalFields(js_object, sink, output.str(), err))
+    sink->Write("}");
 }
 
 template <>
-std::string Printer::Stringify(v8::JSArray js_array, Error& err) {
+void Printer::Print(v8::JSArray js_array, OutputSink* sink, Error& err) {
   int64_t length = js_array.GetArrayLength(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
   std::string res = "<Array: length=" + std::to_string(length);
 
+  std::stringstream ss;
   if (options_.detailed) {
     int64_t display_length = std::min<int64_t>(length, options_.length);
-    std::string elems = StringifyElements(js_array, display_length, err);
-    if (err.Fail()) return std::string();
 
-    std::stringstream ss;
     ss << rang::fg::magenta << res << rang::fg::reset;
-    res = ss.str().c_str();
+    sink->Write(ss.str());
 
-    if (!elems.empty()) res += " {\n" + elems + "}>";
-    return res;
+    if (PrintElements(js_array, display_length, sink, " {\n", err))
+      sink->Write("}>");
   } else {
-    std::stringstream ss;
     ss << rang::fg::yellow << res + ">" << rang::fg::reset;
-    res = ss.str().c_str();
-    return res;
+    sink->Write(ss.str());
   }
 }
 
 
 template <>
-std::string Printer::Stringify(v8::JSRegExp regexp, Error& err) {
-  if (llv8_->js_regexp()->kSourceOffset == -1)
-    return Stringify<v8::JSObject>(regexp, err);
+void Printer::Print(v8::JSRegExp regexp, OutputSink* sink, Error& err) {
+  if (llv8_->js_regexp()->kSourceOffset == -1) {
+    Print<v8::JSObject>(regexp, sink, err);
+    return;
+  }
 
   std::string res = "<JSRegExp ";
 
   v8::String src = regexp.GetSource(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
   res += "source=/" + src.ToString(err) + "/";
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
 
+  std::stringstream ss;
   // Print properties in detailed mode
   if (options_.detailed) {
-    std::stringstream ss;
-    ss << rang::fg::magenta << res << rang::fg::reset;
-    res = ss.str();
+    ss << rang::fg::magenta << res << rang::fg::reset << " ";
+    sink->Write(ss.str());
 
-    res += " " + StringifyProperties(regexp, err);
-    res += ">";
-    if (err.Fail()) return std::string();
+    PrintProperties(regexp, sink, err);
+    sink->Write(">");
   } else {
-    std::stringstream ss;
     ss << rang::fg::yellow << res + ">" << rang::fg::reset;
-    res = ss.str();
+    sink->Write(ss.str());
   }
-  return res;
 }
 
 template <>
-std::string Printer::Stringify(v8::HeapObject heap_object, Error& err) {
+void Printer::Print(v8::HeapObject heap_object, OutputSink* sink, Error& err) {
   int64_t type = heap_object.GetType(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return;
+
+  // Don't expand the value we started from again
+  if (options_.detailed && options_.depth > 1)
+    expand_state()->visited.insert(heap_object.raw());
 
   // TODO(indutny): make this configurable
   char buf[64];
   if (options_.print_map) {
     v8::HeapObject map = heap_object.GetMap(err);
-    if (err.Fail()) return std::string();
+    if (err.Fail()) return;
 
     snprintf(buf, sizeof(buf),
              "0x%016" PRIx64 "(map=0x%016" PRIx64 "):", heap_object.raw(),
@@ -673,87 +965,118 @@ std::string Printer::Stringify(v8::HeapObject heap_object, Error& err) {
   if (type == llv8_->types()->kGlobalObjectType) {
     std::stringstream ss;
     ss << rang::fg::yellow << "<Global>" << rang::fg::reset;
-    return pre + ss.str();
+    sink->Write(pre + ss.str());
+    return;
   }
   if (type == llv8_->types()->kGlobalProxyType) {
     std::stringstream ss;
     ss << rang::fg::yellow << "<Global proxy>" << rang::fg::reset;
-    return pre + ss.str();
+    sink->Write(pre + ss.str());
+    return;
   }
   if (type == llv8_->types()->kCodeType) {
     std::stringstream ss;
     ss << rang::fg::yellow << "<Code>" << rang::fg::reset;
-    return pre + ss.str();
+    sink->Write(pre + ss.str());
+    return;
   }
   if (type == llv8_->types()->kMapType) {
     v8::Map m(heap_object);
-    return pre + Stringify(m, err);
+    sink->Write(pre);
+    Print(m, sink, err);
+    return;
   }
 
   if (heap_object.IsJSErrorType(err)) {
     v8::JSError error(heap_object);
-    return pre + Stringify(error, err);
+    sink->Write(pre);
+    Print(error, sink, err);
+    return;
   }
 
   if (v8::JSObject::IsObjectType(llv8_, type)) {
     v8::JSObject o(heap_object);
-    return pre + Stringify(o, err);
+    sink->Write(pre);
+    Print(o, sink, err);
+    return;
   }
 
   if (type == llv8_->types()->kHeapNumberType) {
     v8::HeapNumber n(heap_object);
-    return pre + Stringify(n, err);
+    sink->Write(pre);
+    Print(n, sink, err);
+    return;
   }
 
   if (type == llv8_->types()->kJSArrayType) {
     v8::JSArray arr(heap_object);
-    return pre + Stringify(arr, err);
+    sink->Write(pre);
+    Print(arr, sink, err);
+    return;
   }
 
   if (type == llv8_->types()->kOddballType) {
     v8::Oddball o(heap_object);
-    return pre + Stringify(o, err);
+    sink->Write(pre);
+    Print(o, sink, err);
+    return;
   }
 
   if (type == llv8_->types()->kJSFunctionType) {
     v8::JSFunction fn(heap_object);
-    return pre + Stringify(fn, err);
+    sink->Write(pre);
+    Print(fn, sink, err);
+    return;
   }
 
   if (type == *llv8_->types()->kJSRegExpType) {
     v8::JSRegExp re(heap_object);
-    return pre + Stringify(re, err);
+    sink->Write(pre);
+    Print(re, sink, err);
+    return;
   }
 
   if (type < llv8_->types()->kFirstNonstringType) {
     v8::String str(heap_object);
-    return pre + Stringify(str, err);
+    sink->Write(pre);
+    Print(str, sink, err);
+    return;
   }
 
   if (type >= llv8_->types()->kFirstContextType &&
       type <= llv8_->types()->kLastContextType) {
     v8::Context ctx(heap_object);
-    return pre + Stringify(ctx, err);
+    sink->Write(pre);
+    Print(ctx, sink, err);
+    return;
   }
 
   if (type == llv8_->types()->kFixedArrayType) {
     v8::FixedArray arr(heap_object);
-    return pre + Stringify(arr, err);
+    sink->Write(pre);
+    Print(arr, sink, err);
+    return;
   }
 
   if (type == llv8_->types()->kJSArrayBufferType) {
     v8::JSArrayBuffer buf(heap_object);
-    return pre + Stringify(buf, err);
+    sink->Write(pre);
+    Print(buf, sink, err);
+    return;
   }
 
   if (type == llv8_->types()->kJSTypedArrayType) {
     v8::JSTypedArray typed_array(heap_object);
-    return pre + Stringify(typed_array, err);
+    sink->Write(pre);
+    Print(typed_array, sink, err);
+    return;
   }
 
   if (type == llv8_->types()->kJSDateType) {
     v8::JSDate date(heap_object);
-    return pre + Stringify(date, err);
+    sink->Write(pre);
+    Print(date, sink, err);
+    return;
   }
 
   PRINT_DEBUG("Unknown HeapObject Type %" PRId64 " at 0x%016" PRIx64 "", type,
@@ -761,234 +1084,305 @@ std::string Printer::Stringify(v8::HeapObject heap_object, Error& err) {
 
   std::stringstream ss;
   ss << rang::fg::yellow << "<unknown>" << rang::fg::reset;
-  return pre + ss.str().c_str();
+  sink->Write(pre + ss.str());
 }
 
 template <>
-std::string Printer::Stringify(v8::Value value, Error& err) {
+void Printer::Print(v8::Value value, OutputSink* sink, Error& err) {
   v8::Smi smi(value);
-  if (smi.Check()) return Stringify(smi, err);
+  if (smi.Check()) {
+    Print(smi, sink, err);
+    return;
+  }
 
   v8::HeapObject obj(value);
   if (!obj.Check()) {
     err = Error::Failure("Not object and not smi");
-    return std::string();
+    return;
+  }
+
+  Print(obj, sink, err);
+}
+
+template <>
+std::string Printer::Stringify(v8::HeapObject heap_object, Error& err) {
+  return PrintToString(heap_object, err);
+}
+
+template <>
+std::string Printer::Stringify(v8::Value value, Error& err) {
+  return PrintToString(value, err);
+}
+
+Printer::ExpandState* Printer::expand_state() {
+  if (expand_ == nullptr) {
+    own_expand_.reset(new ExpandState());
+    expand_ = own_expand_.get();
+  }
+  return expand_;
+}
+
+
+bool Printer::IsExpandable(v8::HeapObject heap_object, Error& err) {
+  int64_t type = heap_object.GetType(err);
+  if (err.Fail()) return false;
+
+  return v8::JSObject::IsObjectType(llv8_, type) ||
+         type == llv8_->types()->kJSArrayType ||
+         type == llv8_->types()->kFixedArrayType ||
+         (type >= llv8_->types()->kFirstContextType &&
+          type <= llv8_->types()->kLastContextType);
+}
+
+
+void Printer::PrintChild(v8::Value value, OutputSink* sink, Error& err) {
+  Printer printer(llv8_);
+
+  v8::HeapObject heap_object(value);
+  if (!options_.detailed || options_.depth <= 1 || v8::Smi(value).Check() ||
+      !heap_object.Check() || !IsExpandable(heap_object, err)) {
+    if (err.Fail()) return;
+    sink->Write(printer.Stringify(value, err));
+    return;
   }
 
-  return Stringify(obj, err);
+  ExpandState* state = expand_state();
+
+  // Cycles and objects reachable through several paths are printed once
+  if (state->visited.count(heap_object.raw()) != 0) {
+    std::stringstream ss;
+    ss << printer.Stringify(value, err) << rang::fg::red << " [seen above]"
+       << rang::fg::reset;
+    sink->Write(ss.str());
+    return;
+  }
+
+  if (state->nodes >= options_.node_limit) {
+    sink->Write(printer.Stringify(value, err));
+    return;
+  }
+
+  state->visited.insert(heap_object.raw());
+  state->nodes++;
+
+  PrinterOptions options = options_;
+  options.depth--;
+  Printer nested(llv8_, options, state);
+  IndentSink indented(sink, std::string(PrinterOptions::kIndentSize * 2, ' '));
+  nested.Print(value, &indented, err);
 }
 
-std::string Printer::StringifyInternalFields(v8::JSObject js_object,
-                                             Error& err) {
+
+bool Printer::PrintInternalFields(v8::JSObject js_object, OutputSink* sink,
+                                  const std::string& opening, Error& err) {
   v8::HeapObject map_obj = js_object.GetMap(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
   v8::Map map(map_obj);
   int64_t type = map.GetType(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
   // Only v8::JSObject for now
-  if (!v8::JSObject::IsObjectType(llv8_, type)) return std::string();
+  if (!v8::JSObject::IsObjectType(llv8_, type)) return false;
 
   int64_t instance_size = map.InstanceSize(err);
 
   // kVariableSizeSentinel == 0
   // TODO(indutny): post-mortem constant for this?
-  if (err.Fail() || instance_size == 0) return std::string();
+  if (err.Fail() || instance_size == 0) return false;
 
   int64_t in_object_props = map.InObjectProperties(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
   // in-object properties are appended to the end of the v8::JSObject,
   // skip them.
-  instance_size -= in_object_props * llv8_->common()->kPointerSize;
+  instance_size -= in_object_props * llv8_->common()->kTaggedSize;
 
-  std::string res;
+  bool printed = false;
   std::stringstream ss;
   for (int64_t off = llv8_->js_object()->kInternalFieldsOffset;
-       off < instance_size; off += llv8_->common()->kPointerSize) {
-    int64_t field = js_object.LoadField(off, err);
-    if (err.Fail()) return std::string();
+       off < instance_size && !sink->full();
+       off += llv8_->common()->kPointerSize) {
+    // Embedder fields are full words even with pointer compression
+    int64_t field = js_object.LoadRawField(off, err);
+    if (err.Fail()) return printed;
 
     char tmp[128];
     snprintf(tmp, sizeof(tmp), "    0x%016" PRIx64, field);
 
-    if (!res.empty()) res += ",\n  ";
-
     ss.str("");
     ss.clear();
+    if (printed)
+      ss << ",\n  ";
+    else
+      ss << opening;
     ss << rang::fg::cyan << tmp << rang::fg::reset;
-    res += ss.str();
+    sink->Write(ss.str());
+    printed = true;
   }
 
-  return res;
+  return printed;
 }
 
 
-std::string Printer::StringifyProperties(v8::JSObject js_object, Error& err) {
-  std::string res;
+bool Printer::PrintProperties(v8::JSObject js_object, OutputSink* sink,
+                              Error& err) {
+  v8::HeapObject elements_obj = js_object.Elements(err);
+  if (err.Fail()) return false;
 
-  std::string elems = StringifyElements(js_object, err);
-  if (err.Fail()) return std::string();
+  v8::FixedArray elements(elements_obj);
 
-  if (!elems.empty()) {
-    std::stringstream ss;
-    ss << rang::fg::magenta << "elements" << rang::fg::reset << " {"
-       << std::endl
-       << elems << "}";
-    res = ss.str();
-  }
+  v8::Smi length_smi = elements.Length(err);
+  if (err.Fail()) return false;
+
+  std::stringstream ss;
+  ss << rang::fg::magenta << "elements" << rang::fg::reset << " {"
+     << std::endl;
+  bool printed =
+      PrintElements(js_object, length_smi.GetValue(), sink, ss.str(), err);
+  if (printed) sink->Write("}");
+  if (err.Fail()) return printed;
 
   v8::HeapObject map_obj = js_object.GetMap(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return printed;
 
   v8::Map map(map_obj);
 
-  std::string props;
   bool is_dict = map.IsDictionary(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return printed;
+
+  ss.str("");
+  ss.clear();
+  if (printed) ss << "\n  ";
+  ss << rang::fg::magenta << "properties" << rang::fg::reset << " {"
+     << std::endl;
 
+  bool printed_props;
   if (is_dict)
-    props = StringifyDictionary(js_object, err);
+    printed_props = PrintDictionary(js_object, sink, ss.str(), err);
   else
-    props = StringifyDescriptors(js_object, map, err);
-
-  if (err.Fail()) return std::string();
-
-  if (!props.empty()) {
-    if (!res.empty()) res += "\n  ";
-    std::stringstream ss;
-    ss << rang::fg::magenta << "properties" << rang::fg::reset << " {"
-       << std::endl
-       << props << "}";
-    res += ss.str().c_str();
-  }
-
-  return res;
-}
-
-std::string Printer::StringifyElements(v8::JSObject js_object, Error& err) {
-  v8::HeapObject elements_obj = js_object.Elements(err);
-  if (err.Fail()) return std::string();
+    printed_props = PrintDescriptors(js_object, map, sink, ss.str(), err);
 
-  v8::FixedArray elements(elements_obj);
-
-  v8::Smi length_smi = elements.Length(err);
-  if (err.Fail()) return std::string();
+  if (printed_props) sink->Write("}");
 
-  int64_t length = length_smi.GetValue();
-  return StringifyElements(js_object, length, err);
+  return printed || printed_props;
 }
 
 
-std::string Printer::StringifyElements(v8::JSObject js_object, int64_t length,
-                                       Error& err) {
+bool Printer::PrintElements(v8::JSObject js_object, int64_t length,
+                            OutputSink* sink, const std::string& opening,
+                            Error& err) {
   v8::HeapObject elements_obj = js_object.Elements(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
   v8::FixedArray elements(elements_obj);
 
-  Printer printer(llv8_);
-
-  std::string res;
-  for (int64_t i = 0; i < length; i++) {
+  bool printed = false;
+  for (int64_t i = 0; i < length && !sink->full(); i++) {
     v8::Value value = elements.Get<v8::Value>(i, err);
-    if (err.Fail()) return std::string();
+    if (err.Fail()) return printed;
 
     bool is_hole = value.IsHole(err);
-    if (err.Fail()) return std::string();
+    if (err.Fail()) return printed;
 
     // Skip holes
     if (is_hole) continue;
 
-    if (!res.empty()) res += ",\n";
-
     std::stringstream ss;
+    if (printed)
+      ss << ",\n";
+    else
+      ss << opening;
     ss << rang::style::bold << rang::fg::yellow << "    ["
        << static_cast<int>(i) << "]" << rang::fg::reset << rang::style::reset
        << "=";
-    res += ss.str();
+    sink->Write(ss.str());
+    printed = true;
 
-    res += printer.Stringify(value, err);
-    if (err.Fail()) return std::string();
+    PrintChild(value, sink, err);
+    if (err.Fail()) return printed;
   }
 
-  return res;
+  return printed;
 }
 
-std::string Printer::StringifyDictionary(v8::JSObject js_object, Error& err) {
+bool Printer::PrintDictionary(v8::JSObject js_object, OutputSink* sink,
+                              const std::string& opening, Error& err) {
   v8::HeapObject dictionary_obj = js_object.Properties(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
   v8::NameDictionary dictionary(dictionary_obj);
 
   int64_t length = dictionary.Length(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
-  Printer printer(llv8_);
-
-  std::string res;
+  bool printed = false;
   std::stringstream ss;
 
-  for (int64_t i = 0; i < length; i++) {
+  for (int64_t i = 0; i < length && !sink->full(); i++) {
     v8::Value key = dictionary.GetKey(i, err);
-    if (err.Fail()) return std::string();
+    if (err.Fail()) return printed;
 
     // Skip holes
     bool is_hole = key.IsHoleOrUndefined(err);
-    if (err.Fail()) return std::string();
+    if (err.Fail()) return printed;
     if (is_hole) continue;
 
     v8::Value value = dictionary.GetValue(i, err);
-    if (err.Fail()) return std::string();
-
-    if (!res.empty()) res += ",\n";
+    if (err.Fail()) return printed;
 
     ss.str("");
     ss.clear();
+    if (printed)
+      ss << ",\n";
+    else
+      ss << opening;
     ss << rang::style::bold << rang::fg::yellow << "    ." + key.ToString(err)
-       << rang::fg::reset << rang::style::reset;
-    res += ss.str() + "=";
-    if (err.Fail()) return std::string();
+       << rang::fg::reset << rang::style::reset << "=";
+    if (err.Fail()) return printed;
 
-    res += printer.Stringify(value, err);
-    if (err.Fail()) return std::string();
+    sink->Write(ss.str());
+    printed = true;
+
+    PrintChild(value, sink, err);
+    if (err.Fail()) return printed;
   }
 
-  return res;
+  return printed;
 }
 
 
-std::string Printer::StringifyDescriptors(v8::JSObject js_object, v8::Map map,
-                                          Error& err) {
+bool Printer::PrintDescriptors(v8::JSObject js_object, v8::Map map,
+                               OutputSink* sink, const std::string& opening,
+                               Error& err) {
   v8::HeapObject descriptors_obj = map.InstanceDescriptors(err);
-  RETURN_IF_INVALID(descriptors_obj, std::string());
+  RETURN_IF_INVALID(descriptors_obj, false);
 
   v8::DescriptorArray descriptors(descriptors_obj);
   int64_t own_descriptors_count = map.NumberOfOwnDescriptors(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
   int64_t in_object_count = map.InObjectProperties(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
   int64_t instance_size = map.InstanceSize(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
   v8::HeapObject extra_properties_obj = js_object.Properties(err);
-  if (err.Fail()) return std::string();
+  if (err.Fail()) return false;
 
   v8::FixedArray extra_properties(extra_properties_obj);
 
-  Printer printer(llv8_);
-
-  std::string res;
+  bool printed = false;
   std::stringstream ss;
-  for (int64_t i = 0; i < own_descriptors_count; i++) {
-    if (!res.empty()) res += ",\n";
-
+  for (int64_t i = 0; i < own_descriptors_count && !sink->full(); i++) {
     v8::Value key = descriptors.GetKey(i);
 
     ss.str("");
     ss.clear();
+    if (printed)
+      ss << ",\n";
+    else
+      ss << opening;
     ss << rang::style::bold << rang::fg::yellow << "    .";
     if (key.Check()) {
       ss << key.ToString(err);
@@ -996,15 +1390,15 @@ std::string Printer::StringifyDescriptors(v8::JSObject js_object, v8::Map map,
       PRINT_DEBUG("Failed to get key for index %ld", i);
       ss << "???";
     }
-    ss << rang::fg::reset << rang::style::reset;
-
-    res += ss.str() + "=";
-    if (err.Fail()) return std::string();
+    ss << rang::fg::reset << rang::style::reset << "=";
+    if (err.Fail()) return printed;
 
     v8::Smi details = descriptors.GetDetails(i);
     if (!details.Check()) {
       PRINT_DEBUG("Failed to get details for index %ld", i);
-      res += "???";
+      ss << "???";
+      sink->Write(ss.str());
+      printed = true;
       continue;
     }
 
@@ -1013,11 +1407,14 @@ std::string Printer::StringifyDescriptors(v8::JSObject js_object, v8::Map map,
       v8::Value value;
 
       value = descriptors.GetValue(i);
-      RETURN_IF_INVALID(value, std::string());
-      if (err.Fail()) return std::string();
+      RETURN_IF_INVALID(value, printed);
+      if (err.Fail()) return printed;
 
-      res += printer.Stringify(value, err);
-      if (err.Fail()) return std::string();
+      sink->Write(ss.str());
+      printed = true;
+
+      PrintChild(value, sink, err);
+      if (err.Fail()) return printed;
       continue;
     }
 
@@ -1027,44 +1424,55 @@ std::string Printer::StringifyDescriptors(v8::JSObject js_object, v8::Map map,
       v8::HeapNumber value = js_object.GetDoubleField(index, err);
 
       Error value_err;
-      res += value.ToString(true, value_err);
-    } else {
-      v8::Value value;
-      if (index < 0)
-        value =
-            js_object.GetInObjectValue<v8::Value>(instance_size, index, err);
-      else
-        value = extra_properties.Get<v8::Value>(index, err);
+      ss << value.ToString(true, value_err);
+      if (err.Fail()) return printed;
 
-      if (err.Fail()) return std::string();
-
-      res += printer.Stringify(value, err);
+      sink->Write(ss.str());
+      printed = true;
+      continue;
     }
-    if (err.Fail()) return std::string();
+
+    v8::Value value;
+    if (index < 0)
+      value = js_object.GetInObjectValue<v8::Value>(instance_size, index, err);
+    else
+      value = extra_properties.Get<v8::Value>(index, err);
+
+    if (err.Fail()) return printed;
+
+    sink->Write(ss.str());
+    printed = true;
+
+    PrintChild(value, sink, err);
+    if (err.Fail()) return printed;
   }
 
-  return res;
+  return printed;
 }
 
-std::string Printer::StringifyContents(v8::FixedArray fixed_array, int length,
-                                       Error& err) {
-  std::string res;
-  Printer printer(llv8_);
-
-  for (int i = 0; i < length; i++) {
+bool Printer::PrintContents(v8::FixedArray fixed_array, int length,
+                            OutputSink* sink, const std::string& opening,
+                            Error& err) {
+  bool printed = false;
+  for (int i = 0; i < length && !sink->full(); i++) {
     v8::Value value = fixed_array.Get<v8::Value>(i, err);
-    if (err.Fail()) return std::string();
-
-    if (!res.empty()) res += ",\n";
+    if (err.Fail()) return printed;
 
     std::stringstream ss;
+    if (printed)
+      ss << ",\n";
+    else
+      ss << opening;
     ss << rang::style::bold << rang::fg::yellow << "    [" << i << "]"
        << rang::fg::reset << rang::style::reset << "=";
-    res += ss.str() + printer.Stringify(value, err);
-    if (err.Fail()) return std::string();
+    sink->Write(ss.str());
+    printed = true;
+
+    PrintChild(value, sink, err);
+    if (err.Fail()) return printed;
   }
 
-  return res;
+  return printed;
 }
 
 std::string Printer::StringifyArgs(v8::JSFrame js_frame, v8::JSFunction fn,
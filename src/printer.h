@@ -1,7 +1,14 @@
 #ifndef SRC_INSPECT_H_
 #define SRC_INSPECT_H_
 
+#include <stdio.h>
+
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <lldb/API/LLDB.h>
 
@@ -10,6 +17,147 @@
 
 namespace llnode {
 
+// Destination of the Printer's output. Output is written as it's produced,
+// so large objects don't have to be rendered in memory first. Once `limit`
+// bytes were written the rest is dropped, and full() tells the Printer to
+// stop decoding.
+class OutputSink {
+ public:
+  OutputSink() : written_(0), limit_(0), full_(false) {}
+  virtual ~OutputSink() {}
+
+  void Write(const char* data, size_t length);
+  inline void Write(const std::string& data) {
+    Write(data.data(), data.size());
+  }
+  virtual void Flush() {}
+
+  // 0 means no limit
+  inline void set_limit(size_t limit) { limit_ = limit; }
+  virtual bool full() const { return full_; }
+  inline size_t written() const { return written_; }
+
+ protected:
+  virtual void Append(const char* data, size_t length) = 0;
+
+ private:
+  size_t written_;
+  size_t limit_;
+  bool full_;
+};
+
+class StringSink : public OutputSink {
+ public:
+  explicit StringSink(std::string* out) : out_(out) {}
+
+ protected:
+  void Append(const char* data, size_t length) override {
+    out_->append(data, length);
+  }
+
+ private:
+  std::string* out_;
+};
+
+// Writes to a file opened, and closed, by the caller.
+class FileSink : public OutputSink {
+ public:
+  explicit FileSink(FILE* file) : file_(file) {}
+
+ protected:
+  void Append(const char* data, size_t length) override {
+    fwrite(data, 1, length, file_);
+  }
+
+ private:
+  FILE* file_;
+};
+
+// Writes to the command's result in chunks.
+class ResultSink : public OutputSink {
+ public:
+  explicit ResultSink(lldb::SBCommandReturnObject& result) : result_(result) {}
+  ~ResultSink() override { Flush(); }
+
+  void Flush() override;
+
+ protected:
+  void Append(const char* data, size_t length) override;
+
+ private:
+  static const size_t kChunkSize = 64 * 1024;
+
+  lldb::SBCommandReturnObject& result_;
+  std::string buffer_;
+};
+
+// Indents every line after the first one before passing it on, used when
+// nested values are expanded in place.
+class IndentSink : public OutputSink {
+ public:
+  IndentSink(OutputSink* out, const std::string& indent)
+      : out_(out), indent_(indent) {}
+
+  bool full() const override { return out_->full(); }
+
+ protected:
+  void Append(const char* data, size_t length) override;
+
+ private:
+  OutputSink* out_;
+  std::string indent_;
+};
+
+// Streams a JSON document to an OutputSink, for commands' --json mode.
+// Colors are turned off while a writer is alive, so values rendered by the
+// Printer don't carry escape sequences.
+class JSONWriter {
+ public:
+  explicit JSONWriter(OutputSink* sink);
+  ~JSONWriter();
+
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+
+  void Key(const std::string& key);
+  void String(const std::string& value);
+  void Int(int64_t value);
+  // Addresses are written as "0x..." strings, JSON numbers can't hold them
+  void Address(uint64_t value);
+  void Bool(bool value);
+  void Null();
+
+ private:
+  void Separate();
+  void WriteEscaped(const std::string& value);
+
+  OutputSink* sink_;
+  // One entry per open object or array, true until it gets its first member
+  std::vector<bool> first_;
+  bool after_key_;
+};
+
+// Function names and locations by SharedFunctionInfo, so frames running
+// the same function are only decoded once. Safe to share between printers
+// on different threads.
+class FunctionNameCache {
+ public:
+  // Same as JSFunction::GetDebugLine
+  std::string GetDebugLine(v8::JSFunction fn, const std::string& args,
+                           Error& err);
+
+ private:
+  struct Entry {
+    std::string name;
+    std::string postfix;
+  };
+
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, Entry> entries_;
+};
+
 class Printer {
  public:
   class PrinterOptions {
@@ -21,9 +169,21 @@ class Printer {
           length(kLength),
           indent_depth(1),
           output_limit(0),
-          with_args(true) {}
+          page(0),
+          offset(-1),
+          start_address(0),
+          end_address(0),
+          sort_by_size(false),
+          byte_limit(0),
+          depth(1),
+          node_limit(kNodeLimit),
+          with_args(true),
+          json(false),
+          isolate(-1),
+          list_isolates(false) {}
 
     static const unsigned int kLength = 16;
+    static const unsigned int kNodeLimit = 10000;
     static const unsigned int kIndentSize = 2;
     inline std::string get_indent_spaces() const {
       return std::string(indent_depth * kIndentSize, ' ');
@@ -34,40 +194,102 @@ class Printer {
     unsigned int length;
     unsigned int indent_depth;
     int output_limit;
+    // findjsinstances paging and filters, see FindInstancesCmd
+    int page;
+    int offset;
+    uint64_t start_address;
+    uint64_t end_address;
+    bool sort_by_size;
+    size_t byte_limit;
+    // Levels of nested objects, arrays and contexts expanded in detailed mode
+    unsigned int depth;
+    // Maximum number of nested values expanded in a single command
+    unsigned int node_limit;
     bool with_args;
+    bool json;
+    // findjsinstances --output, rendered in parallel instead of printed
+    std::string output_file;
+    // findjsobjects --isolate and --isolates, see LLScan::GetIsolates().
+    // -1 selects every isolate, -2 means --isolate wasn't a valid number.
+    int isolate;
+    bool list_isolates;
   };
 
-  Printer(v8::LLV8* llv8) : llv8_(llv8), options_(){};
+  Printer(v8::LLV8* llv8)
+      : llv8_(llv8), options_(), expand_(nullptr), name_cache_(nullptr){};
   Printer(v8::LLV8* llv8, const PrinterOptions options)
-      : llv8_(llv8), options_(options){};
+      : llv8_(llv8),
+        options_(options),
+        expand_(nullptr),
+        name_cache_(nullptr){};
+
+  // Decode frame functions through `cache`
+  inline void set_name_cache(FunctionNameCache* cache) { name_cache_ = cache; }
 
   template <typename T, typename Actual = T>
   std::string Stringify(T value, Error& err);
 
+  // Write `value` to `sink` as it's decoded. Objects, arrays and their
+  // properties are streamed, everything else is written as a whole.
+  template <typename T>
+  void Print(T value, OutputSink* sink, Error& err);
+
+  // JSFrame Specific Methods
+  std::string StringifyArgs(v8::JSFrame js_frame, v8::JSFunction fn,
+                            Error& err);
+
+ private:
+  // Shared by the printers of one --depth expansion
+  struct ExpandState {
+    ExpandState() : nodes(0) {}
+
+    std::unordered_set<uint64_t> visited;
+    unsigned int nodes;
+  };
+
+  Printer(v8::LLV8* llv8, const PrinterOptions options, ExpandState* expand)
+      : llv8_(llv8),
+        options_(options),
+        expand_(expand),
+        name_cache_(nullptr){};
+
+  ExpandState* expand_state();
+
+  // Write a property, element or local. Up to `depth` levels of them are
+  // expanded in place, the rest is printed in short form.
+  void PrintChild(v8::Value value, OutputSink* sink, Error& err);
+  bool IsExpandable(v8::HeapObject heap_object, Error& err);
+
+  // The methods below return whether they wrote any entry. List printers
+  // write `opening` before their first entry.
+
   // JSObject Specific Methods
-  std::string StringifyInternalFields(v8::JSObject js_obj, Error& err);
-  std::string StringifyProperties(v8::JSObject js_obj, Error& err);
+  bool PrintInternalFields(v8::JSObject js_obj, OutputSink* sink,
+                           const std::string& opening, Error& err);
+  bool PrintProperties(v8::JSObject js_obj, OutputSink* sink, Error& err);
 
-  std::string StringifyElements(v8::JSObject js_obj, Error& err);
-  std::string StringifyElements(v8::JSObject js_obj, int64_t length,
-                                Error& err);
-  std::string StringifyDictionary(v8::JSObject js_obj, Error& err);
-  std::string StringifyDescriptors(v8::JSObject js_obj, v8::Map map,
-                                   Error& err);
+  bool PrintElements(v8::JSObject js_obj, int64_t length, OutputSink* sink,
+                     const std::string& opening, Error& err);
+  bool PrintDictionary(v8::JSObject js_obj, OutputSink* sink,
+                       const std::string& opening, Error& err);
+  bool PrintDescriptors(v8::JSObject js_obj, v8::Map map, OutputSink* sink,
+                        const std::string& opening, Error& err);
 
-  std::string StringifyJSObjectFields(v8::JSObject js_obj, Error& err);
+  void PrintJSObjectFields(v8::JSObject js_obj, OutputSink* sink, Error& err);
 
   // FixedArray Specific Methods
-  std::string StringifyContents(v8::FixedArray fixed_array, int length,
-                                Error& err);
+  bool PrintContents(v8::FixedArray fixed_array, int length, OutputSink* sink,
+                     const std::string& opening, Error& err);
 
-  // JSFrame Specific Methods
-  std::string StringifyArgs(v8::JSFrame js_frame, v8::JSFunction fn,
-                            Error& err);
+  // Render a streamed type to a string
+  template <typename T>
+  std::string PrintToString(T value, Error& err);
 
- private:
   v8::LLV8* llv8_;
   const PrinterOptions options_;
+  std::unique_ptr<ExpandState> own_expand_;
+  ExpandState* expand_;
+  FunctionNameCache* name_cache_;
 };
 
 }  // namespace llnode
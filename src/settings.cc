@@ -13,12 +13,15 @@ std::string Settings::SetColor(std::string option) {
   if (option == "auto" || option == "always" || option == "never")
     color = option;
 
+  RestoreColor();
+  return color;
+}
+
+void Settings::RestoreColor() {
   if (ShouldUseColor())
     rang::setControlMode(rang::control::Force);
   else
     rang::setControlMode(rang::control::Off);
-
-  return color;
 }
 
 int Settings::SetTreePadding(int option) {
@@ -26,6 +26,10 @@ class Settings {
  public:
   static Settings* GetSettings();
   std::string SetColor(std::string option);
+  // Re-apply the color setting after output that turned colors off. Unlike
+  // SetColor(GetColor()) it doesn't write the setting, so it is safe to call
+  // from several threads.
+  void RestoreColor();
   std::string GetColor() { return color; };
   bool ShouldUseColor();
   int GetTreePadding() { return tree_padding; };
@@ -13,8 +13,8 @@ tape('llnode API', (t) => {
 
   // Use prepared core and executable to test
   if (process.env.LLNODE_CORE && process.env.LLNODE_NODE_EXE) {
-    test(process.env.LLNODE_NODE_EXE, process.env.LLNODE_CORE, t);
-    t.end();
+    test(process.env.LLNODE_NODE_EXE, process.env.LLNODE_CORE, t)
+      .then(() => t.end(), t.end);
   } else {
     common.saveCore({
       scenario: 'inspect-scenario.js'
@@ -22,8 +22,7 @@ tape('llnode API', (t) => {
       t.error(err);
       t.ok(true, 'Saved core');
 
-      test(process.execPath, common.core, t);
-      t.end();
+      test(process.execPath, common.core, t).then(() => t.end(), t.end);
     });
   }
 });
@@ -38,6 +37,9 @@ function test(executable, core, t) {
   const typeMap = verifyBasicTypes(llnode, t);
   const processType = verifyProcessType(typeMap, llnode, t);
   verifyProcessInstances(processType, llnode, t);
+  verifyInstanceAddresses(processType, llnode, t);
+  verifyObjectInfo(processType, llnode, t);
+  return verifyAsync(processType, core, executable, t);
 }
 
 function verifySBProcess(llnode, t) {
@@ -154,3 +156,72 @@ function verifyProcessInstances(processType, llnode, t) {
     t.skip('should find the process object');
   }
 }
+
+function verifyInstanceAddresses(processType, llnode, t) {
+  const addresses = processType.instanceAddresses;
+  t.ok(addresses instanceof BigUint64Array,
+    'instanceAddresses should be a BigUint64Array');
+  t.equal(addresses.length, processType.instanceCount,
+    'instanceAddresses should hold every instance');
+
+  const objects = llnode.getObjectsAtAddresses(addresses);
+  t.equal(objects.length, addresses.length,
+    'getObjectsAtAddresses should decode every address');
+  t.equal(BigInt(objects[0].address), addresses[0],
+    'getObjectsAtAddresses should keep the order of the addresses');
+  t.deepEqual(objects[0], llnode.getObjectAtAddress(objects[0].address),
+    'getObjectsAtAddresses should decode the same object as ' +
+    'getObjectAtAddress');
+
+  // The array is a copy, writing to it leaves llnode's instance list alone
+  const first = addresses[0];
+  addresses[0] = 0n;
+  t.equal(processType.instanceAddresses[0], first,
+    'instanceAddresses should not expose the scan state');
+}
+
+function verifyObjectInfo(processType, llnode, t) {
+  const pid = llnode.getProcessObject().pid;
+  let processInfo;
+  for (const address of processType.instanceAddresses) {
+    const info = llnode.getObjectInfo(`0x${address.toString(16)}`);
+    if (info.properties && 'pid' in info.properties) {
+      processInfo = info;
+      break;
+    }
+  }
+
+  t.ok(processInfo, 'getObjectInfo should decode the process properties');
+  t.equal(processInfo.kind, 'object', 'process should be an object');
+  t.equal(processInfo.typeName, 'process', 'process should have a type name');
+  t.ok(/^0x[0-9a-f]+$/.test(processInfo.map), 'process should have a map');
+
+  const pidInfo = processInfo.properties.pid;
+  t.equal(pidInfo.kind, 'smi', 'process.pid should be decoded lazily');
+  t.equal(pidInfo.value, pid, 'process.pid should be the process id');
+
+  const argv = processInfo.properties.argv;
+  t.equal(argv.kind, 'array', 'process.argv should be an array');
+  t.equal(argv.elements[0].kind, 'string',
+    'process.argv elements should be strings');
+}
+
+async function verifyAsync(processType, core, executable, t) {
+  debug('============= Async API ==============');
+  const llnode = fromCoredump(core, executable);
+
+  const pending = llnode.getHeapTypesAsync();
+  t.throws(() => llnode.getHeapTypes(), /busy/,
+    'Synchronous calls should throw while a scan is pending');
+
+  const heapTypes = await pending;
+  const asyncType = heapTypes.find((type) => type.typeName === 'process');
+  t.ok(asyncType, 'getHeapTypesAsync should find the process type');
+  t.equal(asyncType.instanceCount, processType.instanceCount,
+    'getHeapTypesAsync should count the same instances');
+
+  const [instance] = asyncType.instances;
+  const object = await llnode.getObjectAtAddressAsync(instance.address);
+  t.deepEqual(object, instance,
+    'getObjectAtAddressAsync should decode the same object');
+}
@@ -0,0 +1,78 @@
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const spawnSync = require('child_process').spawnSync;
+const tape = require('tape');
+
+const common = require('../common');
+
+const batchPath = ['Release', 'Debug']
+  .map((config) => path.join(common.projectDir, 'build', config, 'llnode-batch'))
+  .find((file) => fs.existsSync(file));
+
+function test(executable, core, t) {
+  const proc = spawnSync(batchPath, [
+    '-j', '2', '-r', 'process,heap,instances=Object', '-n', '5',
+    executable, core, core
+  ], { encoding: 'utf8' });
+  t.equal(proc.status, 0, 'llnode-batch should analyze every core');
+
+  const reports = proc.stdout.trim().split('\n').map((line) => JSON.parse(line));
+  t.equal(reports.length, 2, 'There should be a report per core');
+
+  for (const report of reports) {
+    t.equal(report.core, core, 'The report should name its core');
+    t.ok(report.process.pid > 0, 'The report should have the process');
+    t.ok(report.heap.types.some((type) => type.name === 'Object'),
+      'The heap section should list the Object type');
+    t.equal(report.instances[0].type, 'Object',
+      'The instances section should list Object instances');
+    t.equal(report.instances[0].objects.length, 5,
+      'Instances should be limited by --limit');
+  }
+
+  // The same core twice must not write the same report file
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'llnode-batch-'));
+  const output = spawnSync(batchPath, [
+    '-r', 'process', '-o', dir, executable, core, core
+  ], { encoding: 'utf8' });
+  t.equal(output.status, 0, 'llnode-batch should write every report');
+
+  const base = path.basename(core);
+  const files = fs.readdirSync(dir).sort();
+  t.deepEqual(files, [`${base}-1.json`, `${base}-2.json`],
+    'Cores with the same name should get their position appended');
+  for (const file of files) {
+    const report = JSON.parse(fs.readFileSync(path.join(dir, file), 'utf8'));
+    t.equal(report.core, core, 'The report file should hold its core');
+    fs.unlinkSync(path.join(dir, file));
+  }
+  fs.rmdirSync(dir);
+}
+
+tape('llnode-batch', (t) => {
+  t.timeoutAfter(common.saveCoreTimeout);
+
+  if (!batchPath) {
+    t.skip('llnode-batch is not built, see `make batch`');
+    return t.end();
+  }
+
+  // Use prepared core and executable to test
+  if (process.env.LLNODE_CORE && process.env.LLNODE_NODE_EXE) {
+    test(process.env.LLNODE_NODE_EXE, process.env.LLNODE_CORE, t);
+    t.end();
+  } else {
+    common.saveCore({
+      scenario: 'inspect-scenario.js'
+    }, (err) => {
+      t.error(err);
+      t.ok(true, 'Saved core');
+
+      test(process.execPath, common.core, t);
+      t.end();
+    });
+  }
+});
@@ -78,6 +78,8 @@ function SessionOutput(session, stream, timeout) {
     }
   }
 
+  // Decode as UTF-8 so multi-byte characters split across chunks survive.
+  stream.setEncoding('utf8');
   stream.on('data', (data) => {
     buf += data;
     this.flush();
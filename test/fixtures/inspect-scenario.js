@@ -39,6 +39,10 @@ function closure() {
       'this could be a bit smaller, but v8 wants big str.';
   c.hashmap['cons-string'] += c.hashmap['cons-string'];
   c.hashmap['internalized-string'] = 'foobar';
+  // Two-byte string with BMP characters and a surrogate pair.
+  c.hashmap['two-byte-string'] = '\u4f60\u597d, \u00e9t\u00e9 \ud83d\ude00';
+  // One-byte string with Latin-1 characters outside of ASCII.
+  c.hashmap['latin1-string'] = '\u00e9t\u00e9 \u00a9';
   // This thin string points to the previous 'foobar'.
   c.hashmap['thin-string'] = makeThin('foo', 'bar');
   // Create an externalized string and slice it.
@@ -106,6 +110,14 @@ function closure() {
 
   let classC = new Class_C(arr);
 
+  // A view that starts in the middle of its buffer, kept out of the hashmap
+  // since views don't print on every version of node.
+  function Class_View() {
+    const bytes = new Uint8Array([0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07]);
+    this.view = new Uint8Array(bytes.buffer, 3, 4);
+  }
+  const classView = new Class_View();
+
   c.method();
 }
 
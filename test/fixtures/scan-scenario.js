@@ -44,6 +44,8 @@ function closure() {
 
   function Class_B() {
     this.my_class_b = "Class B";
+    // Latin-1 one-byte string, for the UTF-8 of the --json output
+    this.label = 'caf\u00e9';
   }
 
   function Class_C(class_b_array) {
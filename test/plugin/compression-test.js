@@ -0,0 +1,47 @@
+'use strict';
+
+const tape = require('tape');
+
+const common = require('../common');
+
+// Only builds of node with pointer compression store tagged fields as 4-byte
+// compressed values.
+const compressed = /^(1|true)$/.test(
+    String(process.config.variables.v8_enable_pointer_compression));
+
+tape('v8 pointer compression', (t) => {
+  t.timeoutAfter(60000);
+
+  if (!compressed) {
+    t.skip('node was built without pointer compression');
+    return t.end();
+  }
+
+  const sess = common.Session.create('inspect-scenario.js');
+
+  sess.waitBreak((err) => {
+    t.error(err);
+    sess.send('v8 findjsinstances Class');
+  });
+
+  // Heap objects are only found by the scan once compressed pointers to
+  // their maps decode inside the isolate's cage
+  sess.wait(/0x[0-9a-f]+:<Object: Class>/, (err, line) => {
+    t.error(err);
+    const address = line.match(/(0x[0-9a-f]+):<Object: Class>/)[1];
+    sess.send(`v8 inspect ${address}`);
+    sess.linesUntil(/}>/, (err, lines) => {
+      t.error(err);
+      lines = lines.join('\n');
+      t.ok(/x=<Smi: 1>/.test(lines),
+           'a compressed Smi should be sign-extended');
+      const hashmap = lines.match(/hashmap=(0x[0-9a-f]+):<Object: Object>/);
+      t.ok(hashmap, 'a compressed pointer should decode to an object');
+      t.ok(hashmap && hashmap[1].length > 10,
+           'a decompressed pointer should include the cage base');
+
+      sess.quit();
+      t.end();
+    });
+  });
+});
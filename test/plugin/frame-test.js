@@ -77,7 +77,7 @@ tape('v8 stack', async (t) => {
     lines.reverse();
     t.ok(lines.length > 4, 'frame count');
 
-    lines = lines.filter((s) => !/<builtin>|<stub>/.test(s));
+    lines = lines.filter((s) => !/<builtin(: \w+)?>|<stub>/.test(s));
     const hasArgumentAdaptorFrame = nodejsVersion()[0] < 16;
     const argumentAdaptorOffset = hasArgumentAdaptorFrame ? 1 : 0;
     const exit = lines[4 + argumentAdaptorOffset];
@@ -107,6 +107,16 @@ tape('v8 stack', async (t) => {
          'global this');
     t.ok(/this=(0x[0-9a-f]+):<undefined>/.test(crasher), 'undefined this');
 
+    sess.send('v8 bt all');
+    const allLines = await sess.linesUntil(/\sfnFunctionName at /);
+    t.ok(allLines.some((line) => /^ \* \d+ threads?: #\d+/.test(line)),
+         'bt all lists threads by stack');
+
+    sess.send('v8 dump stacks');
+    const folded = await sess.linesUntil(/;fnFunctionName at .* \d+$/);
+    t.ok(/;crasher at [^;]*;fnFunctionName at /.test(folded[folded.length - 1]),
+         'dump stacks writes folded stacks from the root down');
+
     // TODO(kvakil): This doesn't work on Node 16 for some reason. Skipping for
     // now.
     if (nodejsVersion()[0] == 16) {
@@ -1,5 +1,8 @@
 'use strict';
 
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
 const tape = require('tape');
 
 const common = require('../common');
@@ -104,6 +107,16 @@ const hashMapTests = {
     re: /.internalized-string=(0x[0-9a-f]+):<String: "foobar">/,
     desc: '.internalized-string Internalized String property'
   },
+  // .two-byte-string=0x000003df9cbe7601:<String: "你好, été 😀">,
+  'two-byte-string': {
+    re: /.two-byte-string=(0x[0-9a-f]+):<String: "\u4f60\u597d, \u00e9t\u00e9 \ud83d\ude00">/,
+    desc: '.two-byte-string TwoByteString property'
+  },
+  // .latin1-string=0x000003df9cbe7611:<String: "été ©">,
+  'latin1-string': {
+    re: /.latin1-string=(0x[0-9a-f]+):<String: "\u00e9t\u00e9 \u00a9">/,
+    desc: '.latin1-string OneByteString property'
+  },
   // .thin-string=0x000003df9cbe7621:<String: "foobar">,
   'thin-string': {
     re: /.thin-string=(0x[0-9a-f]+):<String: "foobar">/,
@@ -122,14 +135,26 @@ const hashMapTests = {
       });
     }
   },
-  // .externalized-string=0x000036eccf7bdb41:<String: "(external)">,
+  // .externalized-string=0x000036eccf7bdb41:<String: "string that will...">,
   'externalized-string': {
-    re: /.externalized-string=(0x[0-9a-f]+):<String: "\(external\)">/,
-    desc: '.externalized-string ExternalString property'
+    re: /.externalized-string=(0x[0-9a-f]+):<String: "string that will...">/,
+    desc: '.externalized-string ExternalString property',
+    validator(t, sess, addresses, name, cb) {
+      const address = addresses[name];
+      sess.send(`v8 inspect -F ${address}`);
+
+      sess.linesUntil(/">/, (err, lines) => {
+        if (err) return cb(err);
+        lines = lines.join('\n');
+        t.ok(lines.includes('string that will be externalized and sliced'),
+            'hashmap.externalized-string should have the right content');
+        cb(null);
+      });
+    }
   },
-  // .sliced-externalized-string=0x000003df9cbe77e9:<String: "(external)">,
+  // .sliced-externalized-string=0x000003df9cbe77e9:<String: "t will be extern...">,
   'sliced-externalized-string': {
-    re: /.sliced-externalized-string=(0x[0-9a-f]+):<String: "\(external\)">/,
+    re: /.sliced-externalized-string=(0x[0-9a-f]+):<String: "t will be extern...">/,
     desc: '.sliced-externalized-string Sliced ExternalString property'
   },
   // .error=0x0000392d5d661119:<Object: Error>
@@ -219,7 +244,7 @@ const hashMapTests = {
   'long-array': {
     re: /.long-array=(0x[0-9a-f]+):<Array: length=20>/,
     desc: '.long-array JSArray property',
-    validator(t, sess, addresses, name, cb) {
+    validators: [(t, sess, addresses, name, cb) => {
       const address = addresses[name];
       sess.send(`v8 inspect -l 10 ${address}`);
 
@@ -232,7 +257,22 @@ const hashMapTests = {
             'hashmap.long-array should have the right content');
         cb(null);
       });
-    }
+    }, (t, sess, addresses, name, cb) => {
+      const address = addresses[name];
+      sess.send(`v8 inspect -l 20 --byte-limit 100 ${address}`);
+
+      sess.linesUntil(/output truncated/, (err, lines) => {
+        if (err) return cb(err);
+        lines = lines.join('\n');
+        t.ok(lines.includes('<Array: length=20'),
+            'hashmap.long-array should start printing with --byte-limit');
+        t.ok(/\(output truncated after \d+ bytes\)/.test(lines),
+            'hashmap.long-array should be truncated with --byte-limit');
+        t.notOk(lines.includes('[19]='),
+            'hashmap.long-array should stop before the last element');
+        cb(null);
+      });
+    }]
   },
   // .array-buffer=0x000003df9cbe7df1:<ArrayBuffer: backingStore=0x00000000022509b0, byteLength=5>,
   'array-buffer': {
@@ -276,6 +316,20 @@ const hashMapTests = {
             '--array-length 1');
         cb(null);
       });
+    }, (t, sess, addresses, name, cb) => {
+      const address = addresses[name];
+      const file = path.join(os.tmpdir(), `llnode-dump-${process.pid}.bin`);
+      sess.send(`v8 dump buffer ${address} ${file}`);
+
+      sess.wait(/Wrote \d+ bytes/, (err, line) => {
+        if (err) return cb(err);
+        t.ok(/Wrote 5 bytes from 0x[0-9a-f]+ to /.test(line),
+            'v8 dump buffer should report the number of bytes written');
+        t.deepEqual(fs.readFileSync(file), Buffer.from([1, 2, 3, 4, 5]),
+            'v8 dump buffer should write the backing store to the file');
+        fs.unlinkSync(file);
+        cb(null);
+      });
     }]
   },
   // .uint8-array=0x0000393071133e59:<ArrayBufferView: backingStore=0x000000000195b230, byteOffset=0, byteLength=6>,
@@ -568,11 +622,28 @@ function verifyClass(t, sess, that) {
       if (!match) {
         return teardown(t, sess);
       }
-      verifyObject(t, sess, match[1]);
+      verifyDepth(t, sess, that, match[1]);
     });
   });
 }
 
+function verifyDepth(t, sess, that, hashmap) {
+  sess.send(`v8 inspect --depth 2 ${that}`);
+  // Just a separator
+  sess.send('version');
+  sess.linesUntil(common.versionMark, (err, lines) => {
+    if (err) {
+      return teardown(t, sess, err);
+    }
+    lines = lines.join('\n');
+    t.ok(lines.includes(`hashmap=${hashmap}:<Object: Object`),
+        'this.hashmap should be printed with --depth 2');
+    t.ok(/\.some-key=<Smi: 42>/.test(lines),
+        'this.hashmap should be expanded with --depth 2');
+    verifyObject(t, sess, hashmap);
+  });
+}
+
 function verifyObject(t, sess, hashmap) {
   sess.send(`v8 inspect ${hashmap}`);
   sess.wait(/Object/, (err, line) => {
@@ -673,10 +744,40 @@ function verifyInvalidExpr(t, sess) {
       /use of undeclared identifier 'invalid_expr'/.test(line),
       'invalid expression should return an error'
     );
-    teardown(t, sess);
+    verifyDumpView(t, sess);
   }, false);
 }
 
+function verifyDumpView(t, sess) {
+  sess.send('v8 findjsinstances Class_View');
+  sess.wait(/<Object: Class_View>/, (err, line) => {
+    if (err) {
+      return teardown(t, sess, err);
+    }
+    const that = line.match(/(0x[0-9a-f]+):<Object: Class_View>/)[1];
+    sess.send(`v8 inspect ${that}`);
+    sess.wait(/\.view=(0x[0-9a-f]+):/, (err, line) => {
+      if (err) {
+        return teardown(t, sess, err);
+      }
+      const view = line.match(/\.view=(0x[0-9a-f]+):/)[1];
+      const file = path.join(os.tmpdir(), `llnode-view-${process.pid}.bin`);
+      sess.send(`v8 dump buffer ${view} ${file}`);
+      sess.wait(/Wrote \d+ bytes/, (err, line) => {
+        if (err) {
+          return teardown(t, sess, err);
+        }
+        t.ok(/Wrote 4 bytes from 0x[0-9a-f]+ to /.test(line),
+            'v8 dump buffer should only write the bytes of the view');
+        t.deepEqual(fs.readFileSync(file), Buffer.from([4, 5, 6, 7]),
+            'v8 dump buffer should start at the byteOffset of the view');
+        fs.unlinkSync(file);
+        teardown(t, sess);
+      });
+    });
+  });
+}
+
 tape('v8 inspect', (t) => {
   t.timeoutAfter(30000);
 
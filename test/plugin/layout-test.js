@@ -0,0 +1,73 @@
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const tape = require('tape');
+
+const common = require('../common');
+
+tape('v8 layout save and load', (t) => {
+  t.timeoutAfter(60000);
+
+  const profile = path.join(os.tmpdir(), `llnode-${process.pid}.layout`);
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'llnode-layouts-'));
+  const emptyDir = fs.mkdtempSync(path.join(os.tmpdir(), 'llnode-layouts-'));
+  function cleanup() {
+    for (const file of fs.readdirSync(dir))
+      fs.unlinkSync(path.join(dir, file));
+    fs.rmdirSync(dir);
+    fs.rmdirSync(emptyDir);
+    if (fs.existsSync(profile))
+      fs.unlinkSync(profile);
+  }
+
+  const sess = common.Session.create('inspect-scenario.js');
+
+  sess.waitBreak((err) => {
+    t.error(err);
+    sess.send(`v8 layout save ${profile}`);
+  });
+
+  sess.wait(/Layout profile written to/, (err) => {
+    t.error(err);
+    const entries = fs.readFileSync(profile, 'utf8').split('\n')
+        .filter((line) => line && line[0] !== '#');
+    t.ok(entries.every((line) => /^\S+ -?\d+$/.test(line)),
+         'layout save should write one "name value" line per constant');
+
+    sess.send(`v8 layout load ${profile}`);
+  });
+
+  sess.wait(/Layout profile loaded from/, (err, line) => {
+    t.error(err);
+    t.ok(line.includes(profile), 'layout load should read the saved file');
+
+    // Directories are searched for a profile named after the V8 version
+    const contents = fs.readFileSync(profile, 'utf8');
+    const major = contents.match(/^v8::internal::Version::major_ (\d+)$/m);
+    const minor = contents.match(/^v8::internal::Version::minor_ (\d+)$/m);
+    if (!major || !minor) {
+      t.skip('target has no V8 version constants');
+      sess.send(`v8 layout load ${profile}`);
+      return;
+    }
+    fs.writeFileSync(path.join(dir, `${major[1]}.${minor[1]}.layout`),
+                     contents);
+    sess.send(`v8 layout load ${dir}`);
+  });
+
+  sess.wait(/Layout profile loaded from/, (err) => {
+    t.error(err);
+    sess.send(`v8 layout load ${emptyDir}`);
+    sess.waitError(/error:/, (err, line) => {
+      t.error(err);
+      t.ok(/No layout profile for V8 \d+\.\d+|pass a profile file/.test(line),
+           'layout load should report a directory without a profile');
+
+      cleanup();
+      sess.quit();
+      t.end();
+    });
+  });
+});
@@ -1,5 +1,8 @@
 'use strict';
 
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
 const tape = require('tape');
 const common = require('../common');
 const versionMark = common.versionMark;
@@ -35,6 +38,10 @@ function testFindrefsForInvalidExpr(t, sess, next) {
 }
 
 function test(executable, core, t) {
+  const instancesFile = path.join(os.tmpdir(), `llnode-instances-${process.pid}`);
+  const perfMapFile = path.join(os.tmpdir(), `llnode-perf-${process.pid}.map`);
+  const snapshotFile =
+      path.join(os.tmpdir(), `llnode-${process.pid}.heapsnapshot`);
   const sess = common.Session.loadCore(executable, core, (err) => {
     t.error(err);
     t.ok(true, 'Loaded core');
@@ -58,6 +65,140 @@ function test(executable, core, t) {
     t.ok(/3 +0 Class: x, y, hashmap/.test(lines.join('\n')),
          '"Class: x, y, hashmap" should be in findjsobjects -d');
 
+    sess.send('v8 findjsobjects --json');
+    // Just a separator
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    const json = JSON.parse(lines.find((line) => /^{/.test(line)));
+    const classB = json.types.find((type) => type.name === 'Class_B');
+    t.ok(classB && classB.instances === 10,
+         'Class_B should have 10 instances in findjsobjects --json');
+
+    sess.send('v8 findjsobjects --isolates --json');
+    // Just a separator
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    const json = JSON.parse(lines.find((line) => /^{/.test(line)));
+    t.equal(json.isolates[0] && json.isolates[0].isolate, 1,
+            'findjsobjects --isolates should list the main isolate first');
+    t.ok(json.isolates[0] && json.isolates[0].instances > 0,
+         'The main isolate should have instances');
+    t.ok(json.isolates.every((isolate, i) =>
+           isolate.isolate !== 0 || i === json.isolates.length - 1),
+         'Objects without an isolate should be listed last');
+
+    sess.send('v8 findjsobjects --isolate 1x');
+    sess.waitError(/error:/, (err, line) => {
+      t.error(err);
+      t.ok(/--isolate expects the number of an isolate/.test(line),
+           'findjsobjects --isolate should reject what is not a number');
+
+      sess.send('v8 findjsinstances --json -n 5 Class_B');
+      // Just a separator
+      sess.send('version');
+    });
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    const json = JSON.parse(lines.find((line) => /^{/.test(line)));
+    t.equal(json.total, 10, 'findjsinstances --json should count 10 instances');
+    t.equal(json.instances.length, 5, 'findjsinstances --json should list 5');
+    t.ok(/^0x[0-9a-f]+$/.test(json.instances[0].address),
+         'Instances should have an address');
+    t.ok(json.truncated, 'Should show that more instances are available');
+
+    sess.send('v8 findjsinstances --json -v -n 1 Class_B');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    const json = JSON.parse(lines.find((line) => /^{/.test(line)));
+    t.ok(json.instances[0].value.includes('"caf\u00e9"'),
+         'findjsinstances --json should write Latin-1 strings as UTF-8');
+
+    sess.send('v8 findjsinstances -n 4 --page 3 Class_B');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+
+    t.ok((lines.join('\n').match(/<Object: Class_B>/g)).length == 2, 'Should show 2 instances');
+    t.ok(/\(Showing 9 to 10 of 10 instances\)/.test(lines.join('\n')), 'Should show 9 to 10 ');
+
+    sess.send('v8 findjsinstances -n 10 --byte-limit 100 Class_B');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+
+    const output = lines.join('\n');
+    const shown = output.match(/\(Showing 1 to (\d+) of 10 instances\)/);
+    t.ok(/output truncated/.test(output), 'Should truncate with --byte-limit');
+    t.ok(shown, 'Should show where --byte-limit stopped');
+    t.equal(Number(shown && shown[1]),
+            output.match(/<Object: Class_B>/g).length,
+            'Should not count the instance cut by --byte-limit as shown');
+
+    sess.send(`v8 findjsinstances --output ${instancesFile} Class_B`);
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.ok(/Wrote 10 instances of Class_B/.test(lines.join('\n')),
+         'findjsinstances --output should report the instances written');
+    const written = fs.readFileSync(instancesFile, 'utf8');
+    fs.unlinkSync(instancesFile);
+    t.equal(written.match(/<Object: Class_B>/g).length, 10,
+            'findjsinstances --output should write every instance');
+
+    sess.send(`v8 dump perfmap ${perfMapFile}`);
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.ok(/Wrote \d+ entries to /.test(lines.join('\n')),
+         'v8 dump perfmap should report the entries written');
+    const map = fs.readFileSync(perfMapFile, 'utf8');
+    fs.unlinkSync(perfMapFile);
+    t.ok(map.split('\n').every((line) => line === '' ||
+                                /^[0-9a-f]+ [0-9a-f]+ JS:/.test(line)),
+         'v8 dump perfmap should write perf map lines');
+
+    sess.send(`v8 heapsnapshot ${snapshotFile}`);
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.ok(/Wrote \d+ nodes and \d+ edges to /.test(lines.join('\n')),
+         'v8 heapsnapshot should report the nodes and edges written');
+    const snapshot = JSON.parse(fs.readFileSync(snapshotFile, 'utf8'));
+    fs.unlinkSync(snapshotFile);
+    const meta = snapshot.snapshot.meta;
+    t.equal(snapshot.nodes.length,
+            snapshot.snapshot.node_count * meta.node_fields.length,
+            'heapsnapshot node_count should match the nodes');
+    t.equal(snapshot.edges.length,
+            snapshot.snapshot.edge_count * meta.edge_fields.length,
+            'heapsnapshot edge_count should match the edges');
+    const names = [];
+    for (let i = 0; i < snapshot.nodes.length; i += meta.node_fields.length)
+      names.push(snapshot.strings[snapshot.nodes[i + 1]]);
+    t.equal(names.filter((name) => name === 'Class_B').length, 10,
+            'heapsnapshot should have a node per Class_B instance');
+
     sess.send('v8 findjsinstances Class_B')
     // Just a separator
     sess.send('version');
@@ -130,6 +271,20 @@ function test(executable, core, t) {
   sess.linesUntil(versionMark, (err, lines) => {
     t.error(err);
     t.ok(/Class_C\.arr/.test(lines.join('\n')), 'Should find parent reference with -r -n' );
+    sess.send('v8 findrefs -n label --json');
+    sess.send('version');
+  });
+
+  // Test that findrefs walks every property of the objects it scans
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    const json = JSON.parse(lines.find((line) => /^{/.test(line)));
+    const refs = json.references.filter((ref) => ref.type === 'Class_B');
+    t.equal(refs.length, 10, 'findrefs -n should find label on every Class_B');
+    t.ok(refs.every((ref) => ref.property === 'label'),
+         'findrefs -n should report the property found');
+    t.equal(json.partial_objects, 0,
+            'findrefs should decode the properties of every object');
     // TODO(mmarchini) see comment below
     // sess.send('v8 findrefs -s "My Class C"');
     sess.send('v8 findjsinstances Zlib');